@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory.h>
 #include <math.h>
 #include "util.h"
 #include "graphics.h"
@@ -97,6 +98,8 @@ void CCol::Set(int x, int y, KV kv)
   if (!FLegal(x, y))
     return;
   pb = _Pb(x, y);
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, kv);
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, fOff, kv);
   _Set(pb, RgbR(kv), RgbG(kv), RgbB(kv));
@@ -114,6 +117,8 @@ void CCol::Inv(int x, int y)
     return;
   pb = _Pb(x, y);
   kv = _Get(pb) ^ kvWhite;
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, kv);
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, fOff, kv);
   _Set(pb, RgbR(kv), RgbG(kv), RgbB(kv));
@@ -124,7 +129,7 @@ void CCol::Inv(int x, int y)
 
 flag CCol::FAllocate(int x, int y, CONST CMap *pcOld)
 {
-  long cb;
+  lsize cb;
 
   if (x < 0 || y < 0 || x > xColmap || y > yColmap) {
     PrintSzNN_E("Can't create color bitmap larger than %d by %d!\n",
@@ -151,6 +156,7 @@ flag CCol::FAllocate(int x, int y, CONST CMap *pcOld)
     m_x3 = wClient1Def; m_y3 = wClient2Def;
     m_z3 = wClient3Def; m_w3 = wClient4Def;
   }
+  DirtyAll();
   return fTrue;
 }
 
@@ -379,7 +385,8 @@ void CCol::BlockMove(CONST CCol &c1, int x1, int y1, int x2, int y2,
   // Fast case: Straight copying to a destinatinon rectangle that's entirely
   // on the bitmap means can quickly copy one row at a time.
   if (nOp < 0 && FLegal(x0, y0) && FLegal(x0+(x2-x1), y0+(y2-y1)) &&
-    c1.FLegal(x1, y1) && c1.FLegal(x2, y2))
+    c1.FLegal(x1, y1) && c1.FLegal(x2, y2)) {
+    Dirty(x0, y0, x0+(x2-x1), y0+(y2-y1));
     for (y = y1; y <= y2; y++) {
       pbSrc = c1._Pb(x1, y);
       pbDst = _Pb(x0, y0+(y-y1));
@@ -389,6 +396,9 @@ void CCol::BlockMove(CONST CCol &c1, int x1, int y1, int x2, int y2,
         pbSrc += cbPixelC; pbDst += cbPixelC;
       }
     }
+    if (this == gs.bRecord)
+      RecordPatch(x0, y0, x0+(x2-x1), y0+(y2-y1));
+  }
 
   // Standard case: Copy one pixel at a time using the given operator.
   else
@@ -430,6 +440,8 @@ void CCol::LineX(int x1, int x2, int y, KV kv)
     _Set(pb, nR, nG, nB);
     pb += cbPixelC;
   }
+  Dirty(x1, y, x2, y);
+  Rec(recBlock, x1, y, x2, y, kv);
   if (gs.fTraceDot && FVisible())
     for (x = x1; x <= x2; x++)
       ScreenDot(x, y, fOff, kv);
@@ -460,6 +472,8 @@ void CCol::LineY(int x, int y1, int y2, KV kv)
     _Set(pb, nR, nG, nB);
     pb += m_clRow << 2;
   }
+  Dirty(x, y1, x, y2);
+  Rec(recBlock, x, y1, x, y2, kv);
   if (gs.fTraceDot && FVisible())
     for (y = y1; y <= y2; y++)
       ScreenDot(x, y, fOff, kv);
@@ -596,18 +610,16 @@ flag CCol::FQuadrilateral(int x1, int y1, int x2, int y2, int x3, int y3,
 flag CCol::FFill(int x, int y, KV kv, KV kvArea, flag fFlood)
 {
   PT *rgpt;
-  long ipt = 0;
+  lsize ipt = 0, lScratch = LScratchMark();
   int xnew, ynew, d, dMax;
 
   if (!FLegal(x, y))
     return fTrue;
-  if (F64K())
-    return fFalse;
   if (kvArea < 1)
     kvArea = Get(x, y);
   if (kv == kvArea || Get(x, y) != kvArea)
     return fTrue;
-  rgpt = RgAllocate(m_x*m_y, PT);
+  rgpt = RgAllocateScratch((lsize)m_x*m_y, PT);
   if (rgpt == NULL)
     return fFalse;
   dMax = DIRS + fFlood*DIRS;
@@ -626,7 +638,7 @@ LSet:
       break;
     FillPop(x, y);
   }
-  DeallocateP(rgpt);
+  ScratchRelease(lScratch);
   return fTrue;
 }
 
@@ -641,7 +653,7 @@ LSet:
 
 void CCol::BitmapSet(KV kv)
 {
-  int il;
+  lsize il;
   dword *pl, l;
   flag fTrace;
 
@@ -650,7 +662,7 @@ void CCol::BitmapSet(KV kv)
     // For the simplest colors, set 32 bits at a time.
     l = kv == kvBlack ? 0 : dwSet;
     pl = (dword *)_Pb(0);
-    for (il = m_y * m_clRow; il > 0; il--)
+    for (il = (lsize)m_y * m_clRow; il > 0; il--)
       *pl++ = l;
   } else {
 
@@ -659,11 +671,78 @@ void CCol::BitmapSet(KV kv)
     Block(0, 0, m_x-1, m_y-1, kv);
     gs.fTraceDot = fTrace;
   }
+  DirtyAll();
   if (gs.fTraceDot && FVisible())
     UpdateDisplay();
 }
 
 
+// Copy a color bitmap into another with its rows and columns swapped. The
+// destination must already be allocated to the transposed size. Works in
+// small square blocks, so both bitmaps are walked in a cache friendly way.
+
+#define cTransposeBlock 16
+
+void CCol::ColmapTransposeTo(CCol &c) CONST
+{
+  CONST byte *pbSrc;
+  byte *pbDst;
+  int x, y, x1, y1, x2, y2, db = c.m_clRow << 2;
+
+  Assert(c.m_x == m_y && c.m_y == m_x);
+  for (y1 = 0; y1 < m_y; y1 += cTransposeBlock) {
+    y2 = Min(y1 + cTransposeBlock, m_y);
+    for (x1 = 0; x1 < m_x; x1 += cTransposeBlock) {
+      x2 = Min(x1 + cTransposeBlock, m_x);
+      for (y = y1; y < y2; y++) {
+        pbSrc = _Pb(x1, y);
+        pbDst = c._Pb(y, x1);
+        for (x = x1; x < x2; x++) {
+          pbDst[0] = pbSrc[0]; pbDst[1] = pbSrc[1]; pbDst[2] = pbSrc[2];
+          pbSrc += cbPixelC;
+          pbDst += db;
+        }
+      }
+    }
+  }
+}
+
+
+// Copy a color bitmap into another at half its size, where each pixel is the
+// average of a 2x2 block of pixels, and optionally with its rows and columns
+// swapped. The destination must already be allocated to half the size,
+// rounding down but at least one pixel. Used to make the next smaller level
+// of a mipmap chain.
+
+void CCol::ColmapHalveTo(CCol &c, flag fTranspose) CONST
+{
+  CONST byte *pbSrc1, *pbSrc2;
+  byte *pbDst;
+  int x, y, xMax, yMax, dx, db, nR, nG, nB;
+
+  xMax = Max(m_x >> 1, 1); yMax = Max(m_y >> 1, 1);
+  Assert(fTranspose ? c.m_x == yMax && c.m_y == xMax :
+    c.m_x == xMax && c.m_y == yMax);
+  dx = m_x > 1 ? cbPixelC : 0;
+  db = fTranspose ? c.m_clRow << 2 : cbPixelC;
+  for (y = 0; y < yMax; y++) {
+    pbSrc1 = _Pb(0, y << 1);
+    pbSrc2 = m_y > 1 ? _Pb(0, (y << 1) + 1) : pbSrc1;
+    pbDst = fTranspose ? c._Pb(y, 0) : c._Pb(0, y);
+    for (x = 0; x < xMax; x++) {
+      nR = pbSrc1[0] + pbSrc1[dx] + pbSrc2[0] + pbSrc2[dx];
+      nG = pbSrc1[1] + pbSrc1[dx+1] + pbSrc2[1] + pbSrc2[dx+1];
+      nB = pbSrc1[2] + pbSrc1[dx+2] + pbSrc2[2] + pbSrc2[dx+2];
+      pbDst[0] = (nR + 2) >> 2; pbDst[1] = (nG + 2) >> 2;
+      pbDst[2] = (nB + 2) >> 2;
+      pbSrc1 += cbPixelC << 1;
+      pbSrc2 += cbPixelC << 1;
+      pbDst += db;
+    }
+  }
+}
+
+
 // Convert all colors in a color bitmap to shades of gray with the same
 // brightness.
 
@@ -702,6 +781,7 @@ void CCol::ColmapGrayscale()
       }
     }
   }
+  DirtyAll();
 }
 
 
@@ -821,6 +901,7 @@ void CCol::ColmapReplace(KV kvFrom, KV kvTo, int x1, int y1, int x2, int y2)
       pb += cbPixelC;
     }
   }
+  DirtyAll();
 }
 
 
@@ -1121,17 +1202,36 @@ void CCol::BitmapFlipX()
 }
 
 
+// Borrow a color scratch bitmap of the given size. Like monochrome scratch
+// bitmaps, these are shared by transforms that replace the whole bitmap.
+
+CCol rgcScratch[cScratchMap];
+
+CCol *PcScratch(int x, int y, CONST CMap *pbOld)
+{
+  int i;
+
+  if (smapCol.rgpb[0] == NULL)
+    for (i = 0; i < cScratchMap; i++)
+      smapCol.rgpb[i] = &rgcScratch[i];
+  i = IScratchBorrow(&smapCol, x, y, pbOld);
+  return i >= 0 ? &rgcScratch[i] : NULL;
+}
+
+
 // Resize a color bitmap to be a given size. The old contents of the bitmap
 // are stretched or compacted to fit within the new dimensions.
 
 flag CCol::FBitmapZoomTo(int xnew, int ynew, flag fPreserve)
 {
-  CCol cNew;
+  CCol *pcNew;
   int x, y, x1, y1, x2, y2, nR, nG, nB, i;
   KV kv, kv2;
 
-  if (!cNew.FAllocate(xnew, ynew, this))
+  pcNew = PcScratch(xnew, ynew, this);
+  if (pcNew == NULL)
     return fFalse;
+  CCol &cNew = *pcNew;
   if (FNull() || cNew.FNull())
     goto LDone;
   if (fPreserve && xnew <= m_x && ynew <= m_y) {
@@ -1196,7 +1296,8 @@ flag CCol::FBitmapZoomTo(int xnew, int ynew, flag fPreserve)
         cNew.Set(x, y, Get(x * m_x / xnew, y * m_y / ynew));
   }
 LDone:
-  CopyFrom(cNew);
+  SwapWith(cNew);
+  ScratchMapDone(pcNew);
   return fTrue;
 }
 
@@ -1207,13 +1308,15 @@ LDone:
 
 flag CCol::FBitmapBias(int xbias1, int xbias2, int ybias1, int ybias2)
 {
-  CCol cNew;
+  CCol *pcNew;
   int x, y;
 
-  if (!cNew.FAllocate(
+  pcNew = PcScratch(
     (m_x >> 1)*(xbias1 + xbias2) + FOdd(m_x)*xbias1,
-    (m_y >> 1)*(ybias1 + ybias2) + FOdd(m_y)*ybias1, this))
+    (m_y >> 1)*(ybias1 + ybias2) + FOdd(m_y)*ybias1, this);
+  if (pcNew == NULL)
     return fFalse;
+  CCol &cNew = *pcNew;
   for (y = 0; y < m_y; y++)
     for (x = 0; x < m_x; x++)
       cNew.Block((x >> 1)*(xbias1 + xbias2) + FOdd(x)*xbias1,
@@ -1221,24 +1324,33 @@ flag CCol::FBitmapBias(int xbias1, int xbias2, int ybias1, int ybias2)
         ((x + 1) >> 1)*(xbias1 + xbias2) + FOdd(x + 1)*xbias1 - 1,
         ((y + 1) >> 1)*(ybias1 + ybias2) + FOdd(y + 1)*ybias1 - 1,
         Get(x, y));
-  CopyFrom(cNew);
+  SwapWith(cNew);
+  ScratchMapDone(pcNew);
   return fTrue;
 }
 
 
-// Blur the colors in a bitmap together slightly.
+// Blur the colors in a bitmap together slightly. This is done in place,
+// keeping copies of just the original contents of the previous and current
+// rows, and of the top row for torus wrapping, instead of the whole bitmap.
 
 flag CCol::FColmapBlur(flag fTorus)
 {
-  CCol cCopy;
-  int x, y, xnew, ynew, d, cd, nR, nG, nB, nRT, nGT, nBT;
-  byte *pb, *pb2, *pbT;
+  int x, y, xnew, ynew, d, cd, nR, nG, nB, nRT, nGT, nBT, cbRow;
+  byte *pb, *pb2, *pbT, *pbRow0, *pbPrev, *pbCur;
+  lsize lScratch = LScratchMark();
   flag fLegal;
 
-  if (!cCopy.FBitmapCopy(*this))
+  cbRow = m_clRow << 2;
+  pbRow0 = RgAllocateScratch(cbRow*3, byte);
+  if (pbRow0 == NULL)
     return fFalse;
+  pbPrev = pbRow0 + cbRow; pbCur = pbPrev + cbRow;
+  CopyPb(_Pb(0, 0), pbRow0, cbRow);
   for (y = 0; y < m_y; y++) {
-    pb = _Pb(0, y); pb2 = cCopy._Pb(0, y);
+    pbT = pbPrev; pbPrev = pbCur; pbCur = pbT;
+    CopyPb(_Pb(0, y), pbCur, cbRow);
+    pb = _Pb(0, y); pb2 = pbCur;
     for (x = 0; x < m_x; x++) {
 
       // For each pixel, average its color with its neighboring pixels.
@@ -1251,8 +1363,18 @@ flag CCol::FColmapBlur(flag fTorus)
           if (fTorus && !fLegal)
             Legalize2(&xnew, &ynew);
           cd++;
-          pbT = cCopy._Pb(xnew, ynew);
-          cCopy._Get(pbT, &nRT, &nGT, &nBT);
+
+          // Rows above this one have already been blurred, so get their
+          // original colors from the saved copies. Rows below are untouched.
+          if (ynew == y)
+            pbT = pbCur;
+          else if (ynew == y-1)
+            pbT = pbPrev;
+          else if (ynew == 0)
+            pbT = pbRow0;
+          else
+            pbT = _Pb(0, ynew);
+          _Get(pbT + xnew*cbPixelC, &nRT, &nGT, &nBT);
           nR += nRT; nG += nGT; nB += nBT;
         }
       }
@@ -1262,6 +1384,8 @@ flag CCol::FColmapBlur(flag fTorus)
       pb += cbPixelC; pb2 += cbPixelC;
     }
   }
+  ScratchRelease(lScratch);
+  DirtyAll();
   return fTrue;
 }
 
@@ -1314,6 +1438,7 @@ void CCol::ColmapContrast(flag fRainbow)
       }
     }
   }
+  DirtyAll();
 }
 
 
@@ -1469,7 +1594,7 @@ long CCol::BitmapCount() CONST
   int x, y;
   KV kv;
 
-  tot = m_x*m_y;
+  tot = (long)m_x*m_y;
   for (y = 0; y < m_y; y++)
     for (x = 0; x < m_x; x++) {
       kv = Get(x, y);
@@ -1740,20 +1865,130 @@ flag CCol::FColmapStereogram(CONST CMon &b, CONST CCol &cRandom,
         Set(x, y, Get(x - w, y));
     }
   }
+  DirtyAll();
   return fTrue;
 }
 
 
+typedef struct _colmaplife {
+  CCol *c;         // Color bitmap being evolved
+  CCol *c2;        // Bitmap of color indexes, with a one pixel border
+  dword *rgl;      // Packed copy of the live state and color of each cell
+  byte *rgb;       // Packed copy of the color index of each cell
+  CONST KV *rgkv;  // Colors to use for each index, for Evolution
+  int xs;          // Width of each row of the packed copy
+  int col;
+  int cstrip;
+  int nPass;
+  flag fCorner;
+  flag fTrace;
+  long rgcount[cThreadMax];
+} COLLIFE;
+
+#define CollifeLo(is, cy) ((cy) * (is) / clife->cstrip)
+#define CollifeHi(is, cy) ((cy) * ((is)+1) / clife->cstrip)
+
+// Set a pixel in a color bitmap from within a thread routine. Tracing dots
+// to the screen isn't thread safe, so it's only done when on one thread.
+
+INLINE void CollifeSet(COLLIFE *clife, int x, int y, KV kv)
+{
+  if (clife->fTrace)
+    clife->c->Set(x, y, kv);
+  else
+    clife->c->_Set(clife->c->_Pb(x, y), RgbR(kv), RgbG(kv), RgbB(kv));
+}
+
+
+// Thread routine for ColmapLifeGenerate. Pass 0 packs the rows of the
+// second bitmap in a strip into labels, each containing a cell's live state
+// in the low byte and its color index above that. Pass 1 computes the next
+// generation of each row in a strip.
+
+void ColmapLifeThread(void *pv, int is)
+{
+  COLLIFE *clife = (COLLIFE *)pv;
+  CCol &c2 = *clife->c2;
+  CONST dword *pl;
+  byte *pb;
+  int rgk[DIRS2], x, y, ylo, yhi, i, n, k, xs = clife->xs;
+  long count = 0, cbRow = (long)xs;
+
+  if (clife->nPass <= 0) {
+    ylo = CollifeLo(is, c2.m_y); yhi = CollifeHi(is, c2.m_y);
+    for (y = ylo; y < yhi; y++) {
+      pb = c2._Pb(0, y);
+      for (x = 0; x < xs; x++, pb += cbPixelC)
+        clife->rgl[(lsize)y * xs + x] =
+          (((dword)*(pb+1) << 8 | *(pb+2)) << 8) | *pb;
+    }
+    return;
+  }
+
+  ylo = CollifeLo(is, clife->c->m_y); yhi = CollifeHi(is, clife->c->m_y);
+  for (y = ylo; y < yhi; y++) {
+    pl = &clife->rgl[(lsize)(y+1) * xs + 1];
+    for (x = 0; x < clife->c->m_x; x++, pl++) {
+
+      // Quickly count the number of neighboring live cells.
+      n = (byte)*(pl-cbRow) + (byte)*(pl+cbRow) + (byte)*(pl-1) +
+        (byte)*(pl+1) + (byte)*(pl-cbRow-1) + (byte)*(pl-cbRow+1) +
+        (byte)*(pl+cbRow-1) + (byte)*(pl+cbRow+1);
+      if ((byte)*pl) {
+        if (gs.grfLifeDie & (1 << n)) {
+
+          // A cell dies.
+          c2._Set(c2._Pb(x+1, y+1), 0, 0, 0);
+          CollifeSet(clife, x, y, kvBlack);
+          count++;
+        }
+      } else {
+        if (gs.grfLifeBorn & (1 << n)) {
+
+          // A new cell is born.
+          n = 0;
+          for (i = 0; i < DIRS2; i++) {
+            k = *(pl + yoff[i]*cbRow + xoff[i]);
+            if ((byte)k)
+              rgk[n++] = k >> 8;
+          }
+          for (i = n; i < 3; i++)
+            rgk[i] = n > 0 ? rgk[0] : 0;
+
+          // Find the midpoint of three colors of the rainbow of the parent
+          // cells, and make a new color of the rainbow based on them.
+          k = (rgk[0] + rgk[1] + rgk[2] + 1) / 3;
+          if (NAbs(k - rgk[0]) + NAbs(k - rgk[1]) +
+            NAbs(k - rgk[2]) > nHue23) {
+            k += nHue13 * ((rgk[0] >= nHueHalf) + (rgk[1] >= nHueHalf) +
+              (rgk[2] >= nHueHalf) >= 2 ? 1 : -1);
+            if (k < 0)
+              k += nHueMax;
+            else if (k >= nHueMax)
+              k -= nHueMax;
+          }
+          c2._Set(c2._Pb(x+1, y+1), k & 255, k >> 8, 1);
+          CollifeSet(clife, x, y, Hue(k));
+          count++;
+        }
+      }
+    }
+  }
+  clife->rgcount[is] = count;
+}
+
+
 // Treat the color bitmap as a board of the "Life" cellular automaton, and
 // create the next generation. A second bitmap contains indexes of the colors
-// to use for each cell in the main bitmap.
+// to use for each cell in the main bitmap. The second bitmap is packed into
+// an array of labels, which large bitmaps process in strips on many threads.
 
 long CCol::ColmapLifeGenerate(CCol &c2, flag fTorus)
 {
-  CCol cT;
-  int rgk[8], x, y, i, n, k, xT, yT;
-  byte *pb;
-  long count = 0L, cbRow, l;
+  COLLIFE clife;
+  int x, y, k, is;
+  long count = 0L;
+  lsize lScratch;
 
   // If the second bitmap doesn't exist in the right size, it can't contain
   // valid color information, so recreate it with random colors.
@@ -1789,74 +2024,87 @@ long CCol::ColmapLifeGenerate(CCol &c2, flag fTorus)
     c2.Set(c2.m_x-1, c2.m_y-1, c2.Get(1,        1       ));
   }
 
-  if (!cT.FBitmapCopy(c2))
+  clife.xs = c2.m_x;
+  lScratch = LScratchMark();
+  clife.rgl = RgAllocateScratch((lsize)c2.m_x * c2.m_y, dword);
+  if (clife.rgl == NULL)
     return -1;
-  cbRow = c2.m_clRow << 2;
-  for (y = 0; y < m_y; y++)
-    for (x = 0; x < m_x; x++) {
+  clife.c = this; clife.c2 = &c2;
+  clife.fTrace = gs.fTraceDot && FVisible();
+  clife.cstrip = clife.fTrace ? 1 :
+    Min(CThread(), Max((long)m_x * m_y >> 16, 1));
+  EnsureBetween(clife.cstrip, 1, m_y);
+  for (clife.nPass = 0; clife.nPass < 2; clife.nPass++)
+    RunThreads(ColmapLifeThread, &clife, clife.cstrip);
+  for (is = 0; is < clife.cstrip; is++)
+    count += clife.rgcount[is];
+  ScratchRelease(lScratch);
+  DirtyAll();
+  return count;
+}
 
-      // Quickly count the number of neighboring live cells.
-      l = cT._Ib(x+1, y+1);
-      pb = cT._Pb(l);
-      k = (*(pb+1) << 8) | *(pb+2);
-      n = *(pb-cbRow) + *(pb+cbRow) + *(pb-3) + *(pb+3) +
-        *(pb-cbRow-3) + *(pb-cbRow+3) + *(pb+cbRow-3) + *(pb+cbRow+3);
-      if (*pb) {
-        if (gs.grfLifeDie & (1 << n)) {
 
-          // A cell dies.
-          pb = c2._Pb(l);
-          _Set(pb, 0, 0, 0);
-          Set(x, y, kvBlack);
-          count++;
-        }
-      } else {
-        if (gs.grfLifeBorn & (1 << n)) {
+// Thread routine for Evolution. Pass 0 packs the rows of the second bitmap
+// in a strip into an array of color indexes. Pass 1 computes the next
+// generation of each row in a strip.
 
-          // A new cell is born.
-          n = 0;
-          for (i = 0; i < DIRS2; i++) {
-            xT = x + xoff[i]; yT = y + yoff[i];
-            pb = cT._Pb(xT+1, yT+1);
-            if (*pb)
-              rgk[n++] = (*(pb+1) << 8) | *(pb+2);
-          }
+void EvolutionThread(void *pv, int is)
+{
+  COLLIFE *clife = (COLLIFE *)pv;
+  CCol &c2 = *clife->c2;
+  CONST byte *pbI;
+  byte *pb;
+  int x, y, ylo, yhi, i, xs = clife->xs;
+  long count = 0, cbRow = (long)xs;
+
+  if (clife->nPass <= 0) {
+    ylo = CollifeLo(is, c2.m_y); yhi = CollifeHi(is, c2.m_y);
+    for (y = ylo; y < yhi; y++) {
+      pb = c2._Pb(0, y) + 2;
+      for (x = 0; x < xs; x++, pb += cbPixelC)
+        clife->rgb[(lsize)y * xs + x] = *pb;
+    }
+    return;
+  }
 
-          // Find the midpoint of three colors of the rainbow of the parent
-          // cells, and make a new color of the rainbow based on them.
-          k = (rgk[0] + rgk[1] + rgk[2] + 1) / 3;
-          if (NAbs(k - rgk[0]) + NAbs(k - rgk[1]) +
-            NAbs(k - rgk[2]) > nHue23) {
-            k += nHue13 * ((rgk[0] >= nHueHalf) + (rgk[1] >= nHueHalf) +
-              (rgk[2] >= nHueHalf) >= 2 ? 1 : -1);
-            if (k < 0)
-              k += nHueMax;
-            else if (k >= nHueMax)
-              k -= nHueMax;
-          }
-          pb = c2._Pb(l);
-          c2._Set(pb, k & 255, k >> 8, 1);
-          Set(x, y, Hue(k));
-          count++;
-        }
+  ylo = CollifeLo(is, clife->c->m_y); yhi = CollifeHi(is, clife->c->m_y);
+  for (y = ylo; y < yhi; y++) {
+    pbI = &clife->rgb[(lsize)(y+1) * xs + 1];
+    for (x = 0; x < clife->c->m_x; x++, pbI++) {
+
+      // Quickly check if a neighboring cell is one color higher.
+      i = *pbI + 1;
+      if (i >= clife->col)
+        i = 0;
+      if (*(pbI-cbRow) == i || *(pbI-1) == i ||
+        *(pbI+cbRow) == i || *(pbI+1) == i || (clife->fCorner && (
+        *(pbI-cbRow-1) == i || *(pbI-cbRow+1) == i ||
+        *(pbI+cbRow-1) == i || *(pbI+cbRow+1) == i))) {
+        count++;
+
+        // Set the current cell's color to the neighbor cell's color.
+        *(c2._Pb(x+1, y+1) + 2) = i;
+        CollifeSet(clife, x, y, clife->rgkv[i]);
       }
     }
-  return count;
+  }
+  clife->rgcount[is] = count;
 }
 
 
 // Treat the color bitmap as a board of the "Evolution" cyclic cellular
 // automaton, and create the next generation. A second bitmap contains indexes
-// of the colors to use for each cell in the main bitmap.
+// of the colors to use for each cell in the main bitmap. Like the Life
+// generator, the indexes are packed into an array and processed in strips.
 
 long CCol::Evolution(CCol &c2, int col,
   flag fContinue, flag fTorus, flag fCorner)
 {
-  CCol cT;
+  COLLIFE clife;
   KV rgkv[32];
-  byte *pb;
   int x, y, i;
-  long count = 0L, cbRow, l;
+  long count = 0L;
+  lsize lScratch;
 
   if (!c2.FBitmapSizeSet(m_x+2, m_y+2))
     return -1;
@@ -1901,29 +2149,23 @@ long CCol::Evolution(CCol &c2, int col,
     }
   }
 
-  if (!cT.FBitmapCopy(c2))
+  clife.xs = c2.m_x;
+  lScratch = LScratchMark();
+  clife.rgb = RgAllocateScratch((lsize)c2.m_x * c2.m_y, byte);
+  if (clife.rgb == NULL)
     return -1;
-  cbRow = c2.m_clRow << 2;
-  for (y = 0; y < m_y; y++)
-    for (x = 0; x < m_x; x++) {
-
-      // Quickly check if a neighboring cell is one color higher.
-      l = cT._Ib(x+1, y+1);
-      pb = cT._Pb(l) + 2;
-      i = *pb + 1;
-      if (i >= col)
-        i = 0;
-      if (*(pb-cbRow) == i || *(pb-3) == i ||
-        *(pb+cbRow) == i || *(pb+3) == i || (fCorner && (
-        *(pb-cbRow-3) == i || *(pb-cbRow+3) == i ||
-        *(pb+cbRow-3) == i || *(pb+cbRow+3) == i))) {
-        count++;
-
-        // Set the current cell's color to the neighbor cell's color.
-        *(c2._Pb(l) + 2) = i;
-        Set(x, y, rgkv[i]);
-      }
-    }
+  clife.c = this; clife.c2 = &c2;
+  clife.rgkv = rgkv; clife.col = col; clife.fCorner = fCorner;
+  clife.fTrace = gs.fTraceDot && FVisible();
+  clife.cstrip = clife.fTrace ? 1 :
+    Min(CThread(), Max((long)m_x * m_y >> 16, 1));
+  EnsureBetween(clife.cstrip, 1, m_y);
+  for (clife.nPass = 0; clife.nPass < 2; clife.nPass++)
+    RunThreads(EvolutionThread, &clife, clife.cstrip);
+  for (i = 0; i < clife.cstrip; i++)
+    count += clife.rgcount[i];
+  ScratchRelease(lScratch);
+  DirtyAll();
   return count;
 }
 
@@ -1991,6 +2233,7 @@ void CCol::Mandelbrot(real xmin, real ymin, real xmax, real ymax,
       pb += cbPixelC;
     }
   }
+  DirtyAll();
 }
 
 
@@ -2021,6 +2264,7 @@ flag CCol::FColmapGetFromBitmap(CONST CMon &b, KV kv0, KV kv1)
     }
   }
   Copy3(b);
+  DirtyAll();
   return fTrue;
 }
 
@@ -2168,17 +2412,15 @@ int CCol::ColmapGraphDistance(CONST CMon &b, CONST CMon &b2,
 {
   BFSS *bfss;
   int count = 0, xnew, ynew, d, j = DIRS + fCorner*DIRS;
-  long iLo = 0, iHi, iMax = 0, i;
+  lsize iLo = 0, iHi, iMax = 0, i;
 
   if ((!b.FLegal(x, y) || b.Get(x, y)) && !b.FBitmapFind(&x, &y, fOff)) {
     PrintSz_W("There are no open sections to graph.\n");
     return -2;
   }
-  if (b.F64K())
-    return -2;
   if (!FColmapGetFromBitmap(b, kv0, kv1))
     return -1;
-  bfss = RgAllocate(m_x*m_y, BFSS);
+  bfss = RgAllocate((lsize)m_x*m_y, BFSS);
   if (bfss == NULL)
     return -1;
   Set(x, y, kv1);
@@ -2241,12 +2483,12 @@ long CCol::ColmapGraphDistance2(CONST CMon &b, KV kv0, KV kv1, flag fCorner)
 {
   PT *rgpt;
   int mpgrff[256], x, y, xnew, ynew, d, dSav, cd, grf, i;
-  long cpt = 0, ipt, iMax = 0;
+  lsize cpt = 0, ipt, iMax = 0;
   KV kv;
 
   if (!FColmapGetFromBitmap(b, kv0, kv1))
     return -1;
-  rgpt = RgAllocate(m_x*m_y, PT);
+  rgpt = RgAllocate((lsize)m_x*m_y, PT);
   if (rgpt == NULL)
     return -1;
   if (fCorner) {
@@ -2494,6 +2736,7 @@ flag CCol::FReadColmapCore(FILE *file, int x, int y, int z, int k)
     for (x = 0; x < cb; x++)
       skipbyte();
   }
+  DirtyAll();
   return fTrue;
 }
 
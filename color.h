@@ -142,9 +142,9 @@ extern CS cs;
 class CCol : virtual public CMap // Color bitmap
 {
 public:
-  INLINE long _Ib(int x, int y) CONST
-    { return y*(m_clRow << 2) + (x * cbPixelC); }
-  INLINE byte *_Pb(long i) CONST
+  INLINE lsize _Ib(int x, int y) CONST
+    { return (lsize)y*(m_clRow << 2) + ((lsize)x * cbPixelC); }
+  INLINE byte *_Pb(lsize i) CONST
     { return &m_rgb[i]; }
   INLINE byte *_Pb(int x, int y) CONST
     { return &m_rgb[_Ib(x, y)]; }
@@ -206,6 +206,8 @@ public:
   long ColmapGraphDistance2(CONST CMon &, KV, KV, flag);
 
   void ColmapGrayscale();
+  void ColmapTransposeTo(CCol &) CONST;
+  void ColmapHalveTo(CCol &, flag) CONST;
   void ColmapBrightness(int, real, int);
   void ColmapReplace(KV, KV, int, int, int, int);
   void ColmapReplacePattern(KV, int, int, int, int, int);
@@ -268,6 +270,7 @@ extern KV Hue(int);
 #define kvRandom Rgb(Rnd(0, 255), Rnd(0, 255), Rnd(0, 255))
 #define kvRandomRainbow Hue(Rnd(0, nHueMax-1))
 extern KV Hsl(int, int, int);
+extern CCol *PcScratch(int, int, CONST CMap *);
 
 
 /*
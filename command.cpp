@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory.h>
 #include <time.h>
 #include <math.h>
 #include "resource.h"
@@ -585,6 +586,7 @@ enum _operationindex {
   oprSavePicture,
   oprSaveVector,
   oprSaveSolids,
+  oprSaveAnalysis,
   oprSize,
   oprSizeC,
   oprZoom,
@@ -618,6 +620,8 @@ enum _operationindex {
   oprDoEmbed,
   oprConstDefine,
   oprClearEvents,
+  oprProfileDump,
+  oprProfileClear,
   oprVarSet,
   oprVarSets,
   oprVarSwap,
@@ -729,6 +733,10 @@ enum _operationindex {
   oprHunger,
   oprSystem,
   oprSetup,
+  oprPlayback,
+  oprPlaybackSave,
+  oprRenderPath,
+  oprRenderSolve,
 
   oprFileClose,
   oprFileWrite,
@@ -774,6 +782,7 @@ CONST OPR rgopr[copr] = {
 {oprSavePicture, "SavePicture",   1, SZ},
 {oprSaveVector,  "SaveVector",    1, SZ},
 {oprSaveSolids,  "SaveSolids",    1, SZ},
+{oprSaveAnalysis, "SaveAnalysis", 1, SZ},
 {oprSize,        "Size",          4, R2      | B1},
 {oprSizeC,       "SizeC",         4, R2      | C1},
 {oprZoom,        "Zoom",          4, R2 | HG},
@@ -807,6 +816,8 @@ CONST OPR rgopr[copr] = {
 {oprDoEmbed,     "Embed",         0, 0},
 {oprConstDefine, "DefineConst",   1, 0},
 {oprClearEvents, "ClearEvents",   0, 0},
+{oprProfileDump, "ProfileDump",   1, SZ},
+{oprProfileClear,"ProfileClear",  0, 0},
 {oprVarSet,      "SetVar",        2, 0},
 {oprVarSets,     "SetVars",       3, 0},
 {oprVarSwap,     "SwapVar",       2, 0},
@@ -918,6 +929,10 @@ CONST OPR rgopr[copr] = {
 {oprHunger,      "Hunger",        1, 0},
 {oprSystem,      "System",        1, 0},
 {oprSetup,       "Setup",         0, 0},
+{oprPlayback,    "Playback",      2, R2 | HG | B1},
+{oprPlaybackSave,"SavePlayback",  2, SZ | HG | B1},
+{oprRenderPath,  "RenderPath",    3, SZ | HG},
+{oprRenderSolve, "RenderSolve",   1, SZ | HG},
 
 {oprFileClose, "FileClose",     1, 0},
 {oprFileWrite, "FileWrite",     2, 0},
@@ -1241,6 +1256,7 @@ enum _variableindex {
   varTextureDual,
   varTextureDual2,
   varTextureBlend,
+  varTextureMip,
   varMarkElevX1,
   varMarkElevY1,
   varMarkElevX2,
@@ -1250,6 +1266,8 @@ enum _variableindex {
   varFractalDepth,
   varFractalLength,
   varFractalType,
+  varWilsonPop,
+  varAnalyzeSolve,
   varStretch,
   varGraphNumber,
   varGrayscale,
@@ -1258,6 +1276,9 @@ enum _variableindex {
   varFogLength2,
   varLineWidth,
   varLineSort,
+  varZBuffer,
+  varDrawDistance,
+  varMergeFace,
   varLineDistance,
   varFaceOrigin,
   varStereo3D,
@@ -1267,10 +1288,32 @@ enum _variableindex {
   varSoundDelay,
   varFileLock,
   varRndOld,
+  varThread,
+  varLifeHash,
+  varLifeHashMem,
+  varRecord,
+  varRecordMem,
   varNoExit,
   varAlloc,
   varAllocTotal,
-  varAllocSize = cvar-1,
+  varAllocSize,
+  varAllocReuse,
+  varAllocPool,
+  varAllocPoolMax,
+  varProfile,
+  varProfileFile,
+  varDisplayFile,
+  varDisplayFrame,
+  varAnalyzeCell,
+  varAnalyzeDeadEnd,
+  varAnalyzeJunction,
+  varAnalyzeCross,
+  varAnalyzeStraight,
+  varAnalyzeTurning,
+  varAnalyzeLongX,
+  varAnalyzeLongY,
+  varAnalyzeRiver,
+  varAnalyzeSolution = cvar-1,
 };
 
 CONST VAR rgvar[cvar] = {
@@ -1586,6 +1629,7 @@ CONST VAR rgvar[cvar] = {
 {varTextureDual,   "fTextureDual",    R1},
 {varTextureDual2,  "fTextureDual2",   R1},
 {varTextureBlend,  "fTextureBlend",   R1},
+{varTextureMip,    "fTextureMipmap",  R1},
 {varMarkElevX1,    "nMarkElevX1",     0},
 {varMarkElevY1,    "nMarkElevY1",     0},
 {varMarkElevX2,    "nMarkElevX2",     0},
@@ -1595,6 +1639,8 @@ CONST VAR rgvar[cvar] = {
 {varFractalDepth,  "nFractalDepth",   0},
 {varFractalLength, "nFractalLength",  0},
 {varFractalType,   "nFractalType",    0},
+{varWilsonPop,     "fWilsonCyclePop", 0},
+{varAnalyzeSolve,  "fAnalyzeSolution", 0},
 {varStretch,       "nStretch",        R1},
 {varGraphNumber,   "fGraphNumber",    0},
 {varGrayscale,     "nGrayscale",      0},
@@ -1603,6 +1649,9 @@ CONST VAR rgvar[cvar] = {
 {varFogLength2,    "nFogDistance2",   0},
 {varLineWidth,     "nWireWidth",      R1},
 {varLineSort,      "fWireSort",       R1},
+{varZBuffer,       "fPatchZBuffer",   R1},
+{varDrawDistance,  "nDrawDistance",   R1},
+{varMergeFace,     "fMergeFaces",     0},
 {varLineDistance,  "nWireDistance",   R1},
 {varFaceOrigin,    "nDrawFaceOrigin", R1},
 {varStereo3D,      "fStereo3D",       R1},
@@ -1612,10 +1661,32 @@ CONST VAR rgvar[cvar] = {
 {varSoundDelay,    "nSoundDelay",     0},
 {varFileLock,      "nFileLock",       0},
 {varRndOld,        "fRndOld",         0},
+{varThread,        "nThreadCount",    0},
+{varLifeHash,      "nLifeHash",       0},
+{varLifeHashMem,   "nLifeHashMemory", 0},
+{varRecord,        "fRecordMaze",     0},
+{varRecordMem,     "nRecordMemory",   0},
 {varNoExit,        "fNoExit",         0},
 {varAlloc,         "nAllocations",    0},
 {varAllocTotal,    "nAllocsTotal",    0},
 {varAllocSize,     "nAllocsSize",     0},
+{varAllocReuse,    "nAllocsReused",   0},
+{varAllocPool,     "nAllocsPooled",   0},
+{varAllocPoolMax,  "nAllocsPoolMax",  0},
+{varProfile,       "fProfile",        0},
+{varProfileFile,   "nProfileFile",    0},
+{varDisplayFile,   "nDisplayFile",    0},
+{varDisplayFrame,  "nDisplayFrame",   0},
+{varAnalyzeCell,     "nAnalyzeCells",      0},
+{varAnalyzeDeadEnd,  "nAnalyzeDeadEnds",   0},
+{varAnalyzeJunction, "nAnalyzeJunctions",  0},
+{varAnalyzeCross,    "nAnalyzeCrossroads", 0},
+{varAnalyzeStraight, "nAnalyzeStraights",  0},
+{varAnalyzeTurning,  "nAnalyzeTurnings",   0},
+{varAnalyzeLongX,    "nAnalyzeLongestX",   0},
+{varAnalyzeLongY,    "nAnalyzeLongestY",   0},
+{varAnalyzeRiver,    "nAnalyzeRiver",      0},
+{varAnalyzeSolution, "nAnalyzeSolution",   0},
 };
 
 
@@ -1740,6 +1811,9 @@ enum _functionindex {
   funUDD,
   funTimer,
   funTimer2,
+  funProfileTime,
+  funProfileCount,
+  funProfileBytes,
   funVar,
   funCmd,
   funEval,
@@ -1871,6 +1945,9 @@ CONST FUN rgfun[cfun] = {
 {funUDD,    "UdD",     1},
 {funTimer,  "Timer",   0},
 {funTimer2, "Timer2",  0},
+{funProfileTime,  "ProfileTime",  1},
+{funProfileCount, "ProfileCount", 1},
+{funProfileBytes, "ProfileBytes", 1},
 {funVar,    "Var",     1},
 {funCmd,    "Command", 1},
 {funEval,   "Eval",    1},
@@ -1904,6 +1981,89 @@ int CmdFromRgch(CONST char *pch, int cch)
 }
 
 
+// Profile records, accumulated while the fProfile setting is on. There's one
+// for each overall phase of work, one for each command, and one for each
+// operation. Each command or operation record includes the time of anything
+// it ran, such as a script, while the phase records only count the outermost
+// action of each kind so nothing is counted twice.
+
+PROF rgprofPhase[cprf], rgprofCmd[ccmd], rgprofOpr[copr];
+
+CONST char *rgszProfilePhase[cprf] = {"Scripts", "Commands", "Operations",
+  "InsideDraw", "InsideReuse"};
+
+// Return the profile record for a phase, command, or operation name.
+
+PROF *PprofFromRgch(CONST char *pch, int cch)
+{
+  int i;
+
+  for (i = 0; i < cprf; i++)
+    if (FCompareSzRgchI(rgszProfilePhase[i], pch, cch))
+      return &rgprofPhase[i];
+  i = CmdFromRgch(pch, cch);
+  if (i >= 0)
+    return &rgprofCmd[i];
+  i = ILookupTrie(ws.rgsTrieOpr, pch, cch, fTrue);
+  if (i >= 0)
+    return &rgprofOpr[i];
+  return NULL;
+}
+
+
+// Write one profile record to a file, as either a CSV line or a JSON object.
+
+void ProfileWrite(FILE *file, flag fJson, flag fFirst, CONST char *szKind,
+  CONST char *szName, CONST PROF *pprof)
+{
+  if (!fJson)
+    fprintf(file, "%s,%s,%ld,%lld,%lld\n", szKind, szName, pprof->cCall,
+      (quad)pprof->lTime, (quad)pprof->cbAlloc);
+  else
+    fprintf(file, "%s\n  {\"kind\": \"%s\", \"name\": \"%s\", "
+      "\"calls\": %ld, \"usec\": %lld, \"bytes\": %lld}",
+      fFirst ? "" : ",", szKind, szName, pprof->cCall, (quad)pprof->lTime,
+      (quad)pprof->cbAlloc);
+}
+
+
+// Save all profile records to a file. The file is JSON if its name ends in
+// ".json", and CSV otherwise. All phases are listed, but only the commands
+// and operations that were actually run.
+
+flag FProfileDump(CONST char *szFile)
+{
+  FILE *file;
+  char sz[cchSzMax];
+  int cch = CchSz(szFile), i;
+  flag fJson, fFirst = fTrue;
+
+  file = FileOpen(szFile, "w");
+  if (file == NULL) {
+    sprintf(S(sz), "The profile file %s could not be created.", szFile);
+    PrintSz_E(sz);
+    return fFalse;
+  }
+  fJson = cch >= 5 && FCompareSzRgchI(".json", szFile + cch - 5, 5);
+  fprintf(file, fJson ? "[" : "kind,name,calls,usec,bytes\n");
+  for (i = 0; i < cprf; i++, fFirst = fFalse)
+    ProfileWrite(file, fJson, fFirst, "phase", rgszProfilePhase[i],
+      &rgprofPhase[i]);
+  for (i = 0; i < ccmd; i++)
+    if (rgprofCmd[i].cCall > 0)
+      ProfileWrite(file, fJson, fFalse, "command", rgcmd[i].szName,
+        &rgprofCmd[i]);
+  for (i = 0; i < copr; i++)
+    if (rgprofOpr[i].cCall > 0)
+      ProfileWrite(file, fJson, fFalse, "operation", rgopr[i].szName,
+        &rgprofOpr[i]);
+  if (fJson)
+    fprintf(file, "\n]\n");
+  fclose(file);
+  return fTrue;
+}
+
+
 // Set a variable to either a string or numeric value.
 
 void DoSetVariable(int ivar, CONST char *sz, int cch, long l)
@@ -2232,6 +2392,7 @@ void DoSetVariable(int ivar, CONST char *sz, int cch, long l)
   case varTextureDual:   dr.fTextureDual  = f; break;
   case varTextureDual2:  dr.fTextureDual2 = f; break;
   case varTextureBlend:  dr.fTextureBlend = f; break;
+  case varTextureMip:    dr.fTextureMip   = f; break;
   case varMarkElevX1:    dr.nMarkElevX1   = n; break;
   case varMarkElevY1:    dr.nMarkElevY1   = n; break;
   case varMarkElevX2:    dr.nMarkElevX2   = n; break;
@@ -2241,6 +2402,8 @@ void DoSetVariable(int ivar, CONST char *sz, int cch, long l)
   case varFractalDepth:  ms.nFractalD     = n; break;
   case varFractalLength: ms.nFractalL     = n; break;
   case varFractalType:   ms.nFractalT     = n; break;
+  case varWilsonPop:     ms.fWilsonPop    = f; break;
+  case varAnalyzeSolve:  ms.fAnalyzeSolve = f; break;
   case varStretch:       dr.nStretchMode  = n; break;
   case varGraphNumber:   cs.fGraphNumber  = f; break;
   case varGrayscale:     cs.lGrayscale    = l; break;
@@ -2249,6 +2412,9 @@ void DoSetVariable(int ivar, CONST char *sz, int cch, long l)
   case varFogLength2:    ds.nFog          = n; break;
   case varLineWidth:     ds.nWireWidth    = n; break;
   case varLineSort:      ds.fWireSort     = f; break;
+  case varZBuffer:       ds.fZBuffer      = f; break;
+  case varDrawDistance:  ds.nDrawDistance = n; break;
+  case varMergeFace:     ds.fMergeFace    = f; break;
   case varLineDistance:  ds.nWireDistance = n; break;
   case varFaceOrigin:    ds.nFaceOrigin   = n; break;
   case varStereo3D:      ds.fStereo3D     = f; break;
@@ -2260,10 +2426,43 @@ void DoSetVariable(int ivar, CONST char *sz, int cch, long l)
   case varSoundDelay:    ws.nSoundDelay   = n; break;
   case varFileLock:      ws.nFileLock     = n; break;
   case varRndOld:        us.fRndOld       = f; break;
+  case varThread:        us.nThread       = n; break;
+  case varLifeHash:      gs.lLifeHash     = l; break;
+  case varLifeHashMem:   gs.nLifeHashMem  = n; break;
+  case varRecord:        gs.fRecord       = f; break;
+  case varRecordMem:     gs.nRecordMem    = n; break;
   case varNoExit:        ws.fNoExit       = f; break;
   case varAlloc:         us.cAlloc        = n; break;
   case varAllocTotal:    us.cAllocTotal   = n; break;
   case varAllocSize:     us.cAllocSize    = n; break;
+  case varAllocReuse:    us.cAllocReuse   = n; break;
+  case varAllocPool:
+    ScratchMapFree();
+    InsideCacheFree();
+    AllocPoolFlush();
+    break;
+  case varAllocPoolMax:
+    us.cbAllocPoolMax = (lsize)Max(n, 0) << 20;
+    if (us.cAllocPool > us.cbAllocPoolMax) {
+      ScratchMapFree();
+      InsideCacheFree();
+      AllocPoolFlush();
+    }
+    break;
+  case varProfile:       us.fProfile      = f; break;
+  case varProfileFile:   ws.nProfileFile  = n; break;
+  case varDisplayFile:   ws.nDisplayFile  = n; break;
+  case varDisplayFrame:  ws.nDisplayFrame = n; break;
+  case varAnalyzeCell:     mas.cCell       = n; break;
+  case varAnalyzeDeadEnd:  mas.rgcWay[1]   = n; break;
+  case varAnalyzeJunction: mas.rgcWay[3]   = n; break;
+  case varAnalyzeCross:    mas.rgcWay[4]   = n; break;
+  case varAnalyzeStraight: mas.cStraight   = n; break;
+  case varAnalyzeTurning:  mas.rgcWay[2]   = mas.cStraight + n; break;
+  case varAnalyzeLongX:    mas.xLong       = n; break;
+  case varAnalyzeLongY:    mas.yLong       = n; break;
+  case varAnalyzeRiver:    mas.rRiver      = (real)n / 100.0; break;
+  case varAnalyzeSolution: mas.lSolution   = n; break;
 
   default:
     PrintSzN_E("Setting variable %d is undefined.", ivar);
@@ -2597,6 +2796,7 @@ void GetVariable(int ivar, char **psz, int *pcch, long *pl)
   case varTextureDual:   n = dr.fTextureDual;  break;
   case varTextureDual2:  n = dr.fTextureDual2; break;
   case varTextureBlend:  n = dr.fTextureBlend; break;
+  case varTextureMip:    n = dr.fTextureMip;   break;
   case varMarkElevX1:    n = dr.nMarkElevX1;   break;
   case varMarkElevY1:    n = dr.nMarkElevY1;   break;
   case varMarkElevX2:    n = dr.nMarkElevX2;   break;
@@ -2606,6 +2806,8 @@ void GetVariable(int ivar, char **psz, int *pcch, long *pl)
   case varFractalDepth:  n = ms.nFractalD;     break;
   case varFractalLength: n = ms.nFractalL;     break;
   case varFractalType:   n = ms.nFractalT;     break;
+  case varWilsonPop:     n = ms.fWilsonPop;    break;
+  case varAnalyzeSolve:  n = ms.fAnalyzeSolve; break;
   case varStretch:       n = dr.nStretchMode;  break;
   case varGraphNumber:   n = cs.fGraphNumber;  break;
   case varGrayscale:     n = cs.lGrayscale;    break;
@@ -2614,6 +2816,9 @@ void GetVariable(int ivar, char **psz, int *pcch, long *pl)
   case varFogLength2:    n = ds.nFog;          break;
   case varLineWidth:     n = ds.nWireWidth;    break;
   case varLineSort:      n = ds.fWireSort;     break;
+  case varZBuffer:       n = ds.fZBuffer;      break;
+  case varDrawDistance:  n = ds.nDrawDistance; break;
+  case varMergeFace:     n = ds.fMergeFace;    break;
   case varLineDistance:  n = ds.nWireDistance; break;
   case varFaceOrigin:    n = ds.nFaceOrigin;   break;
   case varStereo3D:      n = ds.fStereo3D;     break;
@@ -2623,10 +2828,32 @@ void GetVariable(int ivar, char **psz, int *pcch, long *pl)
   case varSoundDelay:    n = ws.nSoundDelay;   break;
   case varFileLock:      n = ws.nFileLock;     break;
   case varRndOld:        n = us.fRndOld;       break;
+  case varThread:        n = us.nThread;       break;
+  case varLifeHash:      n = gs.lLifeHash;     break;
+  case varLifeHashMem:   n = gs.nLifeHashMem;  break;
+  case varRecord:        n = gs.fRecord;       break;
+  case varRecordMem:     n = gs.nRecordMem;    break;
   case varNoExit:        n = ws.fNoExit;       break;
   case varAlloc:         n = us.cAlloc;        break;
   case varAllocTotal:    n = us.cAllocTotal;   break;
   case varAllocSize:     n = us.cAllocSize;    break;
+  case varAllocReuse:    n = us.cAllocReuse;   break;
+  case varAllocPool:     n = us.cAllocPool;    break;
+  case varAllocPoolMax:  n = us.cbAllocPoolMax >> 20; break;
+  case varProfile:       n = us.fProfile;      break;
+  case varProfileFile:   n = ws.nProfileFile;  break;
+  case varDisplayFile:   n = ws.nDisplayFile;  break;
+  case varDisplayFrame:  n = ws.nDisplayFrame; break;
+  case varAnalyzeCell:     n = mas.cCell;     break;
+  case varAnalyzeDeadEnd:  n = mas.rgcWay[1]; break;
+  case varAnalyzeJunction: n = mas.rgcWay[3]; break;
+  case varAnalyzeCross:    n = mas.rgcWay[4]; break;
+  case varAnalyzeStraight: n = mas.cStraight; break;
+  case varAnalyzeTurning:  n = mas.rgcWay[2] - mas.cStraight; break;
+  case varAnalyzeLongX:    n = mas.xLong;     break;
+  case varAnalyzeLongY:    n = mas.yLong;     break;
+  case varAnalyzeRiver:    n = (int)(mas.rRiver * 100.0 + 0.5); break;
+  case varAnalyzeSolution: n = mas.lSolution; break;
 
   default:
     PrintSzN_E("Getting variable %d is undefined.", ivar);
@@ -2643,6 +2870,7 @@ long EvalFunction(int ifun, char *rgsz[], CONST int *rgcch, CONST long *rgl)
 {
   int n = 0, n1, n2, n3, n4;
   char sz[cchSzMax];
+  PROF *pprof;
 
   n1 = (int)rgl[0]; n2 = (int)rgl[1]; n3 = (int)rgl[2]; n4 = (int)rgl[3];
 
@@ -2806,6 +3034,19 @@ long EvalFunction(int ifun, char *rgsz[], CONST int *rgcch, CONST long *rgl)
   case funUDD:    n = UdD(n1);                        break;
   case funTimer:  n = (NGetVariableW(vosGetTimer) + 500) / 1000; break;
   case funTimer2: n = NGetVariableW(vosGetTimer);     break;
+  case funProfileTime:
+  case funProfileCount:
+  case funProfileBytes:
+    pprof = PprofFromRgch(rgsz[0], rgcch[0]);
+    if (pprof == NULL)
+      n = -1;
+    else if (ifun == funProfileTime)
+      n = (int)((pprof->lTime + 500) / 1000);
+    else if (ifun == funProfileCount)
+      n = pprof->cCall;
+    else
+      n = (int)(pprof->cbAlloc >> 10);
+    break;
   case funVar:    n = LVar(n1);                       break;
   case funCmd:    n = CmdFromRgch(rgsz[0], rgcch[0]); break;
   case funEval:
@@ -3018,6 +3259,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
   char *pch, *pchT;
   int nRet = 0, n1, n2, n3, n4, n5, n6, n7, x, y, cch, i;
   long l;
+  lsize lScratch = LScratchMark();
   real rx, ry;
   KV kv1, kv2;
 
@@ -3172,6 +3414,9 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
   case oprSaveSolids:
     CreateSolids(sz);
     break;
+  case oprSaveAnalysis:
+    FWriteMazeAnalysis(sz);
+    break;
 
   case oprSize:
   case oprSizeC:
@@ -3400,6 +3645,14 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
       ws.iEventMiddle = ws.iEventPrev = ws.iEventNext = ws.iEventMouse = 0;
     dr.fRedrawAfter = fFalse;
     break;
+  case oprProfileDump:
+    FProfileDump(sz);
+    break;
+  case oprProfileClear:
+    ClearPb(rgprofPhase, sizeof(rgprofPhase));
+    ClearPb(rgprofCmd, sizeof(rgprofCmd));
+    ClearPb(rgprofOpr, sizeof(rgprofOpr));
+    break;
   case oprVarSet:
     if (n1 == ~0)
       n1 = ChCap(rgsz[0][0]) - '@';
@@ -3530,6 +3783,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
   case oprMaskSwap:
     if (BitmapGetMask(Max(n1, n2)) == NULL)
       break;
+    ws.lTextureGen++;
     pbSrc = BitmapGetMask(n1);
     pbDst = BitmapGetMask(n2);
     if (iopr == oprMaskSwap &&
@@ -3545,6 +3799,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
     pbSrc = BitmapGetMask(n1);
     if (pbSrc != NULL && n1 != -1)
       pbSrc->Free();
+    ws.lTextureGen++;
     break;
   case oprTextureCopy:
   case oprTextureSwap:
@@ -3662,6 +3917,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
   case oprReset:
     DoOperation(oprClearEvents, rgsz, rgcch, rgl, file);
     DeallocateTextures();
+    RecordFree();
     if (ws.rgbCmdMacro != NULL) {
       DeallocateP(ws.rgbCmdMacro);
       ws.rgbCmdMacro = NULL;
@@ -3711,6 +3967,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
     if (bT == NULL)
       break;
     bT->Set(n2, n3, n4);
+    ws.lTextureGen++;
     break;
   case oprSetC:
     if (!bm.k.FNull())
@@ -3770,6 +4027,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
     if (bT == NULL)
       break;
     bT->Set3(n2, n3, n4, n5);
+    ws.lTextureGen++;
     break;
   case oprSet3C:
     if (!bm.k.FNull())
@@ -3999,6 +4257,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
       bm.coor[n1].y2 = (real)ws.rglVar[n2+4];
       bm.coor[n1].z2 = (real)ws.rglVar[n2+5];
       bm.coor[n1].kv =       ws.rglVar[n2+6];
+      VertexStoreFree(&ds.vsWire);
     }
     break;
   case oprGetPatch:
@@ -4029,6 +4288,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
       bm.patch[n1].cpt    = (ws.rglVar[y] <= 3 ? 3 : 4);
       bm.patch[n1].kv     =        ws.rglVar[y+1];
       bm.patch[n1].nTrans = (short)ws.rglVar[y+2];
+      VertexStoreFree(&ds.vsPatch);
     }
     break;
   case oprGetStar:
@@ -4048,6 +4308,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
       pstar[n2].x = n3;
       pstar[n2].y = n4;
       pstar[n2].kv = ParseColor(rgsz[4], fFalse);
+      ResetInsideFrame();
     }
     break;
   case oprStereogram:
@@ -4102,6 +4363,24 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
     DoCommand(cmdSetupUser);
     DoCommand(cmdSetupExtension);
     break;
+  case oprPlayback:
+    FPlayRecording(n1, n2, NULL);
+    break;
+  case oprPlaybackSave:
+    FPlayRecording(n2, 0, sz);
+    break;
+  case oprRenderPath:
+    if (n2 == ~0)
+      n2 = ChCap(rgsz[1][0]) - '@';
+    if (n2 < 0 || n3 < 1 || !FEnsureLVar(n2 + n3*4))
+      break;
+    l = RenderCameraPath(sz, &ws.rglVar[n2], n3);
+    SetMacroReturn(l);
+    break;
+  case oprRenderSolve:
+    l = RenderSolvePath(sz);
+    SetMacroReturn(l);
+    break;
 
   case oprFileClose:
     fclose((FILE *)(size_t)n1);
@@ -4139,6 +4418,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
     SystemHook(hosRedraw);
   if ((rgopr[iopr].grf & fCmtHourglass) > 0 && cursorPrev != NULL)
     HourglassCursor(&cursorPrev, fFalse);
+  ScratchRelease(lScratch);
   return nRet;
 }
 
@@ -4150,7 +4430,7 @@ int DoOperation(int iopr, char **rgsz, CONST int *rgcch, CONST long *rgl,
 // Execute a command. This gets run when a menu option is manually selected,
 // and when a command is automatically invoked via scripting.
 
-flag DoCommand(int wCmd)
+flag DoCommandCore(int wCmd)
 {
   size_t cursorPrev = NULL;
   char sz[cchSzDef], szT[cchSzDef], *pch;
@@ -4159,6 +4439,7 @@ flag DoCommand(int wCmd)
   long l, m;
   ulong ul;
   time_t lTime;
+  lsize lScratch = LScratchMark();
   flag fDidRedraw = fFalse;
 
   Assert(FBetween(icmd, 0, ccmd-1));
@@ -4204,6 +4485,8 @@ LBitmapError:
   }
   if (grf & fCmtMaze) {
     ms.cRunRnd = 0;
+    if (gs.fRecord)
+      FRecordBegin(bm.b);
     PolishMaze(wCmd, 0);
   } else if ((grf & fCmtSolve) > 0 && bm.fColor)
     bT.FBitmapCopy(bm.b);
@@ -5396,7 +5679,7 @@ LBitmapError:
 
   case cmdAnalyze:
     if (!dr.f3D)
-      bm.b.MazeAnalyze();
+      bm.b.MazeAnalyze(dr.x, dr.y);
     else
       bm.b.MazeAnalyze3D();
     break;
@@ -5449,7 +5732,10 @@ LBitmapError:
     break;
 
   case cmdCreateWilson:
-    bm.b.CreateMazeWilson();
+    if (!ms.fWilsonPop)
+      bm.b.CreateMazeWilson();
+    else
+      bm.b.CreateMazeWilsonPop();
     break;
 
   case cmdCreateEller:
@@ -5934,9 +6220,12 @@ LBitmapError:
 
   case cmdLife:
     if (!(ms.nInfCutoff > 0 && ms.nInfGen >= ms.nInfCutoff)) {
-      if (!bm.fColor)
-        l = bm.b.LifeGenerate(dr.nEdge == nEdgeTorus);
-      else
+      if (!bm.fColor) {
+        if (gs.lLifeHash <= 0)
+          l = bm.b.LifeGenerate(dr.nEdge == nEdgeTorus);
+        else
+          l = bm.b.LifeGenerateHash(gs.lLifeHash, dr.nEdge == nEdgeTorus);
+      } else
         l = bm.k.ColmapLifeGenerate(bm.k2, dr.nEdge == nEdgeTorus);
       SetMacroReturn(l);
       ms.nInfGen++;
@@ -6003,6 +6292,7 @@ LBitmapError:
       break;
     }
     PrintSzN_E("Command %d is unimplemented.", icmd);
+    ScratchRelease(lScratch);
     return fFalse;
   }
 
@@ -6024,6 +6314,7 @@ LBitmapError:
   if (grf & fCmtMaze) {
     ms.cMaze++;
     PolishMaze(wCmd, 1);
+    RecordEnd();
   } else if ((grf & fCmtSolve) > 0 && bm.fColor && !bT.FNull()) {
     if (bm.k.FColmapBlendFromBitmap(&bm.b, &bT, NULL)) {
       if (dr.kvDot != kvRed)
@@ -6045,10 +6336,34 @@ LBitmapError:
 LDone:
   if (wCmd != cmdRepeat)
     ws.wCmdRepeat = wCmd;
+  ScratchRelease(lScratch);
   return fDidRedraw;
 }
 
 
+// Execute a command, adding how long it took to its profile record. Commands
+// may run scripts that run other commands, so only the outermost one counts
+// toward the overall command phase.
+
+flag DoCommand(int wCmd)
+{
+  static int nDepth = 0;
+  int icmd = wCmd - icmdBase;
+  PROFT pt;
+  flag fRet;
+
+  ProfileStart(&pt);
+  nDepth++;
+  fRet = DoCommandCore(wCmd);
+  nDepth--;
+  if (FBetween(icmd, 0, ccmd-1))
+    ProfileStop(&rgprofCmd[icmd], &pt);
+  if (nDepth <= 0)
+    ProfileStop(&rgprofPhase[prfCommand], &pt);
+  return fRet;
+}
+
+
 /*
 ******************************************************************************
 ** Command Line Processing
@@ -6185,9 +6500,12 @@ int RunCommandLine(char *szLine, FILE *file)
   char *rgsz[7], *sz;
   int rgcch[7], cch, iParam, n, nRet;
   long rglLocal[iLetterZ+1], rgl[7], l;
+  static int nOprDepth = 0;
+  PROFT pt, ptOpr;
 
   if (szLine == NULL)
     return 0;
+  ProfileStart(&pt);
   rglLocal[0] = 0;
   ws.rglLocal = rglLocal;
   ws.nMacroDepth++;
@@ -6281,7 +6599,13 @@ LRestart:
           if (pchCur == NULL)
             goto LError;
         }
+        ProfileStart(&ptOpr);
+        nOprDepth++;
         n = DoOperation(iopr, rgsz, rgcch, rgl, file);
+        nOprDepth--;
+        ProfileStop(&rgprofOpr[iopr], &ptOpr);
+        if (nOprDepth <= 0)
+          ProfileStop(&rgprofPhase[prfOperation], &ptOpr);
         if (n == -1)
           goto LRestart;
         else if (n > 0) {
@@ -6333,6 +6657,8 @@ LHalt:
   nRet = nRetHalt;
 LReturn:
   ws.nMacroDepth--;
+  if (ws.nMacroDepth <= 0)
+    ProfileStop(&rgprofPhase[prfScript], &pt);
   if (rglLocal[0]) {
     for (ivar = 1; ivar <= cLetter; ivar++)
       if (rglLocal[0] & (1 << ivar))
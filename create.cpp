@@ -352,7 +352,7 @@ flag CMaz::CreateMazeBraidTilt()
 // Find and return the location of an uncreated wall vertex in the Maze.
 // Called from SpiralMakeTemplate() to start a new spiral.
 
-void CMaz::SpiralMakeNew(ushort *x0, ushort *y0)
+void CMaz::SpiralMakeNew(int *x0, int *y0)
 {
   int xsize, ysize, x, y, count = 0;
   long total, i, iInc;
@@ -689,26 +689,26 @@ enum _primcell {
 };
 
 typedef struct _prim {
-  long zFrontier;      // Map cell index to cell coordinate
+  lsize zFrontier;     // Map cell index to cell coordinate
   long set;            // Map cell coordinate to cell type
 } PRIM;
 
 // Mark a cell as part of the set of cells that's part of the Maze. Called
 // from PrimGenerate().
 
-long PrimMakeIn(PRIM *prim, int x, int y, int xs, int ys, long cFrontier)
+lsize PrimMakeIn(PRIM *prim, int x, int y, int xs, int ys, lsize cFrontier)
 {
-  long z;
+  lsize z;
   int xnew, ynew, d;
 
-  z = y*xs + x;
+  z = (lsize)y*xs + x;
   prim[z].set = primIn;
 
   // Update the status of the four adjacent cells.
   for (d = 0; d < DIRS; d++) {
     xnew = x + xoff[d]; ynew = y + yoff[d];
     if (xnew >= 0 && ynew >= 0 && xnew < xs && ynew < ys) {
-      z = ynew*xs + xnew;
+      z = (lsize)ynew*xs + xnew;
       if (prim[z].set == primOut) {
         prim[z].set = primFrontier;
         prim[cFrontier].zFrontier = z;
@@ -726,14 +726,14 @@ long PrimMakeIn(PRIM *prim, int x, int y, int xs, int ys, long cFrontier)
 flag CMaz::PrimGenerate(flag fWall, flag fClear, int xp, int yp)
 {
   PRIM *prim;
-  long cFrontier = 0, i;
+  lsize cFrontier = 0, i;
   int xbase, ybase, x, y, xs, ys, j, xnew, ynew, d;
 
   Assert(FImplies(fWall, fClear));
   if (!FEnsureMazeSize(3, femsOddSize | femsNoResize))
     return fFalse;
   xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
-  prim = RgAllocate(xs*ys, PRIM);
+  prim = RgAllocate((lsize)xs*ys, PRIM);
   if (prim == NULL)
     return fFalse;
   xbase = xl + 1 - fWall; ybase = yl + 1 - fWall;
@@ -741,12 +741,12 @@ flag CMaz::PrimGenerate(flag fWall, flag fClear, int xp, int yp)
   // Figure out which cells are part of the Maze and which should be ignored
   // (because they're in the middle of solid blocks).
   if (fWall || fClear) {
-    for (i = xs*ys-1; i >= 0; i--)
+    for (i = (lsize)xs*ys-1; i >= 0; i--)
       prim[i].set = primOut;
   } else {
     for (y = 0; y < ys; y++)
       for (x = 0; x < xs; x++)
-        prim[y*xs + x].set = primNever -
+        prim[(lsize)y*xs + x].set = primNever -
           Get(xbase + (x << 1), ybase + (y << 1));
   }
 
@@ -758,11 +758,11 @@ flag CMaz::PrimGenerate(flag fWall, flag fClear, int xp, int yp)
   } else {
     for (x = 0; x < xs; x++) {
       prim[x].set = primIn;
-      prim[(ys-1)*xs + x].set = primIn;
+      prim[(lsize)(ys-1)*xs + x].set = primIn;
     }
     for (y = 1; y < ys-1; y++) {
-      prim[y*xs].set = primIn;
-      prim[y*xs + (xs-1)].set = primIn;
+      prim[(lsize)y*xs].set = primIn;
+      prim[(lsize)y*xs + (xs-1)].set = primIn;
     }
     for (x = 0; x < xs; x++) {
       cFrontier = PrimMakeIn(prim, x, 0,    xs, ys, cFrontier);
@@ -790,7 +790,7 @@ flag CMaz::PrimGenerate(flag fWall, flag fClear, int xp, int yp)
     for (j = 0; j < DIRS; j++) {
       xnew = x + xoff[d]; ynew = y + yoff[d];
       if (xnew >= 0 && ynew >= 0 && xnew < xs && ynew < ys &&
-        prim[ynew*xs + xnew].set == primIn) {
+        prim[(lsize)ynew*xs + xnew].set == primIn) {
         Set(xbase + (x << 1) + xoff[d], ybase + (y << 1) + yoff[d], fWall);
         break;
       }
@@ -822,19 +822,19 @@ flag CMaz::CreateMazePrim()
 typedef struct _prim2 {
   long x;        // Horizontal coordinate of edge
   long y;        // Vertical coordinate of edge
-  long iEdge;    // Map cell coordinate to edge index/weight
-  long iHeap;    // Map heap index to edge index/weight
+  lsize iEdge;   // Map cell coordinate to edge index/weight
+  lsize iHeap;   // Map heap index to edge index/weight
 } PRIM2;
 
-#define ZPrimXY(x, y) ((y) * xs + ((x) >> 1))
+#define ZPrimXY(x, y) ((lsize)(y) * xs + ((x) >> 1))
 #define FComparePrim(i1, i2) (prim[i1].iHeap < prim[i2].iHeap)
 
 // Given a valid heap and an item at its end, push that item up through the
 // heap so its valid. Called from CreateMazePrim2 to add edges to the set.
 
-void PushupPrim(PRIM2 *prim, long i)
+void PushupPrim(PRIM2 *prim, lsize i)
 {
-  int n = prim[i].iHeap, iParent;
+  lsize n = prim[i].iHeap, iParent;
 
   while (i > 0) {
     iParent = ((i + 1) >> 1) - 1;
@@ -853,7 +853,7 @@ void PushupPrim(PRIM2 *prim, long i)
 flag CMaz::CreateMazePrim2(int xp, int yp)
 {
   PRIM2 *prim = NULL;
-  long cedgeMax, cedge = 0, iFrontier = 0, i, j, jParent;
+  lsize cedgeMax, cedge = 0, iFrontier = 0, i, j, jParent;
   int xs, ys, x, y, xnew, ynew, xnew2, ynew2, xInc, yInc, d;
   flag fWall = ms.fTreeWall, fRet = fFalse;
 
@@ -864,7 +864,7 @@ flag CMaz::CreateMazePrim2(int xp, int yp)
   UpdateDisplay();
 
   xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
-  cedgeMax = xs*ys << 1;
+  cedgeMax = (lsize)xs*ys << 1;
   prim = RgAllocate(cedgeMax, PRIM2);
   if (prim == NULL)
     goto LExit;
@@ -1048,7 +1048,7 @@ void KruskalUnion(KRUS *krus1, KRUS *krus2)
 // number in it, push it down through the tree until the heap condition is met
 // again. Called from CreateMazeKruskal() to implement heap sort.
 
-void PushdownKrus(short *rgs, int z, PT *hedge, long i, long chedge)
+void PushdownKrus(short *rgs, int z, PT *hedge, lsize i, lsize chedge)
 {
   PT ptT;
 
@@ -1070,7 +1070,7 @@ flag CMaz::CreateMazeKruskal(flag fClear, CCol *c2, CCol *c3)
   KRUS *cell = NULL;
   PT *hedge = NULL, pt;
   short *rgsContrast = NULL;
-  long ccell, chedge, icell, ihedge = 0, i, c;
+  lsize ccell, chedge, icell, ihedge = 0, i, c;
   int xs, ys, x, y, x2, y2, j;
   flag fRet = fFalse, fWall = ms.fTreeWall && fClear;
   KV kv, kv2;
@@ -1078,11 +1078,10 @@ flag CMaz::CreateMazeKruskal(flag fClear, CCol *c2, CCol *c3)
   if (fClear) {
     if (ms.fKruskalPic && c3 != NULL)
       FBitmapSizeSet(c3->m_x & ~1, c3->m_y & ~1);
-    if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize |
-      fems64K))
+    if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize))
       goto LExit;
   } else {
-    if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | fems64K))
+    if (!FEnsureMazeSize(3, femsOddSize | femsNoResize))
       goto LExit;
   }
 
@@ -1103,8 +1102,8 @@ flag CMaz::CreateMazeKruskal(flag fClear, CCol *c2, CCol *c3)
 LAfterCheck:
 
   xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
-  ccell = xs*ys;
-  chedge = (xs-1)*ys + (ys-1)*xs;
+  ccell = (lsize)xs*ys;
+  chedge = (lsize)(xs-1)*ys + (lsize)(ys-1)*xs;
   cell = RgAllocate(ccell, KRUS);
   if (cell == NULL)
     goto LExit;
@@ -1202,7 +1201,8 @@ LAfterCheck:
               for (x2 = (y2 == y ? x+1 : 0); x2 < xs; x2++)
                 if (cCopy.Get(xl + (x2 << 1) + 1, yl + (y2 << 1) + 1) == kv) {
                   cCopy.Set(xl + (x2 << 1) + 1, yl + (y2 << 1) + 1, kvBlack);
-                  KruskalUnion(&cell[y*xs + x], &cell[y2*xs + x2]);
+                  KruskalUnion(&cell[(lsize)y*xs + x],
+                    &cell[(lsize)y2*xs + x2]);
                   c--;
                 }
           }
@@ -1210,13 +1210,13 @@ LAfterCheck:
     }
   } else {
     for (x = 0; x < xs-1; x++) {
-      i = (ys-1)*xs;
+      i = (lsize)(ys-1)*xs;
       KruskalUnion(&cell[x], &cell[x+1]);
       KruskalUnion(&cell[i+x], &cell[i+x+1]);
       c -= 2;
     }
     for (y = 0; y < ys-1; y++) {
-      i = y*xs;
+      i = (lsize)y*xs;
       KruskalUnion(&cell[i], &cell[i+xs]);
       KruskalUnion(&cell[i+xs-1], &cell[i+xs-1+xs]);
       c -= 2;
@@ -1232,7 +1232,7 @@ LAfterCheck:
       y2++;
     else
       x2++;
-    icell = y*xs + x; i = y2*xs + x2;
+    icell = (lsize)y*xs + x; i = (lsize)y2*xs + x2;
     if (KruskalFind(&cell[icell]) != KruskalFind(&cell[i])) {
       if (fCellMax)
         goto LExit;
@@ -1371,12 +1371,12 @@ LDone:
 flag CMaz::TreeGenerate(flag fWall, int xs, int ys)
 {
   PT *rgpt;
-  long count, cpt = 1, ipt = 0, iptLo, iptHi;
+  lsize count, cpt = 1, ipt = 0, iptLo, iptHi;
   int x, y, d;
 
-  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | fems64K))
+  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize))
     return fFalse;
-  count = (((xh - xl) >> 1) - fWall) * (((yh - yl) >> 1) - fWall);
+  count = (lsize)(((xh - xl) >> 1) - fWall) * (((yh - yl) >> 1) - fWall);
   if (count <= 0)
     return fTrue;
   rgpt = RgAllocate(count, PT);
@@ -1459,7 +1459,7 @@ flag CMaz::TreeGenerate(flag fWall, int xs, int ys)
 
 flag CMaz::CreateMazeTree()
 {
-  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize | fems64K))
+  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize))
     return fFalse;
   MazeClear(!ms.fTreeWall);
   MakeEntranceExit(0);
@@ -1470,11 +1470,11 @@ flag CMaz::CreateMazeTree()
 
 typedef struct _fors { // Forest Struct
   PT pt;
-  long ipt;
+  lsize ipt;
   KRUS krus;
 } FORS;
 
-#define FZ(x, y) ((y) * xs + (x))
+#define FZ(x, y) ((lsize)(y) * xs + (x))
 #define ForsSwap(i1, i2) \
   ptT = fors[i1].pt; fors[i1].pt = fors[i2].pt; fors[i2].pt = ptT; \
   fors[FZ(fors[i1].pt.x, fors[i1].pt.y)].ipt = i1; \
@@ -1491,18 +1491,18 @@ flag CMaz::CreateMazeForest()
 {
   FORS *fors;
   PT ptT;
-  long count, cpt, ipt, iptT, iptLo, iptHi, iptDun = 0, cIsland;
+  lsize count, cpt, ipt, iptT, iptLo, iptHi, iptDun = 0, cIsland;
   int rgdir[DIRS], rgfNew[DIRS], xs, ys, xb, yb, xp, yp, x, y, d, id, cdir;
   flag fWall = ms.fTreeWall, fNew;
 
-  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize | fems64K))
+  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize))
     return fFalse;
   MazeClear(!ms.fTreeWall);
   MakeEntranceExit(0);
   UpdateDisplay();
 
   xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
-  count = cIsland = xs * ys;
+  count = cIsland = (lsize)xs * ys;
   if (count <= 0)
     return fTrue;
   fors = RgAllocate(count, FORS);
@@ -1746,8 +1746,8 @@ flag CMaz::CreateMazeAldousBroder()
 
 
 typedef struct _wilson {
-  long zList;
-  long iBack;
+  lsize zList;
+  lsize iBack;
   long dir;
 } WILS;
 
@@ -1764,29 +1764,29 @@ flag CMaz::CreateMazeWilson()
 {
   WILS *wils;
   int xbase, ybase, x, y, xs, ys, x0, y0, xnew, ynew, d;
-  long count, i;
+  lsize count, i;
   flag fWall = ms.fTreeWall;
 
   if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize))
     return fFalse;
   xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
-  wils = RgAllocate(xs*ys, WILS);
+  wils = RgAllocate((lsize)xs*ys, WILS);
   if (wils == NULL)
     return fFalse;
-  for (i = xs*ys-1; i >= 0; i--) {
+  for (i = (lsize)xs*ys-1; i >= 0; i--) {
     wils[i].zList = wils[i].iBack = i;
     wils[i].dir = -2;
   }
   MazeClear(!fWall);
   MakeEntranceExit(0);
-  count = xs * ys;
+  count = (lsize)xs * ys;
   xbase = xl + !fWall; ybase = yl + !fWall;
 
   // For passage carved Mazes, start with a single cell. For wall added Mazes,
   // start with the outer boundary wall.
   if (!fWall) {
     x = Rnd(0, xs-1); y = Rnd(0, ys-1);
-    i = y * xs + x;
+    i = (lsize)y * xs + x;
     AssignWils(i, --count);
     wils[i].dir = -1;
     Set0(xbase + (x << 1), ybase + (y << 1));
@@ -1794,13 +1794,13 @@ flag CMaz::CreateMazeWilson()
     for (x = 0; x < xs; x++) {
       i = x;
       wils[i].dir = -1; i = wils[i].iBack; AssignWils(i, --count);
-      i = (ys - 1) * xs + x;
+      i = (lsize)(ys - 1) * xs + x;
       wils[i].dir = -1; i = wils[i].iBack; AssignWils(i, --count);
     }
     for (y = 1; y < ys-1; y++) {
-      i = y * xs;
+      i = (lsize)y * xs;
       wils[i].dir = -1; i = wils[i].iBack; AssignWils(i, --count);
-      i = y * xs + (xs - 1);
+      i = (lsize)y * xs + (xs - 1);
       wils[i].dir = -1; i = wils[i].iBack; AssignWils(i, --count);
     }
   }
@@ -1817,8 +1817,8 @@ flag CMaz::CreateMazeWilson()
       xnew = x + xoff[d]; ynew = y + yoff[d];
       if (xnew < 0 || xnew >= xs || ynew < 0 || ynew >= ys)
         continue;
-      wils[y * xs + x].dir = d;
-      if (wils[ynew * xs + xnew].dir == -1)
+      wils[(lsize)y * xs + x].dir = d;
+      if (wils[(lsize)ynew * xs + xnew].dir == -1)
         break;
       x = xnew; y = ynew;
     }
@@ -1829,7 +1829,7 @@ flag CMaz::CreateMazeWilson()
       break;
     x = x0; y = y0;
     loop {
-      i = y * xs + x;
+      i = (lsize)y * xs + x;
       d = wils[i].dir;
       if (d == -1)
         break;
@@ -1844,6 +1844,281 @@ flag CMaz::CreateMazeWilson()
 }
 
 
+// State of each cell during cycle popping. Cells start out unknown, and are
+// resolved once they're known to lead to the root, or else off their strip.
+
+enum _wilsonpopstate {
+  wpsUnknown = 0,
+  wpsRoot    = 1,
+  wpsExit    = 2,
+};
+
+typedef struct _wilsonpop {
+  byte *rgdir;     // Direction of the top arrow on each cell's stack
+  byte *rgstate;   // Whether each cell leads to the root or off its strip
+  byte *rgfin;     // Whether each strip edge cell ends up leading to root
+  dword *rgdepth;  // How many arrows have been popped off each cell's stack
+  long *rgtarget;  // Cell off the strip that each cell's path leads to
+  long *rgstamp;   // Which walk last visited each cell
+  long rgoff[DIRS];
+  ulong lSeed;
+  int xs;
+  int ys;
+  int cstrip;
+  int nPass;
+  flag fWall;
+  long rgcUnknown[cThreadMax];
+} WPOP;
+
+#define WpopNext(i) ((i) + wpop->rgoff[wpop->rgdir[i]])
+#define WpopLo(is) ((long)(wpop->ys * (is) / wpop->cstrip) * wpop->xs)
+#define WpopHi(is) ((long)(wpop->ys * ((is)+1) / wpop->cstrip) * wpop->xs)
+
+// Return the arrow at a given depth in the stack of a cell. Each arrow points
+// to a random neighboring cell, and is a pure function of the random seed,
+// cell, and depth, so the stacks are the same no matter which thread looks.
+
+int DirWilsonPop(CONST WPOP *wpop, long i, dword depth)
+{
+  int rgd[DIRS], x, y, cd = 0;
+  ulong l;
+
+  l = LRndHash(wpop->lSeed, i, depth);
+  if (wpop->fWall)
+    return (int)(l >> 30);  // Cells that aren't root are never on the edge.
+  x = i % wpop->xs; y = i / wpop->xs;
+  if (y > 0)
+    rgd[cd++] = 0;
+  if (x > 0)
+    rgd[cd++] = 1;
+  if (y < wpop->ys-1)
+    rgd[cd++] = 2;
+  if (x < wpop->xs-1)
+    rgd[cd++] = 3;
+  return rgd[(int)(((qword)l * cd) >> 32)];
+}
+
+#define WpopPop(i) wpop->rgdepth[i]++; \
+  wpop->rgdir[i] = DirWilsonPop(wpop, i, wpop->rgdepth[i])
+
+
+// Thread routine for CreateMazeWilsonPop. Pass 0 pops all cycles contained
+// within one horizontal strip of cells, and resolves each cell to lead to the
+// root or else off the strip. Pass 1 converts cells leading off the strip to
+// leading to the root, or back to unknown, based on where they led.
+
+void WilsonPopThread(void *pv, int is)
+{
+  WPOP *wpop = (WPOP *)pv;
+  long lo, hi, i, c, u, uNext, t = 0, cUnknown = 0;
+  int nState;
+
+  lo = WpopLo(is); hi = WpopHi(is);
+  if (wpop->nPass > 0) {
+    for (i = lo; i < hi; i++) {
+      if (wpop->rgstate[i] == wpsExit)
+        wpop->rgstate[i] = wpop->rgfin[wpop->rgtarget[i]] ? wpsRoot :
+          wpsUnknown;
+      wpop->rgstamp[i] = 0;
+      cUnknown += (wpop->rgstate[i] == wpsUnknown);
+    }
+    wpop->rgcUnknown[is] = cUnknown;
+    return;
+  }
+
+  for (i = lo; i < hi; i++) {
+    if (wpop->rgstate[i] != wpsUnknown)
+      continue;
+
+    // Follow the arrows from an unknown cell until reaching a resolved cell
+    // or leaving the strip. Whenever the path loops back onto itself, pop
+    // the arrows off all the cells in the loop, and keep going.
+    c = i;
+    loop {
+      if (c < lo || c >= hi) {
+        nState = wpsExit; t = c;
+        break;
+      }
+      nState = wpop->rgstate[c];
+      if (nState == wpsRoot)
+        break;
+      if (nState == wpsExit) {
+        t = wpop->rgtarget[c];
+        break;
+      }
+      if (wpop->rgstamp[c] == i+1) {
+        u = c;
+        do {
+          uNext = WpopNext(u);
+          if (u != c)
+            wpop->rgstamp[u] = 0;
+          WpopPop(u);
+          u = uNext;
+        } while (u != c);
+      } else
+        wpop->rgstamp[c] = i+1;
+      c = WpopNext(c);
+    }
+
+    // The path from the starting cell is now loop free, so everything along
+    // it leads to the same place.
+    for (u = i; u != c; u = WpopNext(u)) {
+      wpop->rgstate[u] = nState;
+      wpop->rgtarget[u] = t;
+    }
+  }
+}
+
+
+// Create a new perfect Maze in the bitmap using Wilson's algorithm, as done
+// by Propp and Wilson's cycle popping method. This can carve passages or add
+// walls. Each cell has a stack of random arrows, and any loops formed by the
+// top arrows are popped until only a tree remains. The same tree results no
+// matter what order loops are popped in, so the bitmap is divided into strips
+// which are processed on separate threads, and the random stacks come from
+// LRndHash(), so the same Maze results no matter how many threads are used.
+
+flag CMaz::CreateMazeWilsonPop()
+{
+  WPOP wp, *wpop = &wp;
+  int xbase, ybase, xs, ys, x, y, d, is, r;
+  long count, lo, i, b, u, v, vNext, iRoot;
+  flag fWall = ms.fTreeWall, f, fRet = fFalse;
+
+  if (!FEnsureMazeSize(3, femsOddSize | femsNoResize | femsMinSize))
+    return fFalse;
+  xs = ((xh - xl) >> 1) + fWall; ys = ((yh - yl) >> 1) + fWall;
+  count = (long)xs * ys;
+  wpop->rgdir = RgAllocate(count, byte);
+  wpop->rgstate = RgAllocate(count, byte);
+  wpop->rgfin = RgAllocate(count, byte);
+  wpop->rgdepth = RgAllocate(count, dword);
+  wpop->rgtarget = RgAllocate(count, long);
+  wpop->rgstamp = RgAllocate(count, long);
+  if (wpop->rgdir == NULL || wpop->rgstate == NULL || wpop->rgfin == NULL ||
+    wpop->rgdepth == NULL || wpop->rgtarget == NULL || wpop->rgstamp == NULL)
+    goto LExit;
+  MazeClear(!fWall);
+  MakeEntranceExit(0);
+  xbase = xl + !fWall; ybase = yl + !fWall;
+  wpop->xs = xs; wpop->ys = ys; wpop->fWall = fWall;
+  for (d = 0; d < DIRS; d++)
+    wpop->rgoff[d] = (long)yoff[d] * xs + xoff[d];
+  wpop->lSeed = (ulong)Rnd(lHighest, (int)0x80000000);
+  wpop->cstrip = Min(CThread(), ys);
+
+  // For passage carved Mazes, the root is a single cell. For wall added
+  // Mazes, the root is the outer boundary wall.
+  iRoot = !fWall ? Rnd(0, count-1) : -1;
+  for (i = 0; i < count; i++) {
+    x = i % xs; y = i / xs;
+    f = !fWall ? (i == iRoot) : (x <= 0 || y <= 0 || x >= xs-1 || y >= ys-1);
+    wpop->rgstate[i] = f ? wpsRoot : wpsUnknown;
+    wpop->rgdepth[i] = 0;
+    wpop->rgdir[i] = f ? 0 : DirWilsonPop(wpop, i, 0);
+    wpop->rgstamp[i] = 0;
+  }
+  UpdateDisplay();
+
+  loop {
+    // Pop all loops contained within each strip, in parallel.
+    wpop->nPass = 0;
+    RunThreads(WilsonPopThread, wpop, wpop->cstrip);
+    if (wpop->cstrip <= 1)
+      break;
+
+    // Follow paths between strips, from edge cell to edge cell, popping
+    // any loops that span strips, and noting which edge cells lead to root.
+    for (is = 0; is < wpop->cstrip; is++)
+      for (r = 0; r < 2; r++) {
+        lo = !r ? WpopLo(is) : WpopHi(is) - xs;
+        for (b = lo; b < lo + xs; b++)
+          wpop->rgfin[b] = (wpop->rgstate[b] == wpsRoot);
+      }
+    for (is = 0; is < wpop->cstrip; is++)
+      for (r = 0; r < 2; r++) {
+        lo = !r ? WpopLo(is) : WpopHi(is) - xs;
+        for (b = lo; b < lo + xs; b++) {
+          if (wpop->rgstate[b] != wpsExit || wpop->rgstamp[b] > count)
+            continue;
+          u = b;
+          loop {
+            if (wpop->rgstate[u] == wpsRoot) {
+              f = fTrue;
+              break;
+            }
+            if (wpop->rgstamp[u] > count) {
+              f = wpop->rgfin[u];
+              if (wpop->rgstamp[u] == count + 1 + b) {
+                v = u;
+                do {
+                  vNext = WpopNext(v);
+                  WpopPop(v);
+                  v = vNext;
+                } while (v != u);
+                v = u;
+                do {
+                  wpop->rgfin[v] = fFalse;
+                  v = wpop->rgtarget[v];
+                } while (v != u);
+                f = fFalse;
+              }
+              break;
+            }
+            wpop->rgstamp[u] = count + 1 + b;
+            u = wpop->rgtarget[u];
+          }
+          for (v = b; v != u; v = wpop->rgtarget[v])
+            wpop->rgfin[v] = f;
+        }
+      }
+
+    // Resolve cells that led off their strip, in parallel.
+    wpop->nPass = 1;
+    RunThreads(WilsonPopThread, wpop, wpop->cstrip);
+    for (is = 0, i = 0; is < wpop->cstrip; is++)
+      i += wpop->rgcUnknown[is];
+    if (i <= 0)
+      break;
+
+    // Any cells still unknown lead into a loop spanning strips that was
+    // popped above. Resolve them with one pass over the whole bitmap. Most
+    // loops are short and have already been popped within strips.
+    wpop->cstrip = 1;
+  }
+
+  // Draw the tree formed by the final arrow on top of each cell's stack.
+  if (!fWall)
+    Set0(xbase + (iRoot % xs << 1), ybase + (iRoot / xs << 1));
+  for (i = 0; i < count; i++) {
+    x = i % xs; y = i / xs;
+    if (!fWall ? (i == iRoot) : (x <= 0 || y <= 0 || x >= xs-1 || y >= ys-1))
+      continue;
+    if (fCellMax)
+      break;
+    d = wpop->rgdir[i];
+    Set(xbase + (x << 1), ybase + (y << 1), fWall);
+    Set(xbase + (x << 1) + xoff[d], ybase + (y << 1) + yoff[d], fWall);
+  }
+  fRet = fTrue;
+
+LExit:
+  if (wpop->rgdir != NULL)
+    DeallocateP(wpop->rgdir);
+  if (wpop->rgstate != NULL)
+    DeallocateP(wpop->rgstate);
+  if (wpop->rgfin != NULL)
+    DeallocateP(wpop->rgfin);
+  if (wpop->rgdepth != NULL)
+    DeallocateP(wpop->rgdepth);
+  if (wpop->rgtarget != NULL)
+    DeallocateP(wpop->rgtarget);
+  if (wpop->rgstamp != NULL)
+    DeallocateP(wpop->rgstamp);
+  return fRet;
+}
+
+
 // Carve one row of a Maze using Eller's algorithm, adding onto the Maze and
 // updating the sets the cells in the current row are within appropriately.
 
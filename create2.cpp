@@ -1615,19 +1615,17 @@ flag CMaz::CreateMazeHyper()
 {
   PT3 *rgpt;
   int tx, ty, tz, x, y, z, xnew, ynew, znew, d, i;
-  long count, cpt = 1, ipt = 0, iptLo, iptHi;
+  lsize count, cpt = 1, ipt = 0, iptLo, iptHi;
 
   if (!FCubeSizeSet(m_x3, m_y3, m_z3, m_w3))
     return fFalse;
-  if (F64K3())
-    return fFalse;
   BitmapOff();
   tx = Even(m_x3); ty = Even(m_y3); tz = Even(m_z3);
 
   // Start with solid faces at the top and bottom levels.
   CubeBlock(0, 0, 0,    tx-2, ty-2, 0,    fOn);
   CubeBlock(0, 0, tz-2, tx-2, ty-2, tz-2, fOn);
-  count = (long)(tx >> 1) * (ty >> 1) * (tz >> 1);
+  count = (lsize)(tx >> 1) * (ty >> 1) * (tz >> 1);
   if (count < 1)
     return fTrue;
   rgpt = RgAllocate(count, PT3);
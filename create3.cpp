@@ -1497,10 +1497,10 @@ flag CMaz::FFractalLine(CMaz *b2, CMazK *c, KV kv,
   BFSS *bfss;
   CMaz bT;
   int x = x1, y = y1, xnew, ynew, d0, cd, d;
-  long iLo = 0, iHi = 1, iMax = 1, i, j;
+  lsize iLo = 0, iHi = 1, iMax = 1, i, j;
   flag fLine = (x2 < 0), fRet = fFalse;
 
-  bfss = RgAllocate((m_x >> 2)*(m_y >> 2), BFSS);
+  bfss = RgAllocate((lsize)(m_x >> 2)*(m_y >> 2), BFSS);
   if (bfss == NULL)
     return fFalse;
   if (!bT.FBitmapCopy(*this)) {
@@ -2332,12 +2332,12 @@ LNext:
 flag CMaz::CavernGenerate(flag fWall, int xs, int ys)
 {
   PT *rgpt;
-  long cpt = 1, ipt = 0, iptLo, iptHi;
+  lsize cpt = 1, ipt = 0, iptLo, iptHi;
   int x, y, d;
 
-  if (!FEnsureMazeSize(3, femsNoResize | fems64K))
+  if (!FEnsureMazeSize(3, femsNoResize))
     return fFalse;
-  rgpt = RgAllocate((xh-xl+1)*(yh-yl+1), PT);
+  rgpt = RgAllocate((lsize)(xh-xl+1)*(yh-yl+1), PT);
   if (rgpt == NULL)
     return fFalse;
 
@@ -2411,7 +2411,7 @@ flag CMaz::CreateMazeCavern()
   int x1, x2, x, y, i, d;
   flag fRet;
 
-  if (!FEnsureMazeSize(3, femsNoResize | fems64K))
+  if (!FEnsureMazeSize(3, femsNoResize))
     return fFalse;
   BitmapSet(!ms.fTreeWall);
   if (ms.fTreeWall)
@@ -41,6 +41,10 @@
 #include "maze.h"
 #include "draw.h"
 #include "daedalus.h"
+#ifndef PC
+#include <sys/mman.h>
+#define cbHugePage 0x200000
+#endif
 
 
 // Global variables
@@ -57,13 +61,13 @@ WS ws = {
   // Menu settings
   fFalse, fFalse, fFalse, fFalse,
   // Macro accessible only settings
-  nPrintNormal, -1, fFalse, fFalse, 1000, -1,
+  nPrintNormal, -1, fFalse, fFalse, 1000, -1, -1, -1, 0,
   // Internal settings
   NULL, NULL,
     fFalse, fTrue, fFalse, fFalse, fFalse, fFalse, fFalse, fFalse, fFalse,
     0, 0, cmdCreatePerfect, cmdCreatePerfect, 0, fFalse, fFalse,
     NULL, NULL, NULL, NULL, 0, 0, 0, 0, 12, 0, NULL, 0, 0, 0, 0, fFalse,
-    NULL, NULL, 0, NULL, 0, NULL, NULL, 0, NULL, 0, NULL, 0,
+    NULL, NULL, 0, NULL, 0, NULL, NULL, 0, NULL, 0, NULL, 0, 0L,
     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
 
 BM bm = {xStart, yStart, 0, 0, 0, 0, 0, 1, 1, 1,
@@ -94,7 +98,7 @@ DR dr = {
     -1, -1, -1, -1, -1, -1, fFalse, 94001225, 0, 0, 50, 333,
     fFalse, fFalse, -1, fFalse, fFalse, fFalse, fFalse, fFalse, fFalse,
     fFalse, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1,
-    fFalse, fFalse, fFalse, 11, 3412, 4, 427, 0,
+    fFalse, fFalse, fFalse, fTrue, 11, 3412, 4, 427, 0,
   // Internal settings
   fFalse, 0, 0.0, NULL, 0, NULL, NULL, NULL, NULL, 50, 40, 99999, 0};
 
@@ -208,6 +212,7 @@ int InitCoordinates(int cCoor)
     DeallocateP(bm.coor);
   bm.coor = coor;
   bm.ccoor = cCoor;
+  VertexStoreFree(&ds.vsWire);
   if (!fExtend)
     ds.cCoorPatch = 0;
   return bm.ccoor;
@@ -222,6 +227,7 @@ flag FSetCoordinates(int x1, int y1, int z1, int x2, int y2, int z2, KV kv)
     return fFalse;
   Assert(ds.cCoorPatch < bm.ccoor);
   WriteCoordinates(bm.coor, x1, y1, z1, x2, y2, z2, kv < 0 ? ds.kvTrim : kv);
+  VertexStoreFree(&ds.vsWire);
   return fTrue;
 }
 
@@ -246,6 +252,7 @@ int InitPatch(int cPat)
     DeallocateP(bm.patch);
   bm.patch = patch;
   bm.cpatch = cPat;
+  VertexStoreFree(&ds.vsPatch);
   if (!fExtend)
     ds.cCoorPatch = 0;
   return bm.cpatch;
@@ -266,6 +273,7 @@ flag FSetPatch(int x1, int y1, int z1, int x2, int y2, int z2, KV kv)
   pat[3].x = x2; pat[3].y = y2; pat[3].z = z1; pat[3].fLine = fTrue;
   Assert(ds.cCoorPatch < bm.cpatch);
   WritePatch(bm.patch, pat, fFalse, kv < 0 ? ds.kvObject : kv);
+  VertexStoreFree(&ds.vsPatch);
   return fTrue;
 }
 
@@ -543,6 +551,34 @@ flag FWriteFile(CONST CMaz &b, CONST CMazK &c, int wCmd, CONST char *sz,
 }
 
 
+// Check a filename pattern used to save a sequence of frames. It may contain
+// one printf style %d, which gets replaced with the frame number.
+
+flag FCheckFramePattern(CONST char *szFile)
+{
+  char sz[cchSzMax];
+  CONST char *pch;
+  int cd = 0;
+
+  for (pch = szFile; *pch; pch++) {
+    if (*pch != '%')
+      continue;
+    pch++;
+    if (*pch == '%')
+      continue;
+    while (FDigitCh(*pch))
+      pch++;
+    if (*pch != 'd' || ++cd > 1) {
+      sprintf(S(sz), "The frame file %s should contain at most one %%d.",
+        szFile);
+      PrintSz_E(sz);
+      return fFalse;
+    }
+  }
+  return fTrue;
+}
+
+
 // Change the active bitmap. Switch to showing either the main bitmap or the
 // color bitmap.
 
@@ -756,13 +792,16 @@ CMaz *BitmapGetMask(int ib)
 
 
 // Return a pointer to the specified custom color bitmap, as used for
-// textures.
+// textures. Since the caller may change it, also note textures have changed,
+// so any copies the inside view has made of them get made again.
 
 CMazK *ColmapGetTexture(int ic)
 {
   CMazK *pcT;
   int iT;
 
+  ws.lTextureGen++;
+
   // Special values allow referencing the standard bitmaps.
   if (ic < -5)
     return NULL;
@@ -817,6 +856,7 @@ void DeallocateTextures()
     ws.rgcTexture = NULL;
     ws.ccTexture = 0;
   }
+  ws.lTextureGen++;
 }
 
 
@@ -1847,6 +1887,49 @@ void PolishMaze(int wCmd, int nMode)
 }
 
 
+// Replay the edits recorded during the last Maze creation into the main
+// bitmap, spread evenly over the given number of frames. Each frame is either
+// shown on the screen at the given frames per second, or if a file name is
+// passed, saved to its own numbered bitmap file, for making an animation.
+
+flag FPlayRecording(int cframe, int nRate, CONST char *szFile)
+{
+  char sz[cchSzMax];
+  long irec = 0, irecMax;
+  int iframe, nTimer, nDelay;
+  flag fAllowUpdate = ws.fAllowUpdate, fRet = fFalse;
+
+  if (gs.crec <= 0) {
+    PrintSz_W("There is no recorded Maze creation to play back.\n");
+    return fFalse;
+  }
+  RecordEnd();
+  cframe = Max(cframe, 1);
+  ws.fAllowUpdate = fTrue;
+  for (iframe = 0; iframe < cframe; iframe++) {
+    nTimer = NGetVariableW(vosGetTick);
+    irecMax = (long)((real)gs.crec * (real)(iframe + 1) / (real)cframe);
+    irec = RecordApply(bm.b, irec, irecMax);
+    if (szFile != NULL) {
+      sprintf(S(sz), "%s%04d.bmp", szFile, iframe);
+      if (!FWriteFile(bm.b, bm.k, cmdSaveBitmap, sz, sz))
+        goto LExit;
+      continue;
+    }
+    UpdateDisplay();
+    if (nRate > 0) {
+      nDelay = 1000 / nRate - (NGetVariableW(vosGetTick) - nTimer);
+      if (nDelay > 0)
+        DoOperationW(oosDelay, NULL, 0, nDelay, ~0);
+    }
+  }
+  fRet = fTrue;
+LExit:
+  ws.fAllowUpdate = fAllowUpdate;
+  return fRet;
+}
+
+
 // Fire a macro event if defined, passing in the given parameters and
 // returning the result of the macro's execution.
 
@@ -3061,6 +3144,318 @@ LDone:
 
 
 #ifndef WIN
+/*
+******************************************************************************
+** Headless Display
+******************************************************************************
+*/
+
+// The command line version of the program has no window, but when a display
+// file is set, it draws the view into an offscreen bitmap the size the window
+// would be, at each point where the Windows version would redraw its window,
+// and saves each frame drawn. Frames can go to numbered image files, or be
+// streamed as raw 24 bit RGB to a file or to stdout, such as to pipe into a
+// video encoder.
+
+CMazK kDisplay;                 // Offscreen bitmap for the overview display
+FILE *fileDisplay = NULL;       // Open raw frame stream, if any
+char szDisplayOpen[cchSzMax];   // Name of the open raw frame stream
+flag fDisplayDirty = fFalse;    // Whether the view changed since last frame
+
+// Return the display file name pattern, or NULL if the headless display is
+// off.
+
+CONST char *SzDisplayFile()
+{
+  CONST char *sz;
+
+  if (!FSzVar(ws.nDisplayFile))
+    return NULL;
+  sz = SzVar(ws.nDisplayFile);
+  return *sz ? sz : NULL;
+}
+
+
+// Return whether frames are being streamed to stdout, in which case messages
+// need to go to stderr instead so they don't mix with the frame data.
+
+flag FDisplayStdout()
+{
+  CONST char *sz = SzDisplayFile();
+
+  return sz != NULL && sz[0] == '-' && sz[1] == chNull;
+}
+
+
+// Return whether raw frames are being streamed to the display file. Raw
+// streams have no header, so every frame in them has to be the same size.
+
+flag FDisplayStreaming()
+{
+  CONST char *sz = SzDisplayFile();
+
+  return fileDisplay != NULL && sz != NULL &&
+    FCompareSzRgch(szDisplayOpen, sz, CchSz(sz));
+}
+
+
+// Draw the overhead view of the main or color bitmap into a display bitmap,
+// positioned and zoomed the same way the Windows version draws its window.
+
+void DrawDisplayOverview(CMazK &c)
+{
+  CMap3 *pbFocus = PbFocus();
+  int *rgxs, xaBm, yaBm, xaDot, yaDot, xpView, ypView, x, y, xs, ys, i, n;
+  KV kv;
+  byte *pb;
+  lsize lScratch = LScratchMark();
+
+  c.BitmapSet(dr.kvEdge);
+  if (pbFocus->FNull())
+    return;
+  xaBm = pbFocus->m_x; yaBm = pbFocus->m_y;
+  if (!dr.f3D) {
+    xaDot = dr.x; yaDot = dr.y;
+  } else {
+    xaDot = bm.b.X2(dr.x, dr.z); yaDot = bm.b.Y2(dr.y, dr.z);
+  }
+
+  // Determine how much of the bitmap to draw, and where to draw it.
+  if (bm.nWhat > 0) {
+    bm.xaView = Min(bm.xCell, xaBm); bm.yaView = Min(bm.yCell, yaBm);
+    if (bm.nWhat > 1) {
+      bm.xaView = Max(1, ws.xpClient / bm.xaView);
+      bm.yaView = Max(1, ws.ypClient / bm.yaView);
+      bm.xaView = Min(bm.xaView, xaBm); bm.yaView = Min(bm.yaView, yaBm);
+    }
+    bm.xaOrigin = xaDot - (bm.xaView >> 1);
+    bm.yaOrigin = yaDot - (bm.yaView >> 1);
+    EnsureBetween(bm.xaOrigin, 0, xaBm - bm.xaView);
+    EnsureBetween(bm.yaOrigin, 0, yaBm - bm.yaView);
+  } else {
+    bm.xaView = xaBm; bm.yaView = yaBm;
+    bm.xaOrigin = bm.yaOrigin = 0;
+  }
+  if (bm.nHow < 3) {
+    if (bm.nHow == 0 && bm.nWhat != 1) {
+      bm.xpPoint = bm.xCell; bm.ypPoint = bm.yCell;
+    } else {
+      bm.xpPoint = Max(1, ws.xpClient / bm.xaView);
+      bm.ypPoint = Max(1, ws.ypClient / bm.yaView);
+    }
+    if (bm.nHow == 1) {
+      if (bm.xpPoint > bm.ypPoint)
+        bm.xpPoint = bm.ypPoint;
+      else
+        bm.ypPoint = bm.xpPoint;
+    }
+    xpView = bm.xaView * bm.xpPoint; ypView = bm.yaView * bm.ypPoint;
+    bm.xpOrigin = NMultDiv(ws.xpClient - xpView, ws.xScroll, nScrollPage*2);
+    bm.ypOrigin = NMultDiv(ws.ypClient - ypView, ws.yScroll, nScrollPage*2);
+  } else {
+    bm.xpPoint = bm.ypPoint = 1;
+    bm.xpOrigin = bm.ypOrigin = 0;
+    xpView = ws.xpClient; ypView = ws.ypClient;
+  }
+
+  // Figure out which bitmap column each display column shows, then copy the
+  // bitmap a row at a time.
+  rgxs = RgAllocateScratch(c.m_x, int);
+  if (rgxs == NULL)
+    return;
+  for (x = 0; x < c.m_x; x++) {
+    i = x - bm.xpOrigin;
+    rgxs[x] = !FBetween(i, 0, xpView-1) ? -1 : bm.xaOrigin +
+      (bm.nHow < 3 ? i / bm.xpPoint : NMultDiv(i, bm.xaView, xpView));
+  }
+  for (y = 0; y < c.m_y; y++) {
+    i = y - bm.ypOrigin;
+    if (!FBetween(i, 0, ypView-1))
+      continue;
+    ys = bm.yaOrigin +
+      (bm.nHow < 3 ? i / bm.ypPoint : NMultDiv(i, bm.yaView, ypView));
+    pb = c._Pb(0, y);
+    for (x = 0; x < c.m_x; x++, pb += cbPixelC) {
+      xs = rgxs[x];
+      if (xs < 0)
+        continue;
+      if (!bm.fColor)
+        kv = bm.b.Get(xs, ys) ? dr.kvOn : dr.kvOff;
+      else
+        kv = bm.k._Get(xs, ys);
+      c._Set(pb, RgbR(kv), RgbG(kv), RgbB(kv));
+    }
+  }
+  ScratchRelease(lScratch);
+
+  // Draw the 2nd dot and the dot.
+  for (i = 0; i < 2 && bm.nHow < 3; i++) {
+    if (i == 0) {
+      if (!dr.fDot2)
+        continue;
+      if (!dr.f3D) {
+        xs = dr.x2; ys = dr.y2;
+      } else {
+        xs = bm.b.X2(dr.x2, dr.z2); ys = bm.b.Y2(dr.y2, dr.z2);
+      }
+      kv = dr.kvDot2;
+    } else {
+      if (!dr.fDot)
+        continue;
+      xs = xaDot; ys = yaDot;
+      kv = dr.kvDot;
+      bm.fDrewDot = fTrue;
+    }
+    bm.xpDot = bm.xpOrigin + (xs - bm.xaOrigin) * bm.xpPoint;
+    bm.ypDot = bm.ypOrigin + (ys - bm.yaOrigin) * bm.ypPoint;
+    if (!c.FLegal(bm.xpDot, bm.ypDot))
+      continue;
+    n = dr.nDotSize;
+    c.Block(bm.xpDot - bm.xpPoint*n, bm.ypDot - bm.ypPoint*n,
+      bm.xpDot + bm.xpPoint*(n+1) - 1, bm.ypDot + bm.ypPoint*(n+1) - 1, kv);
+  }
+}
+
+
+// Save a frame of the headless display to the display file. The file name may
+// contain one printf style %d, which is replaced with the frame number. Names
+// of "-" or ending in ".rgb" or ".raw" append raw 24 bit RGB frames to a
+// stream. Otherwise a Targa or Windows bitmap is saved, based on extension.
+
+flag FWriteDisplayFrame(CONST CMazK &c)
+{
+  char sz[cchSzMax], szT[cchSzMax*2];
+  CONST char *szFile = SzDisplayFile();
+  int cch = CchSz(szFile), x, y;
+  byte *rgb, *pbSrc, *pbDst;
+  FILE *file;
+  lsize lScratch;
+
+  // Raw frames are streamed to one file, which stays open between frames.
+  if (FDisplayStdout() || (cch >= 4 &&
+    (FCompareSzRgchI(".rgb", szFile + cch - 4, 4) ||
+    FCompareSzRgchI(".raw", szFile + cch - 4, 4)))) {
+    if (fileDisplay != NULL && !FCompareSzRgch(szDisplayOpen, szFile, cch)) {
+      if (fileDisplay != stdout)
+        fclose(fileDisplay);
+      fileDisplay = NULL;
+    }
+    if (fileDisplay == NULL) {
+      fileDisplay = FDisplayStdout() ? stdout : FileOpen(szFile, "wb");
+      if (fileDisplay == NULL) {
+        sprintf(S(sz), "The display file %s could not be created.", szFile);
+        PrintSz_E(sz);
+        return fFalse;
+      }
+      CopySz(szFile, szDisplayOpen, cchSzMax);
+    }
+    lScratch = LScratchMark();
+    rgb = RgAllocateScratch(c.m_x * 3, byte);
+    if (rgb == NULL)
+      return fFalse;
+    for (y = 0; y < c.m_y; y++) {
+      pbSrc = c._Pb(0, y);
+      pbDst = rgb;
+      for (x = 0; x < c.m_x; x++) {
+        pbDst[0] = pbSrc[2]; pbDst[1] = pbSrc[1]; pbDst[2] = pbSrc[0];
+        pbSrc += cbPixelC; pbDst += 3;
+      }
+      fwrite(rgb, 3, c.m_x, fileDisplay);
+    }
+    fflush(fileDisplay);
+    ScratchRelease(lScratch);
+    ws.nDisplayFrame++;
+    return fTrue;
+  }
+
+  // Each other frame is saved to its own file, named by frame number.
+  if (!FCheckFramePattern(szFile))
+    return fFalse;
+  sprintf(S(sz), szFile, ws.nDisplayFrame);
+  file = FileOpen(sz, "wb");
+  if (file == NULL) {
+    sprintf(S(szT), "The display file %s could not be created.", sz);
+    PrintSz_E(szT);
+    return fFalse;
+  }
+  if (cch >= 4 && FCompareSzRgchI(".tga", szFile + cch - 4, 4))
+    c.WriteColmapTarga(file);
+  else
+    c.WriteColmap(file);
+  fclose(file);
+  ws.nDisplayFrame++;
+  return fTrue;
+}
+
+
+// Redraw the headless display, and save it as the next frame. Does nothing if
+// there's no display file. The Inside view is drawn into the Inside bitmap as
+// the Windows version does, while the overview is drawn into its own bitmap.
+
+void RedrawDisplay()
+{
+  CMazK *pc;
+
+  if (SzDisplayFile() == NULL || ws.fInRedraw)
+    return;
+  ws.fInRedraw = fTrue;
+  bm.fDrewDot = fFalse;
+  if (dr.fInside) {
+    if (!dr.fInSmooth &&
+      !FBetween(dr.nInside, nInsideFree, nInsideVeryFree)) {
+      dr.nOffsetX = dr.nOffsetY = dr.nOffsetZ = dr.nOffsetD = 0;
+      if (dr.fNarrow) {
+        dr.x |= 1; dr.y |= 1; dr.z &= ~1;
+      }
+    }
+    if (bm.kI.FNull() || bm.kI.m_x != ws.xpClient || bm.kI.m_y != ws.ypClient)
+      if (!bm.kI.FBitmapSizeSet(ws.xpClient, ws.ypClient))
+        goto LDone;
+    if (dr.nInside != nInsideSimple) {
+      if (ds.nStereo == 0)
+        RedrawInsidePerspective(bm.kI);
+      else
+        RedrawInsidePerspectiveStereo(bm.kI, bm.kS);
+    } else {
+      if (!dr.f3D)
+        RedrawInside(bm.kI);
+      else
+        RedrawInside3(bm.kI);
+    }
+    if (dr.fMap)
+      DrawOverlay(bm.kI, bm.b);
+    if (ws.iEventInside2 > 0)
+      RunMacro(ws.iEventInside2);
+    pc = &bm.kI;
+  } else {
+    if (kDisplay.FNull() ||
+      kDisplay.m_x != ws.xpClient || kDisplay.m_y != ws.ypClient)
+      if (!kDisplay.FBitmapSizeSet(ws.xpClient, ws.ypClient))
+        goto LDone;
+    DrawDisplayOverview(kDisplay);
+    pc = &kDisplay;
+  }
+  FWriteDisplayFrame(*pc);
+  fDisplayDirty = fFalse;
+LDone:
+  ws.fInRedraw = fFalse;
+}
+
+
+// Finish the headless display when the program exits. If the view changed
+// since the last frame, draw one more frame so the final state is included.
+
+void DisplayClose()
+{
+  if (fDisplayDirty)
+    RedrawDisplay();
+  if (fileDisplay != NULL && fileDisplay != stdout)
+    fclose(fileDisplay);
+  fileDisplay = NULL;
+  kDisplay.Free();
+}
+
+
 /*
 ******************************************************************************
 ** Command Line Version
@@ -3077,6 +3472,7 @@ int main(int argc, char *argv[])
   // Initialize globals
   ws.szAppName = szDaedalus;
   ws.szFileTemp = szFileTempCore;
+  ws.xpClient = xDisplayDef; ws.ypClient = yDisplayDef;
 
   // Process command line
   szLine[0] = chNull;
@@ -3103,6 +3499,9 @@ LLoop:
     DoCommandW(cmdCommand);
     goto LLoop;
   }
+  DisplayClose();
+  if (FSzVar(ws.nProfileFile))
+    FProfileDump(SzVar(ws.nProfileFile));
   return 0;
 }
 
@@ -3141,7 +3540,8 @@ int PrintSzCore(CONST char *sz, int nPriority)
   }
 
   // Actually print the text.
-  printf("%s: %s\n", ws.szTitle != NULL ? ws.szTitle : szTitle, sz);
+  fprintf(FDisplayStdout() ? stderr : stdout, "%s: %s\n",
+    ws.szTitle != NULL ? ws.szTitle : szTitle, sz);
   ws.cDialog++;
 
 LDone:
@@ -3150,79 +3550,62 @@ LDone:
 }
 
 
-// Allocate a memory buffer of a given size, in an OS independent manner.
+// Allocate a memory block of a given size from the system, in an OS
+// independent manner. Blocks of several megabytes or more are mapped directly
+// where possible, so the OS can back them with huge pages.
 
-void *PAllocate(long lcb)
+void *PAllocateSys(lsize lcb)
 {
-  char sz[cchSzMax];
-  void *pv;
-
 #ifndef PC
   // For Unix systems in which longs are 8 bytes instead of 4 bytes.
   lcb += 4;
 #endif
-#ifdef DEBUG
-  pv = malloc(lcb + sizeof(dword)*3);
-#else
-  pv = malloc(lcb);
-#endif
+#ifdef MADV_HUGEPAGE
+  void *pv;
 
-  // Handle success or failure of the allocation.
-  if (pv == NULL) {
-    sprintf(S(sz), "Failed to allocate memory (%ld bytes).\n", lcb);
-    PrintSz_E(sz);
-  } else {
-    us.cAlloc++;
-    us.cAllocTotal++;
-    us.cAllocSize += lcb;
-  }
-
-#ifdef DEBUG
-  // Put sentinels at ends of allocation to check for buffer overruns.
-  *(dword *)pv = dwCanary;
-  *(dword *)((byte *)pv + sizeof(dword)) = lcb;
-  *(dword *)((byte *)pv + sizeof(dword)*2 + lcb) = dwCanary;
-  return (byte *)pv + sizeof(dword)*2;
-#else
-  return pv;
+  if (lcb >= cbHugePage) {
+    pv = mmap(NULL, lcb, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+      -1, 0);
+    if (pv == MAP_FAILED)
+      return NULL;
+    madvise(pv, lcb, MADV_HUGEPAGE);
+    return pv;
+  }
 #endif
+  return malloc(lcb);
 }
 
 
-// Free a memory buffer allocated with PAllocate.
+// Free a memory block allocated with PAllocateSys.
 
-void DeallocateP(void *pv)
+void DeallocateSys(void *pv, lsize lcb)
 {
-  Assert(pv != NULL);
-#ifdef DEBUG
-  // Ensure buffer wasn't overrun during its existence.
-  void *pvSys;
-  dword lcb, dw;
-  pvSys = (byte *)pv - sizeof(dword)*2;
-  Assert(pvSys != NULL);
-  dw = *(dword *)pvSys;
-  Assert(dw == dwCanary);
-  lcb = *(dword *)((byte *)pvSys + sizeof(dword));
-  dw = *(dword *)((byte *)pv + lcb);
-  Assert(dw == dwCanary);
-  free(pvSys);
-#else
-  free(pv);
+#ifndef PC
+  lcb += 4;
+#endif
+#ifdef MADV_HUGEPAGE
+  if (lcb >= cbHugePage) {
+    munmap(pv, lcb);
+    return;
+  }
 #endif
-  us.cAlloc--;
+  free(pv);
 }
 
 
-// Redraw the screen, if Allow Partial Screen Updates is on. This does nothing
-// for the command line version of the program, since there's no display.
+// Redraw the screen, if Allow Partial Screen Updates is on. For the command
+// line version of the program, this saves a frame of the headless display.
 
 void UpdateDisplay()
 {
+  if (ws.fAllowUpdate)
+    RedrawDisplay();
 }
 
 
 // Draw a monochrome or color pixel on the display. This does nothing for the
-// command line version of the program, since there's no display.
+// command line version of the program, since the headless display is always
+// redrawn from the bitmaps in full.
 
 void ScreenDot(int x, int y, bit o, KV kv)
 {
@@ -3312,14 +3695,30 @@ flag DoCommandW(int wCmd)
     RunCommandLine(sz, NULL);
     return fTrue;
   }
+  if (wCmd == cmdRepaintNow) {
+    RedrawDisplay();
+    return fTrue;
+  }
   return fFalse;
 }
 
 
-// Set a system variable to a numeric value.
+// Set a system variable to a numeric value. The size and scroll position of
+// the headless display are all there is to set in the command line version.
 
 void DoSetVariableW(int ivos, int n)
 {
+  if ((ivos == vosSizeX || ivos == vosSizeY) && FDisplayStreaming() &&
+    Max(1, Min(n, 32767)) != (ivos == vosSizeX ? ws.xpClient : ws.ypClient)) {
+    PrintSz_W("The display size can't change while streaming raw frames.\n");
+    return;
+  }
+  switch (ivos) {
+  case vosSizeX:   ws.xpClient = Max(1, Min(n, 32767)); break;
+  case vosSizeY:   ws.ypClient = Max(1, Min(n, 32767)); break;
+  case vosScrollX: ws.xScroll = Max(0, Min(n, nScrollPage*2)); break;
+  case vosScrollY: ws.yScroll = Max(0, Min(n, nScrollPage*2)); break;
+  }
 }
 
 
@@ -3331,6 +3730,10 @@ int NGetVariableW(int ivos)
   switch (ivos) {
   case vosGetTick:
     return (int)clock();
+  case vosSizeX:
+    return ws.xpClient;
+  case vosSizeY:
+    return ws.ypClient;
   }
   return 0;
 }
@@ -3343,10 +3746,19 @@ void DoOperationW(int ioos, CONST char *rgch, int cch, int n1, int n2)
 }
 
 
-// Execute a simple system specific action.
+// Execute a simple system specific action. Redraws and dirtied views update
+// the headless display, if there is one.
 
 void SystemHook(int ihos)
 {
+  switch (ihos) {
+  case hosRedraw:
+    RedrawDisplay();
+    break;
+  case hosDirtyView:
+    fDisplayDirty = fTrue;
+    break;
+  }
 }
 
 
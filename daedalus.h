@@ -43,15 +43,17 @@
 #define imtnMax 3600
 #define icldMax 64
 #define szFileTempCore "daedalus.tmp"
+#define xDisplayDef 640
+#define yDisplayDef 480
 
 #define icmdBase 1001
 #define cmdScriptLast cmdScript31
 #define cmdSizeLast cmdSize19
 #define iActionMax ccmd
 #define ccmd 470
-#define copr 183
-#define cvar 328
-#define cfun 125
+#define copr 190
+#define cvar 356
+#define cfun 128
 
 enum _edgebehavior {
   nEdgeVoid  = 0,
@@ -76,6 +78,15 @@ enum _semitransparentwalls {
   nTransDefault  = nTransVery,
 };
 
+enum _profilephase {
+  prfScript      = 0,
+  prfCommand     = 1,
+  prfOperation   = 2,
+  prfInside      = 3,
+  prfInsideReuse = 4,
+  cprf           = 5,
+};
+
 enum _commandtag {
   fCmtRedraw       = 0x1,
   fCmtDirtyView    = 0x2,
@@ -242,6 +253,9 @@ typedef struct _windowstate {
   flag fNoExit;
   int nSoundDelay;
   int nFileLock;
+  int nProfileFile;
+  int nDisplayFile;
+  int nDisplayFrame;
 
   // Internal settings
 
@@ -291,6 +305,7 @@ typedef struct _windowstate {
   int cbMask;
   CMazK *rgcTexture;
   int ccTexture;
+  long lTextureGen;
   TRIE rgsTrieAlloc;
   TRIE rgsTrieCmd;
   TRIE rgsTrieAbbrev;
@@ -540,6 +555,7 @@ typedef struct _dotrendering {
   flag fTextureDual;
   flag fTextureDual2;
   flag fTextureBlend;
+  flag fTextureMip;
   int nMarkElevX1;
   int nMarkElevY1;
   int nMarkElevX2;
@@ -606,6 +622,9 @@ extern CONST CMD rgcmd[ccmd];
 extern CONST OPR rgopr[copr];
 extern CONST VAR rgvar[cvar];
 extern CONST FUN rgfun[cfun];
+extern PROF rgprofPhase[cprf];
+extern PROF rgprofCmd[ccmd];
+extern PROF rgprofOpr[copr];
 extern CONST int rgcmdMouse[11];
 extern CONST PT rgptSize[cmdSizeLast - cmdSize01 + 1];
 extern CONST char *rgszScript[cmdScriptLast - cmdScript01 + 1];
@@ -618,6 +637,7 @@ flag FReadBitmap(FILE *, flag);
 flag FReadDaedalusBitmap(FILE *);
 flag FReadFile(int, FILE *, flag);
 flag FWriteFile(CONST CMaz &, CONST CMazK &, int, CONST char *, CONST char *);
+flag FCheckFramePattern(CONST char *);
 flag FShowColmap(flag);
 void DoSize(int, int, flag, flag);
 flag DoDefineMacro(int, CONST char *, int, CONST char *);
@@ -639,6 +659,7 @@ void FormatRgchToSz(CONST char *, int, char *, int);
 void DotTemp(int, int, int);
 void DotZap(int, int);
 void PolishMaze(int, int);
+flag FPlayRecording(int, int, CONST char *);
 flag FCheckEvent(int, int, int, int);
 void CheckEventMove(int, int, int, int, int, flag);
 flag FCheckEventClick(int, long);
@@ -657,6 +678,7 @@ flag FCreateConstTrie(CONST char *, int);
 // From command.cpp
 
 char *PchGetParameter(char *, char **, int *, long *, int);
+flag FProfileDump(CONST char *);
 int DoCommand(int);
 int RunCommandLine(char *, FILE *);
 void RunCommandLines(CONST char *rgsz[]);
@@ -671,6 +693,8 @@ long InsideFromA(int);
 flag FCreateInsideStars(CMazK *, real, int, flag);
 flag FMoveCloud(int, int);
 void ResetInside();
+void ResetInsideFrame();
+void InsideCacheFree();
 void FormatCompass(char *, flag, int *);
 void FormatLocation(char *, flag);
 void FormatTimer(char *, ulong, ulong);
@@ -679,6 +703,8 @@ flag RedrawInsidePerspectiveStereo(CMazK &, CMazK &);
 void RedrawInside(CMazK &);
 void RedrawInside3(CMazK &);
 void DrawOverlay(CMazK &, CMaz &);
+long RenderCameraPath(CONST char *, CONST long *, int);
+long RenderSolvePath(CONST char *);
 
 // From game.cpp
 
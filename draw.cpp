@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory.h>
 #include "util.h"
 #include "graphics.h"
 #include "color.h"
@@ -46,9 +47,14 @@ DS ds = {
   // Inside settings
   fFalse, 500, 0,
   // Macro accessible only settings
-  10990099, -1, fFalse, fFalse, 0, 0, 0, 1000, fTrue, 0, fFalse,
+  10990099, -1, fFalse, fFalse, 0, 0, 0, 1000, fTrue, fFalse, 0, 0,
+  fFalse, fFalse,
   // Internal settings
-  fFalse, xStart, 0.0, 0, NULL};
+  fFalse, xStart, 0.0, 0, NULL,
+  {NULL, NULL, NULL, NULL, 0, NULL, 0, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0},
+    {0, 0, 0}, NULL, NULL, NULL, 0},
+  {NULL, NULL, NULL, NULL, 0, NULL, 0, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0},
+    {0, 0, 0}, NULL, NULL, NULL, 0}};
 
 
 /*
@@ -972,6 +978,7 @@ long ReadWirelist(COOR **pcoor, FILE *file)
   if (*pcoor != NULL)
     DeallocateP(*pcoor);
   *pcoor = coor;
+  VertexStoreFree(&ds.vsWire);
 
   // Load the appropriate number of actual lines from the file.
   for (i = 0; i < count; i++) {
@@ -1047,6 +1054,7 @@ long ReadPatchlist(PATCH **ppatch, FILE *file)
   if (*ppatch != NULL)
     DeallocateP(*ppatch);
   *ppatch = patch;
+  VertexStoreFree(&ds.vsPatch);
 
   // Load the appropriate number of actual patches from the file.
   for (i = 0; i < count; ) {
@@ -1481,12 +1489,160 @@ flag CreateCubicLine(CONST CMon3 &t, COOR *coor, CONST CCol *c)
 }
 
 
+// Merge sort a list of items of a given size, using a temporary list of the
+// same size, and a function comparing two items given an extra parameter.
+// Called from CMergeWireframe() and CMergePatches().
+
+void SortItem(void *rg, void *rgT, long c, int cb,
+  int (*pfn)(CONST void *, CONST void *, int), int nParam)
+{
+  byte *rgSrc = (byte *)rg, *rgDst = (byte *)rgT, *pbSwap;
+  long cRun, i, j, k, l, iMid, iEnd;
+
+  for (cRun = 1; cRun < c; cRun <<= 1) {
+    for (i = 0; i < c; i += cRun << 1) {
+      iMid = Min(i + cRun, c); iEnd = Min(i + (cRun << 1), c);
+      for (j = i, k = iMid, l = i; l < iEnd; l++) {
+        if (k >= iEnd || (j < iMid &&
+          (*pfn)(rgSrc + j*cb, rgSrc + k*cb, nParam) <= 0))
+          CopyPb(rgSrc + (j++)*cb, rgDst + l*cb, cb);
+        else
+          CopyPb(rgSrc + (k++)*cb, rgDst + l*cb, cb);
+      }
+    }
+    pbSwap = rgSrc; rgSrc = rgDst; rgDst = pbSwap;
+  }
+  if (rgSrc != (byte *)rg)
+    CopyPb(rgSrc, rg, c*cb);
+}
+
+
+// Info about one line segment in a wireframe, for merging with others.
+
+typedef struct _linemerge {
+  long i;      // Index of the first line merged into this one
+  int nAxis;   // Axis the line runs along, or -1 if it isn't axis aligned
+  real a, b;   // Coordinates along the other two axes
+  real r1, r2; // Start and end along its axis
+  KV kv;
+} LM;
+
+// Compare two lines, so that lines along the same axis line and of the same
+// color are grouped together in order of where they start.
+
+int NCompareLine(CONST void *pv1, CONST void *pv2, int nParam)
+{
+  CONST LM *plm1 = (CONST LM *)pv1, *plm2 = (CONST LM *)pv2;
+
+  if (plm1->nAxis != plm2->nAxis)
+    return plm1->nAxis < plm2->nAxis ? -1 : 1;
+  if (plm1->nAxis < 0)
+    return plm1->i < plm2->i ? -1 : (plm1->i > plm2->i);
+  if (plm1->a != plm2->a)
+    return plm1->a < plm2->a ? -1 : 1;
+  if (plm1->b != plm2->b)
+    return plm1->b < plm2->b ? -1 : 1;
+  if (plm1->kv != plm2->kv)
+    return plm1->kv < plm2->kv ? -1 : 1;
+  if (plm1->r1 != plm2->r1)
+    return plm1->r1 < plm2->r1 ? -1 : 1;
+  return plm1->i < plm2->i ? -1 : (plm1->i > plm2->i);
+}
+
+
+// Merge collinear lines of the same color in a wireframe that touch or
+// overlap end to end into single longer lines, keeping the lines in about the
+// same order. Returns the new number of lines. Called from CreateWireframe()
+// when fMergeFaces is set.
+
+long CMergeWireframe(COOR *coor, long ccoor)
+{
+  LM *rglm, *rglmT, *plm;
+  real rg1[3], rg2[3], rT;
+  long i, j, clm = 0;
+  int d;
+
+  rglm = RgAllocate(Max(ccoor, 1) * 2, LM);
+  if (rglm == NULL)
+    return ccoor;
+  rglmT = rglm + Max(ccoor, 1);
+
+  // Figure out which axis each line runs along, if any.
+  for (i = 0; i < ccoor; i++) {
+    plm = &rglm[i];
+    rg1[0] = coor[i].x1; rg1[1] = coor[i].y1; rg1[2] = coor[i].z1;
+    rg2[0] = coor[i].x2; rg2[1] = coor[i].y2; rg2[2] = coor[i].z2;
+    plm->i = i;
+    plm->kv = coor[i].kv;
+    plm->nAxis = -1;
+    for (d = 0; d < 3; d++)
+      if (rg1[d] != rg2[d]) {
+        if (plm->nAxis >= 0) {
+          plm->nAxis = -1;
+          break;
+        }
+        plm->nAxis = d;
+      }
+    if (plm->nAxis < 0)
+      continue;
+    d = plm->nAxis;
+    plm->a = rg1[(d + 1) % 3]; plm->b = rg1[(d + 2) % 3];
+    plm->r1 = rg1[d]; plm->r2 = rg2[d];
+    if (plm->r1 > plm->r2) {
+      rT = plm->r1; plm->r1 = plm->r2; plm->r2 = rT;
+    }
+  }
+
+  // Sort lines so ones along the same axis line are next to each other, then
+  // join each to the previous if they touch.
+  SortItem(rglm, rglmT, ccoor, sizeof(LM), NCompareLine, 0);
+  for (i = 0; i < ccoor; i++) {
+    if (clm > 0 && rglm[i].nAxis >= 0) {
+      plm = &rglm[clm - 1];
+      if (plm->nAxis == rglm[i].nAxis && plm->a == rglm[i].a &&
+        plm->b == rglm[i].b && plm->kv == rglm[i].kv &&
+        rglm[i].r1 <= plm->r2) {
+        plm->r2 = Max(plm->r2, rglm[i].r2);
+        plm->i = Min(plm->i, rglm[i].i);
+        continue;
+      }
+    }
+    rglm[clm++] = rglm[i];
+  }
+
+  // Write the merged lines back over the original list, in the order of the
+  // first line in each.
+  for (i = 0; i < ccoor; i++)
+    rglmT[i].i = -1;
+  for (j = 0; j < clm; j++)
+    rglmT[rglm[j].i] = rglm[j];
+  j = 0;
+  for (i = 0; i < ccoor; i++) {
+    plm = &rglmT[i];
+    if (plm->i < 0)
+      continue;
+    if (plm->nAxis >= 0) {
+      d = plm->nAxis;
+      rg1[d] = plm->r1; rg2[d] = plm->r2;
+      rg1[(d + 1) % 3] = rg2[(d + 1) % 3] = plm->a;
+      rg1[(d + 2) % 3] = rg2[(d + 2) % 3] = plm->b;
+      coor[i].x1 = rg1[0]; coor[i].y1 = rg1[1]; coor[i].z1 = rg1[2];
+      coor[i].x2 = rg2[0]; coor[i].y2 = rg2[1]; coor[i].z2 = rg2[2];
+    }
+    coor[j++] = coor[i];
+  }
+  DeallocateP(rglm);
+  return clm;
+}
+
+
 // Create a wireframe forming blocks around pixels in a bitmap, in a new line
 // list. Implements the Make Wireframe Bitmap Overview command.
 
 long CreateWireframe(CONST CMon3 &b, COOR **pcoor, flag f3D, CONST CCol *c)
 {
   COOR *coor;
+  long ccoor;
 
   // Figure out how many lines will be in the wireframe.
   ds.cCoorPatch = 0;
@@ -1502,6 +1658,7 @@ long CreateWireframe(CONST CMon3 &b, COOR **pcoor, flag f3D, CONST CCol *c)
   if (*pcoor != NULL)
     DeallocateP(*pcoor);
   *pcoor = coor;
+  VertexStoreFree(&ds.vsWire);
 
   // Actually generate the wireframe.
   ds.cCoorPatch = 0;
@@ -1509,6 +1666,14 @@ long CreateWireframe(CONST CMon3 &b, COOR **pcoor, flag f3D, CONST CCol *c)
     CreateOverviewLine(b, coor, c);
   else
     CreateCubicLine(b, coor, c);
+
+  // Merge lines that continue each other, and shrink the list to fit.
+  if (ds.fMergeFace) {
+    ccoor = ds.cCoorPatch;
+    ds.cCoorPatch = CMergeWireframe(coor, ccoor);
+    if (ds.cCoorPatch < ccoor)
+      FSetWireSize(pcoor, ds.cCoorPatch, ds.cCoorPatch);
+  }
   return ds.cCoorPatch;
 }
 
@@ -1525,6 +1690,7 @@ flag FSetWireSize(COOR **pcoor, int ccoorOld, int ccoorNew)
   if (*pcoor != NULL)
     DeallocateP(*pcoor);
   *pcoor = coor;
+  VertexStoreFree(&ds.vsWire);
   return fTrue;
 }
 
@@ -1713,12 +1879,228 @@ void CreateCubicPatch(CONST CMon3 &t, PATCH *patch, CONST CCol *c)
 }
 
 
+// Info about one rectangular patch, for merging with others in its plane.
+
+typedef struct _facemerge {
+  long i;         // Index of the first patch merged into this one
+  int nAxis;      // Axis the face is perpendicular to, or -1 if not a face
+  real w;         // Coordinate of the face's plane along that axis
+  real u1, u2;    // Extent of the face along the next axis
+  real v1, v2;    // Extent of the face along the axis after that
+  int grfCorner;  // Which corner of the face each patch corner is at
+  int grfSide;    // Which sides of the face have lines along them
+  KV kv;
+  int nTrans;
+} FM;
+
+#define fsU1 1
+#define fsU2 2
+#define fsV1 4
+#define fsV2 8
+
+// Compare two faces, so that faces in the same plane which look the same are
+// grouped together, and within that by either rows or columns.
+
+int NCompareFace(CONST void *pv1, CONST void *pv2, int fRow)
+{
+  CONST FM *pfm1 = (CONST FM *)pv1, *pfm2 = (CONST FM *)pv2;
+  real rg1[3], rg2[3];
+  int i;
+
+  if (pfm1->nAxis != pfm2->nAxis)
+    return pfm1->nAxis < pfm2->nAxis ? -1 : 1;
+  if (pfm1->nAxis < 0)
+    return pfm1->i < pfm2->i ? -1 : (pfm1->i > pfm2->i);
+  if (pfm1->w != pfm2->w)
+    return pfm1->w < pfm2->w ? -1 : 1;
+  if (pfm1->grfCorner != pfm2->grfCorner)
+    return pfm1->grfCorner < pfm2->grfCorner ? -1 : 1;
+  if (pfm1->kv != pfm2->kv)
+    return pfm1->kv < pfm2->kv ? -1 : 1;
+  if (pfm1->nTrans != pfm2->nTrans)
+    return pfm1->nTrans < pfm2->nTrans ? -1 : 1;
+  if (fRow) {
+    rg1[0] = pfm1->v1; rg1[1] = pfm1->v2; rg1[2] = pfm1->u1;
+    rg2[0] = pfm2->v1; rg2[1] = pfm2->v2; rg2[2] = pfm2->u1;
+  } else {
+    rg1[0] = pfm1->u1; rg1[1] = pfm1->u2; rg1[2] = pfm1->v1;
+    rg2[0] = pfm2->u1; rg2[1] = pfm2->u2; rg2[2] = pfm2->v1;
+  }
+  for (i = 0; i < 3; i++)
+    if (rg1[i] != rg2[i])
+      return rg1[i] < rg2[i] ? -1 : 1;
+  return pfm1->i < pfm2->i ? -1 : (pfm1->i > pfm2->i);
+}
+
+
+// Figure out which side of a face the edge between two corners is along,
+// given the corners' positions in the face.
+
+int FsFromCorners(int c1, int c2)
+{
+  if ((c1 & 1) == (c2 & 1))
+    return (c1 & 1) ? fsU2 : fsU1;
+  return (c1 & 2) ? fsV2 : fsV1;
+}
+
+
+// Merge rectangular patches of the same color lying next to each other in
+// the same plane into larger rectangles, as long as the edges between them
+// don't have lines drawn along them, so the merged patches look the same as
+// the originals. Patches are first joined into rows, then rows of the same
+// length into larger rectangles, keeping the patches in about the same order.
+// Returns the new number of patches. Called from CreatePatches() when
+// fMergeFaces is set.
+
+long CMergePatches(PATCH *patch, long cpatch)
+{
+  FM *rgfm, *rgfmT, *pfm, *pfmT;
+  CONST PATCH *ppat;
+  real rg[cPatch][3];
+  long i, j, cfm;
+  int rgc[cPatch], d, k, c, nSort;
+  flag fMerge;
+
+  rgfm = RgAllocate(Max(cpatch, 1) * 2, FM);
+  if (rgfm == NULL)
+    return cpatch;
+  rgfmT = rgfm + Max(cpatch, 1);
+
+  // Figure out which plane each patch is in, and where its corners and lines
+  // are within its rectangle. Patches that aren't rectangles aligned with the
+  // axes are left alone.
+  for (i = 0; i < cpatch; i++) {
+    pfm = &rgfm[i];
+    ppat = &patch[i];
+    pfm->i = i;
+    pfm->kv = ppat->kv;
+    pfm->nTrans = ppat->nTrans;
+    pfm->nAxis = -1;
+    if (ppat->cpt != 4)
+      continue;
+    for (k = 0; k < 4; k++) {
+      rg[k][0] = ppat->p[k].x; rg[k][1] = ppat->p[k].y;
+      rg[k][2] = ppat->p[k].z;
+    }
+    for (d = 0; d < 3; d++)
+      if (rg[0][d] == rg[1][d] && rg[0][d] == rg[2][d] &&
+        rg[0][d] == rg[3][d])
+        break;
+    if (d >= 3)
+      continue;
+    pfm->w = rg[0][d];
+    pfm->u1 = pfm->u2 = rg[0][(d + 1) % 3];
+    pfm->v1 = pfm->v2 = rg[0][(d + 2) % 3];
+    for (k = 1; k < 4; k++) {
+      pfm->u1 = Min(pfm->u1, rg[k][(d + 1) % 3]);
+      pfm->u2 = Max(pfm->u2, rg[k][(d + 1) % 3]);
+      pfm->v1 = Min(pfm->v1, rg[k][(d + 2) % 3]);
+      pfm->v2 = Max(pfm->v2, rg[k][(d + 2) % 3]);
+    }
+    // Each corner needs to be at a different corner of the rectangle, with
+    // each edge along one of its sides.
+    pfm->grfCorner = c = 0;
+    for (k = 0; k < 4; k++) {
+      rgc[k] = (rg[k][(d + 1) % 3] == pfm->u2) |
+        (rg[k][(d + 2) % 3] == pfm->v2) << 1;
+      pfm->grfCorner |= rgc[k] << (k << 1);
+      c |= 1 << rgc[k];
+      if ((rg[k][(d + 1) % 3] != pfm->u1 && !(rgc[k] & 1)) ||
+        (rg[k][(d + 2) % 3] != pfm->v1 && !(rgc[k] & 2)))
+        c |= 16;
+    }
+    if (pfm->u1 == pfm->u2 || pfm->v1 == pfm->v2 || c != 15)
+      continue;
+    for (k = 0; k < 4; k++)
+      if ((rgc[k] ^ rgc[(k + 1) & 3]) == 3)
+        break;
+    if (k < 4)
+      continue;
+    pfm->grfSide = 0;
+    for (k = 0; k < 4; k++)
+      if (ppat->p[k].fLine)
+        pfm->grfSide |= FsFromCorners(rgc[k], rgc[(k + 1) & 3]);
+    pfm->nAxis = d;
+  }
+
+  // Join faces next to each other along the first axis into rows, then rows
+  // next to each other along the second axis into rectangles.
+  cfm = cpatch;
+  for (nSort = 1; nSort <= 2; nSort++) {
+    SortItem(rgfm, rgfmT, cfm, sizeof(FM), NCompareFace, nSort == 1);
+    j = 0;
+    for (i = 0; i < cfm; i++) {
+      pfm = &rgfm[i];
+      pfmT = &rgfm[Max(j - 1, 0)];
+      fMerge = j > 0 && pfm->nAxis >= 0 && pfmT->nAxis == pfm->nAxis &&
+        pfmT->w == pfm->w && pfmT->grfCorner == pfm->grfCorner &&
+        pfmT->kv == pfm->kv && pfmT->nTrans == pfm->nTrans;
+      if (fMerge && nSort == 1)
+        fMerge = pfmT->v1 == pfm->v1 && pfmT->v2 == pfm->v2 &&
+          pfmT->u2 == pfm->u1 && !(pfmT->grfSide & fsU2) &&
+          !(pfm->grfSide & fsU1) &&
+          (pfmT->grfSide & (fsV1 | fsV2)) == (pfm->grfSide & (fsV1 | fsV2));
+      else if (fMerge)
+        fMerge = pfmT->u1 == pfm->u1 && pfmT->u2 == pfm->u2 &&
+          pfmT->v2 == pfm->v1 && !(pfmT->grfSide & fsV2) &&
+          !(pfm->grfSide & fsV1) &&
+          (pfmT->grfSide & (fsU1 | fsU2)) == (pfm->grfSide & (fsU1 | fsU2));
+      if (!fMerge) {
+        rgfm[j++] = *pfm;
+        continue;
+      }
+      if (nSort == 1) {
+        pfmT->u2 = pfm->u2;
+        pfmT->grfSide = (pfmT->grfSide & ~fsU2) | (pfm->grfSide & fsU2);
+      } else {
+        pfmT->v2 = pfm->v2;
+        pfmT->grfSide = (pfmT->grfSide & ~fsV2) | (pfm->grfSide & fsV2);
+      }
+      pfmT->i = Min(pfmT->i, pfm->i);
+    }
+    cfm = j;
+  }
+
+  // Write the merged patches back over the original list, in the order of
+  // the first patch in each.
+  for (i = 0; i < cpatch; i++)
+    rgfmT[i].i = -1;
+  for (j = 0; j < cfm; j++)
+    rgfmT[rgfm[j].i] = rgfm[j];
+  j = 0;
+  for (i = 0; i < cpatch; i++) {
+    pfm = &rgfmT[i];
+    if (pfm->i < 0)
+      continue;
+    if (pfm->nAxis >= 0) {
+      d = pfm->nAxis;
+      for (k = 0; k < 4; k++) {
+        rgc[k] = c = (pfm->grfCorner >> (k << 1)) & 3;
+        rg[k][d] = pfm->w;
+        rg[k][(d + 1) % 3] = (c & 1) ? pfm->u2 : pfm->u1;
+        rg[k][(d + 2) % 3] = (c & 2) ? pfm->v2 : pfm->v1;
+      }
+      for (k = 0; k < 4; k++) {
+        patch[i].p[k].x = rg[k][0]; patch[i].p[k].y = rg[k][1];
+        patch[i].p[k].z = rg[k][2];
+        patch[i].p[k].fLine =
+          (pfm->grfSide & FsFromCorners(rgc[k], rgc[(k + 1) & 3])) != 0;
+      }
+    }
+    patch[j++] = patch[i];
+  }
+  DeallocateP(rgfm);
+  return cfm;
+}
+
+
 // Create patches forming blocks around pixels in a bitmap, in a new patch
 // list. Implements the Make Patch Bitmap Overview command.
 
 long CreatePatches(CONST CMon3 &b, PATCH **ppatch, flag f3D, CONST CCol *c)
 {
   PATCH *patch;
+  long cpatch;
 
   // Figure out how many patches will be in the patch list.
   ds.cCoorPatch = 0;
@@ -1734,6 +2116,7 @@ long CreatePatches(CONST CMon3 &b, PATCH **ppatch, flag f3D, CONST CCol *c)
   if (*ppatch != NULL)
     DeallocateP(*ppatch);
   *ppatch = patch;
+  VertexStoreFree(&ds.vsPatch);
 
   // Actually generate the patches.
   ds.cCoorPatch = 0;
@@ -1741,6 +2124,14 @@ long CreatePatches(CONST CMon3 &b, PATCH **ppatch, flag f3D, CONST CCol *c)
     CreateOverviewPatch(b, patch, c);
   else
     CreateCubicPatch(b, patch, c);
+
+  // Merge faces in the same plane, and shrink the list to fit.
+  if (ds.fMergeFace) {
+    cpatch = ds.cCoorPatch;
+    ds.cCoorPatch = CMergePatches(patch, cpatch);
+    if (ds.cCoorPatch < cpatch)
+      FSetPatchSize(ppatch, ds.cCoorPatch, ds.cCoorPatch);
+  }
   return ds.cCoorPatch;
 }
 
@@ -1758,6 +2149,7 @@ flag FSetPatchSize(PATCH **ppatch, int cpatchOld, int cpatchNew)
   if (*ppatch != NULL)
     DeallocateP(*ppatch);
   *ppatch = patch;
+  VertexStoreFree(&ds.vsPatch);
   return fTrue;
 }
 
@@ -55,6 +55,31 @@ typedef struct _starlocation {
   KV kv;   // Color of star
 } STAR;
 
+typedef struct _vertexstore {
+  real *rgx;         // Horizontal coordinate of each unique vertex
+  real *rgy;         // Depth coordinate of each unique vertex
+  real *rgz;         // Vertical coordinate of each unique vertex
+  long *rgiv;        // Vertex index of each patch corner or line end
+  long cv;           // Number of unique vertices
+  CONST void *pvSrc; // Patch or line list the store was built from
+  long cSrc;         // Number of patches or lines in the source list
+  real rgrMin[3];    // Smallest x, y, and z coordinate of any vertex
+  real rgrMax[3];    // Largest x, y, and z coordinate of any vertex
+  int rgcCell[3];    // Number of grid cells along each axis
+  long *rgicItem;    // Grid cell each patch or line is in
+  real *rgrBox;      // Bounding box of the items within each grid cell
+  long *rglStamp;    // Frame each vertex was last gathered in
+  long lStamp;       // Number of the current frame
+} VS;
+
+typedef struct _viewtransform {
+  real xpos, ypos, zpos;          // Viewing location
+  real rxScale, ryScale, rzScale; // Scale along each axis
+  real rS, rC;                    // Horizontal rotation
+  real rS2, rC2;                  // Vertical rotation
+  real rSign, rMirror;            // Whether y-axis is reflected
+} VT;
+
 typedef struct _drawsettings {
   // Draw settings
 
@@ -115,6 +140,9 @@ typedef struct _drawsettings {
   int nWireWidth;
   int nWireDistance;
   flag fWireSort;
+  flag fZBuffer;
+  int nDrawDistance;
+  flag fMergeFace;
   int nFaceOrigin;
   flag fStereo3D;   // Used by Inside view too
 
@@ -125,6 +153,8 @@ typedef struct _drawsettings {
   real rHoriz;
   long cCoorPatch;
   STAR *rgstar;
+  VS vsWire;
+  VS vsPatch;
 } DS;
 
 typedef struct _coordinates {
@@ -153,6 +183,17 @@ typedef struct _patch {
   short nTrans;
 } PATCH;
 
+typedef struct _patchview {
+  long iv[cPatch]; // Vertex store index of each corner
+  real rDistance;
+  KV kv;
+  short cpt;
+  short nTrans;
+  int grfLine;     // Bit for each edge that should have a line drawn
+} PATV;
+
+#define FPatvLine(pat, k) FOdd((pat).grfLine >> (k))
+
 extern DS ds;
 
 
@@ -215,6 +256,7 @@ extern flag CreateSolids(CONST char *);
 
 extern KV KvStarRandom(void);
 extern void CalculateCoordinate(int *, int *, real, real, real);
+extern void VertexStoreFree(VS *);
 extern flag FRenderPerspectiveWireCore(CMap &, COOR *, long);
 extern flag FRenderPerspectiveWire(CMap &, COOR *, long);
 extern flag FRenderPerspectivePatchCore(CMap &, PATCH *, long);
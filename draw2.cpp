@@ -28,6 +28,8 @@
 */
 
 #include <stdio.h>
+#include <stddef.h>
+#include <memory.h>
 #include <math.h>
 #include "util.h"
 #include "graphics.h"
@@ -370,6 +372,346 @@ void CalculateCoordinateR(real *h, real *v, real x, real y, real z)
 }
 
 
+/*
+******************************************************************************
+** Vertex Store
+******************************************************************************
+*/
+
+#define PrCorner(pv, ic) ((CONST real *)((CONST byte *)(pv) + \
+  ((ic) / ccorner) * cbItem + rgofs[(ic) % ccorner]))
+#define cItemCell 16
+#define cCellAxisMax 256
+
+// Free a vertex store, so it will be rebuilt from its patch or line list the
+// next time that list is rendered. Called whenever such a list is changed.
+
+void VertexStoreFree(VS *pvs)
+{
+  if (pvs->rgx != NULL)
+    DeallocateP(pvs->rgx);
+  if (pvs->rgiv != NULL)
+    DeallocateP(pvs->rgiv);
+  if (pvs->rgicItem != NULL)
+    DeallocateP(pvs->rgicItem);
+  if (pvs->rgrBox != NULL)
+    DeallocateP(pvs->rgrBox);
+  if (pvs->rglStamp != NULL)
+    DeallocateP(pvs->rglStamp);
+  ClearPb(pvs, sizeof(VS));
+}
+
+
+// Build a uniform grid over the items in a vertex store, where each item is
+// placed in the cell containing the center of its corners, and the bounding
+// box of all items in each cell is recorded, so whole cells of items out of
+// view can be skipped at once. Called from FVertexStoreBuild().
+
+flag FVertexGridBuild(VS *pvs, int ccorner)
+{
+  real rgrSize[3], rgr[3], *pr, rVol = 1.0, rCell = 1.0;
+  long ccell = 1, icell, i, iv;
+  int d, k, n, cAxis = 0;
+
+  // Pick a cell size giving about cItemCell items per cell. Axes the
+  // vertices don't extend along at all just get one cell.
+  for (d = 0; d < 3; d++) {
+    rgrSize[d] = pvs->rgrMax[d] - pvs->rgrMin[d];
+    if (rgrSize[d] > 0.0) {
+      rVol *= rgrSize[d];
+      cAxis++;
+    }
+  }
+  if (cAxis > 0)
+    rCell = pow(rVol * (real)cItemCell / (real)Max(pvs->cSrc, 1),
+      1.0 / (real)cAxis);
+  for (d = 0; d < 3; d++) {
+    pvs->rgcCell[d] = rgrSize[d] <= 0.0 ? 1 :
+      (int)Min(Max(rgrSize[d] / rCell, 1.0), (real)cCellAxisMax);
+    ccell *= pvs->rgcCell[d];
+  }
+  pvs->rgicItem = RgAllocate(Max(pvs->cSrc, 1), long);
+  pvs->rgrBox = RgAllocate(ccell * 6, real);
+  pvs->rglStamp = RgAllocate(Max(pvs->cv, 1), long);
+  if (pvs->rgicItem == NULL || pvs->rgrBox == NULL || pvs->rglStamp == NULL)
+    return fFalse;
+  ClearPb(pvs->rglStamp, Max(pvs->cv, 1) * sizeof(long));
+  pvs->lStamp = 0;
+
+  // Start each box inside out, so cells with no items in them stay that way.
+  for (icell = 0; icell < ccell; icell++)
+    for (d = 0; d < 3; d++) {
+      pvs->rgrBox[icell*6 + d]     = pvs->rgrMax[d];
+      pvs->rgrBox[icell*6 + 3 + d] = pvs->rgrMin[d] - 1.0;
+    }
+
+  // Figure out which cell each item goes in, and grow that cell's box.
+  for (i = 0; i < pvs->cSrc; i++) {
+    rgr[0] = rgr[1] = rgr[2] = 0.0;
+    for (k = 0; k < ccorner; k++) {
+      iv = pvs->rgiv[i*ccorner + k];
+      rgr[0] += pvs->rgx[iv]; rgr[1] += pvs->rgy[iv]; rgr[2] += pvs->rgz[iv];
+    }
+    icell = 0;
+    for (d = 2; d >= 0; d--) {
+      n = rgrSize[d] <= 0.0 ? 0 : (int)((rgr[d] / (real)ccorner -
+        pvs->rgrMin[d]) / rgrSize[d] * (real)pvs->rgcCell[d]);
+      EnsureBetween(n, 0, pvs->rgcCell[d] - 1);
+      icell = icell * pvs->rgcCell[d] + n;
+    }
+    pvs->rgicItem[i] = icell;
+    pr = pvs->rgrBox + icell*6;
+    for (k = 0; k < ccorner; k++) {
+      iv = pvs->rgiv[i*ccorner + k];
+      pr[0] = Min(pr[0], pvs->rgx[iv]); pr[3] = Max(pr[3], pvs->rgx[iv]);
+      pr[1] = Min(pr[1], pvs->rgy[iv]); pr[4] = Max(pr[4], pvs->rgy[iv]);
+      pr[2] = Min(pr[2], pvs->rgz[iv]); pr[5] = Max(pr[5], pvs->rgz[iv]);
+    }
+  }
+  return fTrue;
+}
+
+
+// Build a vertex store from a patch or line list, unless the store was
+// already built from that list. Each item in the list has up to ccorner
+// corners, with the x, y, and z coordinates of each stored consecutively at
+// the given byte offsets within the item. If ofsCount isn't negative, it's
+// the offset of a short within each item giving how many corners it actually
+// has. Identical corners are merged into one vertex, so a vertex shared by
+// several patches or lines is only transformed and projected once. A grid
+// over the items is also built, for culling them by whole cells at a time.
+
+flag FVertexStoreBuild(VS *pvs, CONST void *pvSrc, long cSrc, long cbItem,
+  int ccorner, CONST int *rgofs, int ofsCount)
+{
+  CONST real *pr, *prT;
+  long *rgih = NULL, *rgicFirst = NULL, cc, ic, iv, ih, cHash, lMask;
+  int ccornerItem, d;
+  dword h;
+  flag fRet = fFalse;
+
+  if (pvs->rgiv != NULL && pvs->pvSrc == pvSrc && pvs->cSrc == cSrc)
+    return fTrue;
+  VertexStoreFree(pvs);
+  cc = cSrc * ccorner;
+  for (cHash = 16; cHash <= cc; cHash <<= 1)
+    ;
+  rgih = RgAllocate(cHash, long);
+  rgicFirst = RgAllocate(Max(cc, 1), long);
+  pvs->rgiv = RgAllocate(Max(cc, 1), long);
+  if (rgih == NULL || rgicFirst == NULL || pvs->rgiv == NULL)
+    goto LDone;
+  for (ih = 0; ih < cHash; ih++)
+    rgih[ih] = -1;
+  lMask = cHash - 1;
+
+  // Hash each corner by its coordinates, and look for an identical corner
+  // earlier in the list that's already been made a vertex.
+  for (ic = 0; ic < cc; ic++) {
+    ccornerItem = ofsCount < 0 ? ccorner : *(CONST short *)((CONST byte *)
+      pvSrc + (ic / ccorner) * cbItem + ofsCount);
+    if (ic % ccorner >= ccornerItem) {
+      pvs->rgiv[ic] = pvs->rgiv[ic - ic % ccorner];
+      continue;
+    }
+    pr = PrCorner(pvSrc, ic);
+    h = (dword)((long)pr[0] * 73856093L ^ (long)pr[1] * 19349663L ^
+      (long)pr[2] * 83492791L);
+    for (ih = h & lMask; (iv = rgih[ih]) >= 0; ih = (ih + 1) & lMask) {
+      prT = PrCorner(pvSrc, rgicFirst[iv]);
+      if (prT[0] == pr[0] && prT[1] == pr[1] && prT[2] == pr[2])
+        break;
+    }
+    if (iv < 0) {
+      iv = pvs->cv++;
+      rgih[ih] = iv;
+      rgicFirst[iv] = ic;
+    }
+    pvs->rgiv[ic] = iv;
+  }
+
+  // Copy the coordinates of each unique vertex into its own set of arrays.
+  pvs->rgx = RgAllocate(Max(pvs->cv, 1) * 3, real);
+  if (pvs->rgx == NULL)
+    goto LDone;
+  pvs->rgy = pvs->rgx + pvs->cv; pvs->rgz = pvs->rgy + pvs->cv;
+  for (iv = 0; iv < pvs->cv; iv++) {
+    pr = PrCorner(pvSrc, rgicFirst[iv]);
+    pvs->rgx[iv] = pr[0]; pvs->rgy[iv] = pr[1]; pvs->rgz[iv] = pr[2];
+    for (d = 0; d < 3; d++) {
+      if (iv == 0 || pr[d] < pvs->rgrMin[d])
+        pvs->rgrMin[d] = pr[d];
+      if (iv == 0 || pr[d] > pvs->rgrMax[d])
+        pvs->rgrMax[d] = pr[d];
+    }
+  }
+  pvs->pvSrc = pvSrc;
+  pvs->cSrc = cSrc;
+  fRet = FVertexGridBuild(pvs, ccorner);
+
+LDone:
+  if (rgicFirst != NULL)
+    DeallocateP(rgicFirst);
+  if (rgih != NULL)
+    DeallocateP(rgih);
+  if (!fRet)
+    VertexStoreFree(pvs);
+  return fRet;
+}
+
+
+// Set up a transformation from world space to view space, which moves points
+// relative to the viewing location, scales them, and rotates them
+// horizontally then vertically, optionally mirroring them along the y-axis
+// first.
+
+void ViewTransformInit(VT *pvt, real theta, real phi, flag fReflect,
+  real rMirror)
+{
+  pvt->xpos = (real)ds.hormin;
+  pvt->ypos = (real)ds.vermin;
+  pvt->zpos = (real)ds.depmin;
+  pvt->rxScale = ds.rxScale;
+  pvt->ryScale = ds.ryScale;
+  pvt->rzScale = ds.rzScale;
+  RotateR2Init(pvt->rS, pvt->rC, theta);
+  if (phi != 0.0) {
+    RotateR2Init(pvt->rS2, pvt->rC2, phi);
+  } else {
+    pvt->rS2 = 0.0; pvt->rC2 = 1.0;
+  }
+  pvt->rSign = fReflect ? -1.0 : 1.0;
+  pvt->rMirror = fReflect ? rMirror : 0.0;
+}
+
+
+// Transform one point from world space to view space.
+
+INLINE void ViewTransform(CONST VT &vt, real x, real y, real z,
+  real *px, real *py, real *pz)
+{
+  real y2;
+
+  x = (x - vt.xpos)*vt.rxScale;
+  y = (vt.rMirror + vt.rSign*y - vt.ypos)*vt.ryScale;
+  z = (z - vt.zpos)*vt.rzScale;
+  *px = x*vt.rC - y*vt.rS;
+  y2 = y*vt.rC + x*vt.rS;
+  *py = y2*vt.rC2 - z*vt.rS2;
+  *pz = z*vt.rC2 + y2*vt.rS2;
+}
+
+
+// Transform vertices in a store from world space to view space. If rgivList
+// is NULL all vertices are transformed, in which case each axis being in its
+// own array and the loop having nothing in it but arithmetic lets the
+// compiler vectorize it. Otherwise just the vertices in the list are.
+
+void TransformVertices(CONST VS *pvs, CONST VT *pvt, CONST long *rgivList,
+  long civ, real *rgx, real *rgy, real *rgz)
+{
+  CONST real *rgxS = pvs->rgx, *rgyS = pvs->rgy, *rgzS = pvs->rgz;
+  CONST VT vt = *pvt;
+  long iv, i;
+
+  if (rgivList == NULL) {
+    for (iv = 0; iv < pvs->cv; iv++)
+      ViewTransform(vt, rgxS[iv], rgyS[iv], rgzS[iv],
+        &rgx[iv], &rgy[iv], &rgz[iv]);
+    return;
+  }
+  for (i = 0; i < civ; i++) {
+    iv = rgivList[i];
+    ViewTransform(vt, rgxS[iv], rgyS[iv], rgzS[iv],
+      &rgx[iv], &rgy[iv], &rgz[iv]);
+  }
+}
+
+
+// Figure out which items in a vertex store might be visible, by checking the
+// bounding box of each grid cell against the viewer, the maximum draw
+// distance if any, and if fScreen is set the edges of the screen. Store the
+// indexes of items in cells that weren't culled in rgiVis, in their original
+// order, and return how many there are.
+
+long CVertexCull(CONST VS *pvs, CONST VT *pvt, long *rgiVis, flag fScreen,
+  int xmax, int ymax)
+{
+  CONST real *pr;
+  real x, y, z, h, v, yMin = 0.0;
+  long ccell, icell, i, cVis = 0;
+  int k, cLeft, cRight, cUp, cDown;
+  flag fBehind, fFront;
+  byte *rgfCell;
+
+  ccell = (long)pvs->rgcCell[0] * pvs->rgcCell[1] * pvs->rgcCell[2];
+  rgfCell = RgAllocate(ccell, byte);
+  if (rgfCell == NULL)
+    return -1;
+  for (icell = 0; icell < ccell; icell++) {
+    rgfCell[icell] = fFalse;
+    pr = pvs->rgrBox + icell*6;
+    if (pr[0] > pr[3])
+      continue;
+    fBehind = fFront = fTrue;
+    cLeft = cRight = cUp = cDown = 0;
+    for (k = 0; k < 8; k++) {
+      ViewTransform(*pvt, pr[(k & 1) ? 3 : 0], pr[(k & 2) ? 4 : 1],
+        pr[(k & 4) ? 5 : 2], &x, &y, &z);
+      yMin = k == 0 ? y : Min(yMin, y);
+      if (y >= 0.0)
+        fBehind = fFalse;
+      if (y < 1.0) {
+        fFront = fFalse;
+        continue;
+      }
+
+      // Allow a pixel of slack, since corners are rounded to pixels.
+      h = (real)(xmax >> 1) + ds.rScale*x / y;
+      v = ds.rHoriz - ds.rScale*(z - (real)ymax + ds.rHoriz) / y;
+      cLeft += h < -1.0; cRight += h > (real)(xmax + 1);
+      cUp += v < -1.0; cDown += v > (real)(ymax + 1);
+    }
+    if (fBehind)
+      continue;
+    if (fScreen && fFront &&
+      (cLeft >= 8 || cRight >= 8 || cUp >= 8 || cDown >= 8))
+      continue;
+    if (ds.nDrawDistance > 0 && yMin / 10.0 > (real)ds.nDrawDistance)
+      continue;
+    rgfCell[icell] = fTrue;
+  }
+  for (i = 0; i < pvs->cSrc; i++)
+    if (rgfCell[pvs->rgicItem[i]])
+      rgiVis[cVis++] = i;
+  DeallocateP(rgfCell);
+  return cVis;
+}
+
+
+// Make a list of the vertices used by the given items in a vertex store,
+// with each vertex listed once no matter how many items share it. Returns
+// the number of vertices in the list.
+
+long CVertexGather(VS *pvs, CONST long *rgiVis, long cVis, int ccorner,
+  long *rgivList)
+{
+  long i, iv, civ = 0;
+  int k;
+
+  pvs->lStamp++;
+  for (i = 0; i < cVis; i++)
+    for (k = 0; k < ccorner; k++) {
+      iv = pvs->rgiv[rgiVis[i]*ccorner + k];
+      if (pvs->rglStamp[iv] != pvs->lStamp) {
+        pvs->rglStamp[iv] = pvs->lStamp;
+        rgivList[civ++] = iv;
+      }
+    }
+  return civ;
+}
+
+
 /*
 ******************************************************************************
 ** Render Perspective Wireframe
@@ -403,73 +745,67 @@ void PushdownWire(COOR *coor, long p, long size)
 
 flag FRenderPerspectiveWireCore(CMap &b, COOR *coor, long ccoor)
 {
+  CONST int rgofs[2] = {offsetof(COOR, x1), offsetof(COOR, x2)};
   COOR *coorT, coorSwap;
-  long ccoor2 = 0, ccoor3 = 0, i;
+  VS *pvs = &ds.vsWire;
+  VT vt;
+  long ccoor2 = 0, ccoor3 = 0, cVis, civ, i, iv1, iv2, *rgiVis, *rgivList;
   int xmax, ymax, x1, y1, x2, y2;
-  real xpos, ypos, zpos, yminCoor, ymaxCoor, theta, phi, rS, rC,
+  real rMirror = 0.0, theta, phi, *rgvx, *rgvy, *rgvz,
     rx1, ry1, rx2, ry2, rxmax, rymax, rDist, rUnit;
   flag fColor = b.FColor(), fSort = ds.fWireSort;
   KV kv;
 
   xmax = b.m_x; ymax = b.m_y; ds.xmax = xmax;
   rxmax = (real)xmax; rymax = (real)ymax;
-  xpos  = (real)ds.hormin;
-  ypos  = (real)ds.vermin;
-  zpos  = (real)ds.depmin;
   RenderGetAngle(&theta, &phi);
   ds.rHoriz = (real)((ymax >> 1) + ds.verv);
   rUnit = (real)ds.nWireDistance * ds.ryScale;
 
-  // Get starting set of coordinates.
+  // Get the shared vertices of the lines, skip over lines in grid cells that
+  // can't be seen, and rotate and adjust the rest of the vertices so viewing
+  // location is central, before copying them to each line.
 
+  if (!FVertexStoreBuild(pvs, coor, ccoor, sizeof(COOR), 2, rgofs, -1))
+    return fFalse;
   coorT = RgAllocate(Max(ccoor, 1), COOR);
-  if (coorT == NULL)
+  rgvx = RgAllocate(Max(pvs->cv, 1) * 3, real);
+  rgiVis = RgAllocate(Max(ccoor, 1) + Max(pvs->cv, 1), long);
+  if (coorT == NULL || rgvx == NULL || rgiVis == NULL) {
+    if (coorT != NULL)
+      DeallocateP(coorT);
+    if (rgvx != NULL)
+      DeallocateP(rgvx);
+    if (rgiVis != NULL)
+      DeallocateP(rgiVis);
     return fFalse;
-  for (i = 0; i < ccoor; i++)
-    coorT[i] = coor[i];
-  if (ds.fReflect && ccoor > 0) {
-    yminCoor = ymaxCoor = coorT[0].y1;
-    for (i = 0; i < ccoor; i++) {
-      yminCoor = Min(yminCoor, coorT[i].y1);
-      yminCoor = Min(yminCoor, coorT[i].y2);
-      ymaxCoor = Max(ymaxCoor, coorT[i].y1);
-      ymaxCoor = Max(ymaxCoor, coorT[i].y2);
-    }
-    for (i = 0; i < ccoor; i++) {
-      neg(coorT[i].y1);
-      neg(coorT[i].y2);
-    }
-    if (yminCoor >= 0)
-      for (i = 0; i < ccoor; i++) {
-        coorT[i].y1 += ymaxCoor + yminCoor;
-        coorT[i].y2 += ymaxCoor + yminCoor;
-      }
   }
-
-  // Rotate and adjust coordinates so viewing location is central.
-
-  RotateR2Init(rS, rC, theta);
-  for (i = 0; i < ccoor; i++) {
-    coorT[i].x1 = (coorT[i].x1 - xpos)*ds.rxScale;
-    coorT[i].y1 = (coorT[i].y1 - ypos)*ds.ryScale;
-    coorT[i].z1 = (coorT[i].z1 - zpos)*ds.rzScale;
-    RotateR2(&coorT[i].x1, &coorT[i].y1, rS, rC);
-    coorT[i].x2 = (coorT[i].x2 - xpos)*ds.rxScale;
-    coorT[i].y2 = (coorT[i].y2 - ypos)*ds.ryScale;
-    coorT[i].z2 = (coorT[i].z2 - zpos)*ds.rzScale;
-    RotateR2(&coorT[i].x2, &coorT[i].y2, rS, rC);
+  rgvy = rgvx + pvs->cv; rgvz = rgvy + pvs->cv;
+  rgivList = rgiVis + Max(ccoor, 1);
+  if (ds.fReflect && pvs->rgrMin[1] >= 0.0)
+    rMirror = pvs->rgrMin[1] + pvs->rgrMax[1];
+  ViewTransformInit(&vt, theta, phi, ds.fReflect, rMirror);
+  cVis = CVertexCull(pvs, &vt, rgiVis, fTrue, xmax, ymax);
+  if (cVis < 0) {
+    DeallocateP(coorT);
+    DeallocateP(rgvx);
+    DeallocateP(rgiVis);
+    return fFalse;
   }
-  if (phi != 0.0) {
-    RotateR2Init(rS, rC, phi);
-    for (i = 0; i < ccoor; i++) {
-      RotateR2(&coorT[i].y1, &coorT[i].z1, rS, rC);
-      RotateR2(&coorT[i].y2, &coorT[i].z2, rS, rC);
-    }
+  civ = CVertexGather(pvs, rgiVis, cVis, 2, rgivList);
+  TransformVertices(pvs, &vt, rgivList, civ, rgvx, rgvy, rgvz);
+  for (i = 0; i < cVis; i++) {
+    iv1 = pvs->rgiv[rgiVis[i]*2]; iv2 = pvs->rgiv[rgiVis[i]*2 + 1];
+    coorT[i].x1 = rgvx[iv1]; coorT[i].y1 = rgvy[iv1]; coorT[i].z1 = rgvz[iv1];
+    coorT[i].x2 = rgvx[iv2]; coorT[i].y2 = rgvy[iv2]; coorT[i].z2 = rgvz[iv2];
+    coorT[i].kv = coor[rgiVis[i]].kv;
   }
+  DeallocateP(rgvx);
+  DeallocateP(rgiVis);
 
   // Drop or adjust all coordinate pairs that are behind the viewer.
 
-  for (i = 0; i < ccoor; i++) {
+  for (i = 0; i < cVis; i++) {
     if (coorT[i].y1 >= 0.0 || coorT[i].y2 >= 0.0) {
       if (coorT[i].y1 < 0.0)
         IgnoreNegativeR(&coorT[i].x1, &coorT[i].y1, &coorT[i].z1,
@@ -574,9 +910,9 @@ flag FRenderPerspectiveWire(CMap &b, COOR *coor, long ccoor)
 // it, push the patch down through the tree until the heap condition is met
 // again. Called from FRenderPerspectivePatch() to implement heap sort.
 
-void PushdownPatch(PATCH *patch, long p, long size)
+void PushdownPatch(PATV *patch, long p, long size)
 {
-  PATCH patT;
+  PATV patT;
 
   while (p < size && (FComparePatch(patch[p >> 1], patch[p]) ||
     (p < size-1 && FComparePatch(patch[p >> 1], patch[p + 1])))) {
@@ -587,133 +923,452 @@ void PushdownPatch(PATCH *patch, long p, long size)
 }
 
 
+// Given the exact screen coordinates of the corners of a projected patch, and
+// the reciprocal depth at each, figure out the plane of reciprocal depth
+// across the patch, such that w = a*x + b*y + c at any pixel within it.
+// Reciprocal depth is linear across the screen even though depth itself
+// isn't. Called from ZFillPatch().
+
+void ZPlaneSetup(CONST real *rgh, CONST real *rgv, CONST real *rgw, int cpt,
+  real *pa, real *pb, real *pc)
+{
+  CONST int rgi[4][3] = {{0, 1, 2}, {0, 2, 3}, {0, 1, 3}, {1, 2, 3}};
+  int i, i0, i1, i2;
+  real d, dx1, dy1, dx2, dy2, dw1, dw2;
+
+  // Use the first three corners that aren't all in a line on the screen.
+  for (i = 0; i < (cpt >= 4 ? 4 : 1); i++) {
+    i0 = rgi[i][0]; i1 = rgi[i][1]; i2 = rgi[i][2];
+    dx1 = rgh[i1] - rgh[i0]; dy1 = rgv[i1] - rgv[i0];
+    dx2 = rgh[i2] - rgh[i0]; dy2 = rgv[i2] - rgv[i0];
+    d = dx1 * dy2 - dx2 * dy1;
+    if (RAbs(d) < rMinute)
+      continue;
+    dw1 = rgw[i1] - rgw[i0]; dw2 = rgw[i2] - rgw[i0];
+    *pa = (dw1 * dy2 - dw2 * dy1) / d;
+    *pb = (dx1 * dw2 - dx2 * dw1) / d;
+    *pc = rgw[i0] - *pa * rgh[i0] - *pb * rgv[i0];
+    return;
+  }
+
+  // A patch seen edge on covers almost no area, so just use its nearest depth.
+  *pa = *pb = 0.0;
+  *pc = rgw[0];
+  for (i = 1; i < cpt; i++)
+    *pc = Max(*pc, rgw[i]);
+}
+
+
+// Draw a projected patch on a bitmap, only drawing pixels that are closer
+// than what's already been drawn there, as recorded in a depth buffer of
+// reciprocal distances. Solid patches update the depth buffer, while
+// translucent patches blend with what's behind them. The patch is filled
+// using its corners rounded to pixels, but its depth comes from the exact
+// corners, so neighboring patches meet cleanly. Called from
+// FRenderPerspectivePatchCore() when fPatchZBuffer is set.
+
+void ZFillPatch(CMap &b, float *rgz, MM *xminmax, CONST int *rgx,
+  CONST int *rgy, CONST real *rgh, CONST real *rgv, CONST real *rgw, int cpt,
+  KV kv, int nTrans)
+{
+  real a, bb, c, w, wMin, wMax, rTrans = (real)nTrans / 10000.0;
+  float *pz;
+  int ymin, ymax, y, x, xmin, xmax, xRun, xT, i;
+  flag fColor = b.FColor(), fSolid = !fColor || rTrans <= 0.0;
+
+  ymin = ymax = rgy[0];
+  wMin = wMax = rgw[0];
+  for (i = 1; i < cpt; i++) {
+    ymin = Min(ymin, rgy[i]); ymax = Max(ymax, rgy[i]);
+    wMin = Min(wMin, rgw[i]); wMax = Max(wMax, rgw[i]);
+  }
+  ymin = Max(ymin, 0); ymax = Min(ymax, b.m_y - 1);
+  for (y = ymin; y <= ymax; y++) {
+    xminmax[y].min = xBitmap;
+    xminmax[y].max = -1;
+  }
+  for (i = 0; i < cpt; i++)
+    b.LineSetup(xminmax, rgx[i], rgy[i], rgx[(i + 1) % cpt],
+      rgy[(i + 1) % cpt]);
+  ZPlaneSetup(rgh, rgv, rgw, cpt, &a, &bb, &c);
+
+  // Each row is scanned for runs of pixels in front of what's there, where
+  // each run can be drawn with a single horizontal line.
+  for (y = ymin; y <= ymax; y++) {
+    xmin = Max(xminmax[y].min, 0);
+    xmax = Min(xminmax[y].max, b.m_x - 1);
+    pz = rgz + (long)y * b.m_x;
+    xRun = -1;
+    for (x = xmin; x <= xmax + 1; x++) {
+      if (x <= xmax) {
+        w = a * (real)x + bb * (real)y + c;
+        EnsureBetween(w, wMin, wMax);
+        if ((float)w > pz[x]) {
+          if (fSolid) {
+            pz[x] = (float)w;
+            if (xRun < 0)
+              xRun = x;
+          } else
+            b.Set(x, y, KvBlendR(kv, b.Get(x, y), rTrans));
+          continue;
+        }
+      }
+      if (xRun < 0)
+        continue;
+      if (fColor || (int)kv >= 0)
+        b.LineX(xRun, x - 1, y, kv);
+      else
+        for (xT = xRun; xT < x; xT++)
+          b.Set(xT, y, FDitherCore(-(int)kv, xT & 3, y & 3));
+      xRun = -1;
+    }
+  }
+}
+
+
+// Draw the edges of a projected patch on a bitmap, only drawing pixels that
+// aren't behind what's in the depth buffer. Since the edges lie on the border
+// between patches, each pixel is compared against the farthest depth around
+// it, so edges aren't hidden by the surfaces they border. Called from
+// FRenderPerspectivePatchCore() when fPatchZBuffer is set.
+
+void ZEdgePatch(CMap &b, CONST float *rgz, CONST int *rgx, CONST int *rgy,
+  CONST real *rgw, int grfLine, int cpt, KV kv)
+{
+  int i, j, x, y, dx, dy, xInc, yInc, xInc2, yInc2, d, dInc, z, zMax,
+    xT, yT;
+  real w;
+  float wMin;
+
+  for (i = 0; i < cpt; i++) {
+    if (!FOdd(grfLine >> i))
+      continue;
+    j = (i + 1) % cpt;
+    x = rgx[i]; y = rgy[i]; dx = rgx[j] - x; dy = rgy[j] - y;
+    if (NAbs(dx) >= NAbs(dy)) {
+      xInc = NSgn(dx); yInc = 0;
+      xInc2 = 0; yInc2 = NSgn(dy);
+      zMax = NAbs(dx); dInc = NAbs(dy);
+    } else {
+      xInc = 0; yInc = NSgn(dy);
+      xInc2 = NSgn(dx); yInc2 = 0;
+      zMax = NAbs(dy); dInc = NAbs(dx);
+    }
+    d = zMax >> 1;
+    for (z = 0; z <= zMax; z++) {
+      if (b.FLegal(x, y)) {
+        w = zMax > 0 ? rgw[i] + (rgw[j] - rgw[i]) * (real)z / (real)zMax :
+          Max(rgw[i], rgw[j]);
+        wMin = rgz[(lsize)y * b.m_x + x];
+        for (yT = Max(y-1, 0); yT <= Min(y+1, b.m_y-1); yT++)
+          for (xT = Max(x-1, 0); xT <= Min(x+1, b.m_x-1); xT++)
+            wMin = Min(wMin, rgz[(lsize)yT * b.m_x + xT]);
+        if ((float)(w * 1.001) >= wMin)
+          b.Set(x, y, kv);
+      }
+      x += xInc; y += yInc; d += dInc;
+      if (d >= zMax) {
+        x += xInc2; y += yInc2; d -= zMax;
+      }
+    }
+  }
+}
+
+
+// Clip a patch partly behind the viewer, so it only covers the part at least
+// one unit in front of the viewer, where projection onto the screen works,
+// like IgnoreNegativeR() does for lines. Corners where the patch edges cross
+// that plane are added to the end of the vertex arrays. A quadrilateral may
+// become a pentagon, in which case it's split into a quadrilateral and a
+// triangle stored in ppat2. A concave or self intersecting quadrilateral can
+// cross the plane four times, which is more than the two new vertices budgeted
+// per patch, so such patches are dropped. Returns the number of patches
+// remaining. Called from FRenderPerspectivePatchCore().
+
+int CClipPatchNear(PATV *ppat, PATV *ppat2, real *rgvx, real *rgvy,
+  real *rgvz, long *pcv)
+{
+  long rgiv[cPatch + 1], iv1, iv2;
+  int rgf[cPatch + 1], cpt = ppat->cpt, c = 0, k;
+  flag fIn1, fIn2;
+  real r;
+
+  for (k = 0; k < cpt; k++) {
+    iv1 = ppat->iv[k]; iv2 = ppat->iv[(k + 1) % cpt];
+    c += (rgvy[iv1] >= 1.0) != (rgvy[iv2] >= 1.0);
+  }
+  if (c > 2)
+    return 0;
+  c = 0;
+  for (k = 0; k < cpt; k++) {
+    iv1 = ppat->iv[k]; iv2 = ppat->iv[(k + 1) % cpt];
+    fIn1 = rgvy[iv1] >= 1.0; fIn2 = rgvy[iv2] >= 1.0;
+    if (fIn1) {
+      rgiv[c] = iv1; rgf[c++] = FPatvLine(*ppat, k);
+    }
+    if (fIn1 != fIn2) {
+      r = (1.0 - rgvy[iv1]) / (rgvy[iv2] - rgvy[iv1]);
+      rgvx[*pcv] = rgvx[iv1] + (rgvx[iv2] - rgvx[iv1]) * r;
+      rgvy[*pcv] = 1.0;
+      rgvz[*pcv] = rgvz[iv1] + (rgvz[iv2] - rgvz[iv1]) * r;
+      // The edge after a corner leaving the visible part runs along the
+      // clipping plane, so never has a line.
+      rgiv[c] = (*pcv)++; rgf[c++] = fIn1 ? fFalse : FPatvLine(*ppat, k);
+    }
+  }
+  if (c < 3)
+    return 0;
+  ppat->cpt = Min(c, cPatch);
+  ppat->grfLine = 0;
+  for (k = 0; k < cPatch; k++)
+    ppat->iv[k] = k < ppat->cpt ? rgiv[k] : rgiv[0];
+  for (k = 0; k < ppat->cpt; k++)
+    ppat->grfLine |= rgf[k] << k;
+  if (c <= cPatch)
+    return 1;
+
+  // The fourth edge of the quadrilateral is now the diagonal of the pentagon.
+  ppat->grfLine &= ~(1 << 3);
+  *ppat2 = *ppat;
+  ppat2->cpt = 3;
+  ppat2->iv[0] = ppat2->iv[3] = rgiv[0];
+  ppat2->iv[1] = rgiv[3]; ppat2->iv[2] = rgiv[4];
+  ppat2->grfLine = rgf[3] << 1 | rgf[4] << 2;
+  return 2;
+}
+
+
 // Draw a perspective scene composed of a set of triangular and quadrilateral
 // patches in 3D space. Implements the Render Wireframe Perspective command
 // for both monochrome and color bitmaps.
 
 flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
 {
-  PATCH *patchT, patT;
-  PATR patrT;
-  long cpatch2 = 0, cpatch3 = 0, count, i, j;
-  int x1, y1, x2, y2, x3, y3, x4, y4, cpt, xmax, ymax, k;
-  flag fSquare, fTouch, fTest;
-  KV kv;
+  CONST int rgofs[cPatch] = {offsetof(PATCH, p[0]), offsetof(PATCH, p[1]),
+    offsetof(PATCH, p[2]), offsetof(PATCH, p[3])};
+  PATV *patchT, patT;
+  VS *pvs = &ds.vsPatch;
+  VT vt;
+  long cpatch2 = 0, cpatch3 = 0, count, i, j, iSort = 0, iv, *piv,
+    *rgiVis = NULL, *rgivList, cVis, civ, ivl, cClip = 0, cvMax, cvClip,
+    iClip;
+  int x1, y1, x2, y2, x3, y3, x4, y4, cpt, xmax, ymax, k = 0, rgx[4], rgy[4],
+    *rgxs = NULL, *rgys;
+  real rgh[4], rgv[4], rgw[4], *rgvx = NULL, *rgvy, *rgvz, *rgvh = NULL,
+    *rgvv = NULL, *rgvw = NULL, *rgvT;
+  PATV *patchT2;
+  float *rgz = NULL;
+  MM *xminmax = NULL;
+  flag fSquare, fTouch, fTest, fBehind, fFront, fRet = fFalse;
+  KV kv = 0;
   CVector vLight, vEye, v;
-  real xpos, ypos, zpos, yminCoor, ymaxCoor, theta, phi, rS, rC, rT;
+  real theta, phi, rS, rC, rT;
   char sz[cchSzDef];
   flag fColor = b.FColor();
 
   xmax = b.m_x; ymax = b.m_y;
   ds.xmax = xmax;
-  xpos  = (real)ds.hormin;
-  ypos  = (real)ds.vermin;
-  zpos  = (real)ds.depmin;
   RenderGetAngle(&theta, &phi);
   ds.rHoriz = (real)((ymax >> 1) + ds.verv);
   vLight = ds.vLight;
 
-  // Get starting set of patches.
+  // Get the shared vertices of the patches, and skip over patches in grid
+  // cells that can't be seen. Touching up edges compares against patches
+  // that aren't drawn, so patches off the screen are only skipped otherwise.
 
-  patchT = RgAllocate(Max(cpatch, 1), PATCH);
-  if (patchT == NULL)
+  if (!FVertexStoreBuild(pvs, patch, cpatch, sizeof(PATCH), cPatch, rgofs,
+    offsetof(PATCH, cpt)))
     return fFalse;
-  for (i = 0; i < cpatch; i++)
-    patchT[i] = patch[i];
-
-  if (ds.fReflect) {
-    yminCoor = ymaxCoor = patchT[0].p[0].y;
-    for (i = 0; i < cpatch; i++)
-      for (k = patchT[i].cpt-1; k >= 0; k--) {
-        yminCoor = Min(yminCoor, patchT[i].p[k].y);
-        ymaxCoor = Max(ymaxCoor, patchT[i].p[k].y);
+  patchT = RgAllocate(Max(cpatch, 1), PATV);
+  rgvx = RgAllocate(Max(pvs->cv, 1) * 3, real);
+  rgiVis = RgAllocate(Max(cpatch, 1) + Max(pvs->cv, 1), long);
+  if (patchT == NULL || rgvx == NULL || rgiVis == NULL)
+    goto LDone;
+  rgvy = rgvx + pvs->cv; rgvz = rgvy + pvs->cv;
+  rgivList = rgiVis + Max(cpatch, 1);
+  fTouch = ds.fEdges && ds.fTouch;
+  ViewTransformInit(&vt, theta, phi, ds.fReflect,
+    pvs->rgrMin[1] + pvs->rgrMax[1]);
+  cVis = CVertexCull(pvs, &vt, rgiVis, !fTouch, xmax, ymax);
+  if (cVis < 0)
+    goto LDone;
+  civ = CVertexGather(pvs, rgiVis, cVis, cPatch, rgivList);
+
+  // Make a list of the remaining patches pointing into the vertices, in the
+  // order their corners will be drawn.
+
+  for (j = 0; j < cVis; j++) {
+    i = rgiVis[j];
+    piv = &pvs->rgiv[i * cPatch];
+    cpt = patch[i].cpt;
+    patchT[j].cpt = cpt;
+    patchT[j].kv = patch[i].kv;
+    patchT[j].nTrans = patch[i].nTrans;
+    patchT[j].grfLine = 0;
+    for (k = 0; k < cPatch; k++)
+      patchT[j].iv[k] = piv[0];
+    if (ds.fReflect) {
+      for (k = 0; k < cpt; k++) {
+        patchT[j].iv[k] = piv[k];
+        patchT[j].grfLine |= patch[i].p[k].fLine << k;
+      }
+    } else {
+      // Reverse the order of the corners, so patches face the other way.
+      for (k = 0; k < cpt; k++) {
+        patchT[j].iv[k] = piv[(cpt - k) % cpt];
+        patchT[j].grfLine |= patch[i].p[cpt-1 - k].fLine << k;
       }
-    for (i = 0; i < cpatch; i++) {
-      for (k = patchT[i].cpt-1; k >= 0; k--)
-        patchT[i].p[k].y = ymaxCoor + yminCoor - patchT[i].p[k].y;
-    }
-  } else {
-    for (i = 0; i < cpatch; i++) {
-      cpt = patchT[i].cpt-1;
-      patrT = patchT[i].p[1];
-      patchT[i].p[1] = patchT[i].p[cpt];
-      patchT[i].p[cpt] = patrT;
-      fTest = patchT[i].p[0].fLine;
-      for (k = 0; k < cpt; k++)
-        patchT[i].p[k].fLine = patchT[i].p[k + 1].fLine;
-      patchT[i].p[cpt].fLine = fTest;
     }
   }
-  fTouch = ds.fEdges && ds.fTouch;
 
-  // Rotate and adjust patches so viewing location is central.
+  // Rotate and adjust vertices so viewing location is central.
 
+  TransformVertices(pvs, &vt, rgivList, civ, rgvx, rgvy, rgvz);
   RotateR2Init(rS, rC, theta);
-  for (i = 0; i < cpatch; i++)
-    for (k = patchT[i].cpt-1; k >= 0; k--) {
-      patchT[i].p[k].x = (patchT[i].p[k].x - xpos)*ds.rxScale;
-      patchT[i].p[k].y = (patchT[i].p[k].y - ypos)*ds.ryScale;
-      patchT[i].p[k].z = (patchT[i].p[k].z - zpos)*ds.rzScale;
-      RotateR2(&patchT[i].p[k].x, &patchT[i].p[k].y, rS, rC);
-    }
   RotateR2(&vLight.m_x, &vLight.m_y, rS, rC);
   if (phi != 0.0) {
     RotateR2Init(rS, rC, phi);
-    for (i = 0; i < cpatch; i++)
-      for (k = patchT[i].cpt-1; k >= 0; k--)
-        RotateR2(&patchT[i].p[k].y, &patchT[i].p[k].z, rS, rC);
     RotateR2(&vLight.m_y, &vLight.m_z, rS, rC);
   }
 
-  // Drop all patches that are behind the viewer.
+  // When faces have been merged into large patches, patches partly behind the
+  // viewer are clipped instead of dropped, each of which may need two new
+  // vertices and one new patch, so make room for them. CClipPatchNear() drops
+  // any patch that would need more.
 
-  for (i = 0; i < cpatch; i++) {
+  for (i = 0; i < cVis && ds.fMergeFace; i++) {
+    piv = patchT[i].iv;
+    fBehind = fFront = fFalse;
+    for (k = patchT[i].cpt-1; k >= 0; k--) {
+      fBehind |= rgvy[piv[k]] < 0.0;
+      fFront |= rgvy[piv[k]] >= 1.0;
+    }
+    cClip += fBehind && fFront;
+  }
+  cvMax = pvs->cv + cClip*2;
+  if (cClip > 0) {
+    rgvT = RgAllocate(cvMax * 3, real);
+    patchT2 = (PATV *)ReallocateArray(patchT, (int)cVis, sizeof(PATV),
+      (int)(cVis + cClip));
+    if (rgvT == NULL || patchT2 == NULL) {
+      if (rgvT != NULL)
+        DeallocateP(rgvT);
+      if (patchT2 != NULL)
+        DeallocateP(patchT2);
+      goto LDone;
+    }
+    CopyPb(rgvx, rgvT, pvs->cv * sizeof(real));
+    CopyPb(rgvy, rgvT + cvMax, pvs->cv * sizeof(real));
+    CopyPb(rgvz, rgvT + cvMax*2, pvs->cv * sizeof(real));
+    DeallocateP(rgvx);
+    rgvx = rgvT; rgvy = rgvx + cvMax; rgvz = rgvy + cvMax;
+    DeallocateP(patchT);
+    patchT = patchT2;
+  }
+  rgxs = RgAllocate(Max(cvMax, 1) * 2, int);
+  if (rgxs == NULL)
+    goto LDone;
+  rgys = rgxs + cvMax;
+
+  // Drop all patches that are behind the viewer, and clip those partly
+  // behind, with any extra patches from clipping added to the end.
+
+  cvClip = pvs->cv;
+  iClip = cVis;
+  for (i = 0; i < cVis; i++) {
     cpt = patchT[i].cpt;
-    if (patchT[i].p[0].y < 0.0 || patchT[i].p[1].y < 0.0 ||
-      patchT[i].p[2].y < 0.0 || (cpt >= 3 && patchT[i].p[3].y < 0.0))
-      continue;
+    piv = patchT[i].iv;
+    j = 1;
+    if (rgvy[piv[0]] < 0.0 || rgvy[piv[1]] < 0.0 ||
+      rgvy[piv[2]] < 0.0 || (cpt >= 4 && rgvy[piv[3]] < 0.0)) {
+      if (cClip <= 0)
+        continue;
+      j = CClipPatchNear(&patchT[i], &patchT[iClip], rgvx, rgvy, rgvz,
+        &cvClip);
+      if (j <= 0)
+        continue;
+      cpt = patchT[i].cpt;
+    }
 
     // Drop patches facing away from the viewer.
     if (!ds.fRight) {
-      v.Normal(patchT[i].p[0].x, patchT[i].p[0].y, patchT[i].p[0].z,
-        patchT[i].p[1].x, patchT[i].p[1].y, patchT[i].p[1].z,
-        patchT[i].p[2].x, patchT[i].p[2].y, patchT[i].p[2].z);
-      vEye.Set(patchT[i].p[0].x, patchT[i].p[0].y, patchT[i].p[0].z);
+      v.Normal(rgvx[piv[0]], rgvy[piv[0]], rgvz[piv[0]],
+        rgvx[piv[1]], rgvy[piv[1]], rgvz[piv[1]],
+        rgvx[piv[2]], rgvy[piv[2]], rgvz[piv[2]]);
+      vEye.Set(rgvx[piv[0]], rgvy[piv[0]], rgvz[piv[0]]);
       if (vEye.Dot(v) > 0.0)
         continue;
     }
-    patchT[cpatch2] = patchT[i];
-    for (k = 0; k < cpt; k++)
-      patchT[cpatch2].p[k].z =
-        patchT[i].p[k].z - (real)ymax + ds.rHoriz;
-    cpatch2++;
+    patchT[cpatch2++] = patchT[i];
     if (cpt <= 3)
       cpatch3++;
+    iClip += j - 1;
+  }
+  for (i = cVis; i < iClip; i++) {
+    patchT[cpatch2++] = patchT[i];
+    cpatch3++;
   }
   sprintf(S(sz),
     "Visible number of patches: %ld (%ld triangle, %ld square)\n",
     cpatch2, cpatch3, cpatch2 - cpatch3);
   PrintSz(sz);
 
+  // Project each vertex onto the screen once, no matter how many patches
+  // share it.
+
+  for (ivl = 0; ivl < civ + cvClip - pvs->cv; ivl++) {
+    iv = ivl < civ ? rgivList[ivl] : pvs->cv + ivl - civ;
+    rgvz[iv] = rgvz[iv] - (real)ymax + ds.rHoriz;
+    CalculateCoordinate(&rgxs[iv], &rgys[iv], rgvx[iv], rgvy[iv], rgvz[iv]);
+  }
+
+  // With a depth buffer, solid patches can be drawn in any order, so only
+  // translucent patches need to be sorted, and drawn after all solid ones.
+
+  if (ds.fZBuffer && !fTouch) {
+    rgz = RgAllocate((long)xmax * ymax, float);
+    xminmax = RgAllocate(ymax, MM);
+    rgvh = RgAllocate(Max(cvMax, 1) * 3, real);
+    if (rgz == NULL || xminmax == NULL || rgvh == NULL)
+      goto LDone;
+    ClearPb(rgz, (long)xmax * ymax * sizeof(float));
+    rgvv = rgvh + cvMax; rgvw = rgvv + cvMax;
+    for (ivl = 0; ivl < civ + cvClip - pvs->cv; ivl++) {
+      iv = ivl < civ ? rgivList[ivl] : pvs->cv + ivl - civ;
+      CalculateCoordinateR(&rgvh[iv], &rgvv[iv],
+        rgvx[iv], rgvy[iv], rgvz[iv]);
+      rgvw[iv] = 1.0 / Max(rgvy[iv], 1.0);
+    }
+    iSort = cpatch2;
+    if (fColor)
+      for (i = cpatch2 - 1; i >= 0; i--)
+        if (patchT[i].nTrans > 0) {
+          iSort--;
+          patT = patchT[i]; patchT[i] = patchT[iSort]; patchT[iSort] = patT;
+        }
+  }
+
   // Sort patches in order from farthest away to closest.
 
-  for (i = 0; i < cpatch2; i++) {
+  for (i = iSort; i < cpatch2; i++) {
     // Calculate the distance of the center of the patch from viewing plane.
     rT = 0.0;
-    for (j = patchT[i].cpt-1; j >= 0; j--)
-      rT += Sq(patchT[i].p[j].y) + Sq(patchT[i].p[j].z) +
-        Sq(patchT[i].p[j].x);
+    for (j = patchT[i].cpt-1; j >= 0; j--) {
+      iv = patchT[i].iv[j];
+      rT += Sq(rgvy[iv]) + Sq(rgvz[iv]) + Sq(rgvx[iv]);
+    }
     patchT[i].rDistance = rT / patchT[i].cpt;
   }
   // Heap sort the list of patches.
-  for (i = (cpatch2 - 1) >> 1; i >= 0; i--)
-    PushdownPatch(patchT, i << 1, cpatch2);
-  for (i = cpatch2 - 1; i > 0; i--) {
-    patT = patchT[i]; patchT[i] = patchT[0]; patchT[0] = patT;
-    PushdownPatch(patchT, 0, i);
+  for (i = (cpatch2 - iSort - 1) >> 1; i >= 0; i--)
+    PushdownPatch(patchT + iSort, i << 1, cpatch2 - iSort);
+  for (i = cpatch2 - iSort - 1; i > 0; i--) {
+    patT = patchT[iSort + i]; patchT[iSort + i] = patchT[iSort];
+    patchT[iSort] = patT;
+    PushdownPatch(patchT + iSort, 0, i);
   }
 #ifdef DEBUG
-  for (i = 1; i < cpatch2; i++)
+  for (i = iSort + 1; i < cpatch2; i++)
     if (FComparePatch(patchT[i], patchT[i - 1])) {
       PrintSzN_E("Patch %d was sorted incorrectly.\n", i);
       break;
@@ -726,15 +1381,12 @@ flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
   count = cpatch3 = 0;
   for (i = 0; i < cpatch2; i++) {
     fSquare = patchT[i].cpt >= 4;
-    CalculateCoordinate(&x1, &y1,
-      patchT[i].p[0].x, patchT[i].p[0].y, patchT[i].p[0].z);
-    CalculateCoordinate(&x2, &y2,
-      patchT[i].p[1].x, patchT[i].p[1].y, patchT[i].p[1].z);
-    CalculateCoordinate(&x3, &y3,
-      patchT[i].p[2].x, patchT[i].p[2].y, patchT[i].p[2].z);
+    piv = patchT[i].iv;
+    x1 = rgxs[piv[0]]; y1 = rgys[piv[0]];
+    x2 = rgxs[piv[1]]; y2 = rgys[piv[1]];
+    x3 = rgxs[piv[2]]; y3 = rgys[piv[2]];
     if (fSquare) {
-      CalculateCoordinate(&x4, &y4,
-        patchT[i].p[3].x, patchT[i].p[3].y, patchT[i].p[3].z);
+      x4 = rgxs[piv[3]]; y4 = rgys[piv[3]];
     } else {
       x4 = x1; y4 = y1;
     }
@@ -745,9 +1397,9 @@ flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
 
       // Figure out the color of this patch based on the light vector.
       if (ds.fShading) {
-        v.Normal(patchT[i].p[0].x, patchT[i].p[0].y, patchT[i].p[0].z,
-          patchT[i].p[1].x, patchT[i].p[1].y, patchT[i].p[1].z,
-          patchT[i].p[2].x, patchT[i].p[2].y, patchT[i].p[2].z);
+        v.Normal(rgvx[piv[0]], rgvy[piv[0]], rgvz[piv[0]],
+          rgvx[piv[1]], rgvy[piv[1]], rgvz[piv[1]],
+          rgvx[piv[2]], rgvy[piv[2]], rgvz[piv[2]]);
         if (!fColor)
           k = -(int)(vLight.Angle(v) / rPi * 16.99);
         else
@@ -759,25 +1411,39 @@ flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
         else
           kv = patchT[i].kv;
       }
+      if (rgz != NULL) {
+        rgx[0] = x1; rgy[0] = y1; rgx[1] = x2; rgy[1] = y2;
+        rgx[2] = x3; rgy[2] = y3; rgx[3] = x4; rgy[3] = y4;
+        for (j = patchT[i].cpt-1; j >= 0; j--) {
+          rgh[j] = rgvh[piv[j]]; rgv[j] = rgvv[piv[j]];
+          rgw[j] = rgvw[piv[j]];
+        }
+      }
       if (!fColor) {
 
         // Draw a monochrome patch.
-        if (fSquare)
+        if (rgz != NULL)
+          ZFillPatch(b, rgz, xminmax, rgx, rgy, rgh, rgv, rgw,
+            patchT[i].cpt, k, 0);
+        else if (fSquare)
           b.FQuadrilateral(x1, y1, x2, y2, x3, y3, x4, y4, k, 0);
         else
           b.FTriangle(x1, y1, x2, y2, x3, y3, k, 0);
-        if (ds.fEdges) {
-          if (patchT[i].p[0].fLine)
+        if (ds.fEdges && rgz != NULL)
+          ZEdgePatch(b, rgz, rgx, rgy, rgw, patchT[i].grfLine,
+            patchT[i].cpt, fOff);
+        else if (ds.fEdges) {
+          if (FPatvLine(patchT[i], 0))
             b.Line(x1, y1, x2, y2, fOff);
-          if (patchT[i].p[1].fLine)
+          if (FPatvLine(patchT[i], 1))
             b.Line(x2, y2, x3, y3, fOff);
           if (fSquare) {
-            if (patchT[i].p[2].fLine)
+            if (FPatvLine(patchT[i], 2))
               b.Line(x3, y3, x4, y4, fOff);
-            if (patchT[i].p[3].fLine)
+            if (FPatvLine(patchT[i], 3))
               b.Line(x4, y4, x1, y1, fOff);
           } else
-            if (patchT[i].p[2].fLine)
+            if (FPatvLine(patchT[i], 2))
               b.Line(x3, y3, x1, y1, fOff);
         }
       } else {
@@ -786,41 +1452,40 @@ flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
         if (ds.nFog > 0) {
           rT = 0.0;
           for (k = patchT[i].cpt-1; k >= 0; k--)
-            rT += patchT[i].p[k].y;
+            rT += rgvy[piv[k]];
           rT = rT / patchT[i].cpt / 10.0 / (real)ds.nFog;
           kv = KvBlendR(kv, ds.kvTrim, Min(rT, 1.0));
         }
-        if (fSquare)
+        if (rgz != NULL)
+          ZFillPatch(b, rgz, xminmax, rgx, rgy, rgh, rgv, rgw,
+            patchT[i].cpt, kv, patchT[i].nTrans);
+        else if (fSquare)
           b.FQuadrilateral(x1, y1, x2, y2, x3, y3, x4, y4,
             kv, patchT[i].nTrans);
         else
           b.FTriangle(x1, y1, x2, y2, x3, y3, kv, patchT[i].nTrans);
-        if (ds.fEdges) {
-          if (patchT[i].p[0].fLine)
+        if (ds.fEdges && rgz != NULL)
+          ZEdgePatch(b, rgz, rgx, rgy, rgw, patchT[i].grfLine,
+            patchT[i].cpt, ds.kvTrim);
+        else if (ds.fEdges) {
+          if (FPatvLine(patchT[i], 0))
             b.Line(x1, y1, x2, y2, ds.kvTrim);
-          if (patchT[i].p[1].fLine)
+          if (FPatvLine(patchT[i], 1))
             b.Line(x2, y2, x3, y3, ds.kvTrim);
           if (fSquare) {
-            if (patchT[i].p[2].fLine)
+            if (FPatvLine(patchT[i], 2))
               b.Line(x3, y3, x4, y4, ds.kvTrim);
-            if (patchT[i].p[3].fLine)
+            if (FPatvLine(patchT[i], 3))
               b.Line(x4, y4, x1, y1, ds.kvTrim);
           } else
-            if (patchT[i].p[2].fLine)
+            if (FPatvLine(patchT[i], 2))
               b.Line(x3, y3, x1, y1, ds.kvTrim);
         }
       }
-      if (fTouch) {
-        patchT[i].p[0].x = (real)x1; patchT[i].p[0].y = (real)y1;
-        patchT[i].p[1].x = (real)x2; patchT[i].p[1].y = (real)y2;
-        patchT[i].p[2].x = (real)x3; patchT[i].p[2].y = (real)y3;
-        patchT[i].p[3].x = (real)x4; patchT[i].p[3].y = (real)y4;
-      }
       count++;
       cpatch3 += !fSquare;
     } else if (fTouch)
-      for (k = 0; k < 4; k++)
-        patchT[i].p[k].fLine = fFalse;
+      patchT[i].grfLine = 0;
   }
   sprintf(S(sz), "Drawn number of patches: %ld (%ld triangle, %ld square)\n",
     count, cpatch3, count - cpatch3); PrintSz(sz);
@@ -828,54 +1493,70 @@ flag FRenderPerspectivePatchCore(CMap &b, PATCH *patch, long cpatch)
   // Touch up edges on the screen. Very slow, but helps avoid blemishes formed
   // by later patches that slightly overlap edges of earlier patches.
 
+#define XTouch(i, k) rgxs[patchT[i].iv[k]]
+#define YTouch(i, k) rgys[patchT[i].iv[k]]
   if (fTouch) {
     for (j = 0; j < cpatch2 - 1; j++) {
       cpt = patchT[j].cpt;
       for (k = 0; k < cpt; k++)
         for (i = j + 1; i < cpatch2; i++)
-          if (patchT[j].p[k].fLine) {
+          if (FPatvLine(patchT[j], k)) {
             fTouch = fTrue;
             for (count = 0; count < 4; count++)
               fTouch = fTouch &&
-                patchT[j].p[k].x <= patchT[i].p[count].x &&
-                patchT[j].p[(k + 1) % cpt].x <= patchT[i].p[count].x;
+                XTouch(j, k) <= XTouch(i, count) &&
+                XTouch(j, (k + 1) % cpt) <= XTouch(i, count);
             fTest = fTouch;
             fTouch = fTrue;
             for (count = 0; count < 4; count++)
               fTouch = fTouch &&
-                patchT[j].p[k].y <= patchT[i].p[count].y &&
-                patchT[j].p[(k + 1) % cpt].y <= patchT[i].p[count].y;
+                YTouch(j, k) <= YTouch(i, count) &&
+                YTouch(j, (k + 1) % cpt) <= YTouch(i, count);
             fTest = fTest || fTouch;
             fTouch = fTrue;
             for (count = 0; count < 4; count++)
               fTouch = fTouch &&
-                patchT[j].p[k].x >= patchT[i].p[count].x &&
-                patchT[j].p[(k + 1) % cpt].x >= patchT[i].p[count].x;
+                XTouch(j, k) >= XTouch(i, count) &&
+                XTouch(j, (k + 1) % cpt) >= XTouch(i, count);
             fTest = fTest || fTouch;
             fTouch = fTrue;
             for (count = 0; count < 4; count++)
               fTouch = fTouch &&
-                patchT[j].p[k].y >= patchT[i].p[count].y &&
-                patchT[j].p[(k + 1) % cpt].y >= patchT[i].p[count].y;
-            patchT[j].p[k].fLine = fTest || fTouch;
+                YTouch(j, k) >= YTouch(i, count) &&
+                YTouch(j, (k + 1) % cpt) >= YTouch(i, count);
+            if (!(fTest || fTouch))
+              patchT[j].grfLine &= ~(1 << k);
           }
     }
     for (i = 0; i < cpatch2; i++) {
       cpt = patchT[i].cpt;
       for (k = 0; k < cpt; k++)
-        if (patchT[i].p[k].fLine) {
-          x1 = (int)patchT[i].p[k].x;
-          y1 = (int)patchT[i].p[k].y;
-          x2 = (int)patchT[i].p[(k + 1) % cpt].x;
-          y2 = (int)patchT[i].p[(k + 1) % cpt].y;
-          b.Line(x1, y1, x2, y2, !fColor ? fOff : ds.kvTrim);
-        }
+        if (FPatvLine(patchT[i], k))
+          b.Line(XTouch(i, k), YTouch(i, k), XTouch(i, (k + 1) % cpt),
+            YTouch(i, (k + 1) % cpt), !fColor ? fOff : ds.kvTrim);
     }
   }
+#undef XTouch
+#undef YTouch
 
   RenderFinalize(b);
-  DeallocateP(patchT);
-  return fTrue;
+  fRet = fTrue;
+LDone:
+  if (rgiVis != NULL)
+    DeallocateP(rgiVis);
+  if (rgvh != NULL)
+    DeallocateP(rgvh);
+  if (xminmax != NULL)
+    DeallocateP(xminmax);
+  if (rgz != NULL)
+    DeallocateP(rgz);
+  if (rgxs != NULL)
+    DeallocateP(rgxs);
+  if (rgvx != NULL)
+    DeallocateP(rgvx);
+  if (patchT != NULL)
+    DeallocateP(patchT);
+  return fRet;
 }
 
 
@@ -983,6 +1664,7 @@ long ConvertPatchToWire(COOR **pcoor, CONST PATCH *patch, long cpatch)
   if (*pcoor != NULL)
     DeallocateP(*pcoor);
   *pcoor = coor;
+  VertexStoreFree(&ds.vsWire);
   for (i = 0; i < cpatch; i++) {
     if (patch[i].p[0].fLine) {
       coor[count].x1 = patch[i].p[0].x;
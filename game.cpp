@@ -291,6 +291,7 @@ flag FHungerGame(int nInput)
         bm.b2.Set0(x, y);
         ws.rgbMask[bmpLit].Set1(x, y);
       }
+    ws.lTextureGen++;
     return fTrue;
   }
 
@@ -28,6 +28,7 @@
 */
 
 #include <stdio.h>
+#include <memory.h>
 #include <math.h>
 #include "util.h"
 #include "graphics.h"
@@ -321,7 +322,9 @@ GS gs = {
   // Display settings
   fFalse, fTrue, NULL,
   // Macro accessible only settings
-  0, 0, 1, 0, fOn, fTrue, fFalse, 0x1F3, 0x008};
+  0, 0, 1, 0, fOn, fTrue, fFalse, 0x1F3, 0x008, 0, 256, fFalse, 256,
+  // Internal settings
+  0, fFalse, {{0, 0, 0, 0}}, NULL, NULL, 0, 0, NULL, 0, 0, 0};
 
 
 /*
@@ -330,11 +333,77 @@ GS gs = {
 ******************************************************************************
 */
 
+// Note that a rectangle within the visible bitmap has changed, so the screen
+// can be updated by copying just the changed areas instead of everything.
+// Touching rectangles are merged, and once the list is full each new one is
+// merged into whichever existing rectangle would grow the least.
+
+void DirtyRect(int x1, int y1, int x2, int y2)
+{
+  DIRTY *pd, dT;
+  real rGrow, rBest;
+  int i, iBest;
+
+  if (gs.fDirtyAll || gs.bFocus == NULL)
+    return;
+  SortN(&x1, &x2);
+  SortN(&y1, &y2);
+  x1 = Max(x1, 0); y1 = Max(y1, 0);
+  x2 = Min(x2, gs.bFocus->m_x-1); y2 = Min(y2, gs.bFocus->m_y-1);
+  if (x1 > x2 || y1 > y2)
+    return;
+
+  // Fast case: Consecutive edits are usually within the same small area.
+  if (gs.cDirty > 0) {
+    pd = &gs.rgDirty[gs.cDirty-1];
+    if (x1 >= pd->x1 && y1 >= pd->y1 && x2 <= pd->x2 && y2 <= pd->y2)
+      return;
+  }
+
+  // Look for a rectangle that overlaps or touches this one.
+  iBest = -1; rBest = 0.0;
+  for (i = 0; i < gs.cDirty; i++) {
+    pd = &gs.rgDirty[i];
+    if (x1 <= pd->x2+1 && x2 >= pd->x1-1 && y1 <= pd->y2+1 && y2 >= pd->y1-1)
+      break;
+    rGrow = (real)(Max(x2, pd->x2) - Min(x1, pd->x1) + 1) *
+      (real)(Max(y2, pd->y2) - Min(y1, pd->y1) + 1) -
+      (real)(pd->x2 - pd->x1 + 1) * (real)(pd->y2 - pd->y1 + 1);
+    if (iBest < 0 || rGrow < rBest) {
+      rBest = rGrow; iBest = i;
+    }
+  }
+  if (i < gs.cDirty)
+    iBest = i;
+  else if (gs.cDirty < cDirtyMax) {
+    pd = &gs.rgDirty[gs.cDirty++];
+    pd->x1 = x1; pd->y1 = y1; pd->x2 = x2; pd->y2 = y2;
+    return;
+  }
+
+  // Merge into the chosen rectangle, and move it to the end of the list so
+  // the fast case above will check it first.
+  pd = &gs.rgDirty[iBest];
+  pd->x1 = Min(pd->x1, x1); pd->y1 = Min(pd->y1, y1);
+  pd->x2 = Max(pd->x2, x2); pd->y2 = Max(pd->y2, y2);
+  dT = *pd; *pd = gs.rgDirty[gs.cDirty-1]; gs.rgDirty[gs.cDirty-1] = dT;
+}
+
+
+// Forget all changed areas, after the screen has been brought up to date.
+
+void DirtyClear()
+{
+  gs.cDirty = 0;
+  gs.fDirtyAll = fFalse;
+}
+
+
 // Allocate a new bitmap of a given size.
 
 flag CMon::FAllocate(int x, int y, CONST CMap *pbOld)
 {
-  long cb;
+  lsize cb;
 
   if (x < 0 || y < 0 || x > xBitmap || y > yBitmap) {
     PrintSzNN_E("Can't create bitmap larger than %d by %d!\n",
@@ -361,6 +430,7 @@ flag CMon::FAllocate(int x, int y, CONST CMap *pbOld)
     m_x3 = wClient1Def; m_y3 = wClient2Def;
     m_z3 = wClient3Def; m_w3 = wClient4Def;
   }
+  DirtyAll();
   return fTrue;
 }
 
@@ -371,6 +441,8 @@ void CMon::Set0(int x, int y)
 {
   if (!FLegal(x, y))
     return;
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, fOff);
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, fOff, ~0);
   *_Pl(x, y) &= ~Lf(x);
@@ -383,6 +455,8 @@ void CMon::Set1(int x, int y)
 {
   if (!FLegal(x, y))
     return;
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, fOn);
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, fOn, ~0);
   *_Pl(x, y) |= Lf(x);
@@ -395,6 +469,8 @@ void CMon::Inv(int x, int y)
 {
   if (!FLegal(x, y))
     return;
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, !_Get(x, y));
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, !_Get(x, y), ~0);
   *_Pl(x, y) ^= Lf(x);
@@ -419,6 +495,8 @@ void CMon::Set(int x, int y, KV kv)
 {
   if (!FLegal(x, y))
     return;
+  Dirty(x, y, x, y);
+  Rec(recDot, x, y, x, y, kv != 0);
   if (gs.fTraceDot && FVisible())
     ScreenDot(x, y, kv, ~0);
   if (kv)
@@ -460,6 +538,264 @@ void CMap::Legalize2(int *x, int *y) CONST
 }
 
 
+/*
+******************************************************************************
+** Bitmap Recording
+******************************************************************************
+*/
+
+// Start recording all edits made to a bitmap into a timeline, replacing any
+// timeline recorded earlier. The current state of the bitmap is kept as the
+// first keyframe, which playback starts from.
+
+flag FRecordBegin(CMap &b)
+{
+  RecordFree();
+  gs.bRecord = &b;
+  RecordKey();
+  return gs.bRecord != NULL;
+}
+
+
+// Stop recording edits, keeping the timeline recorded so far.
+
+void RecordEnd()
+{
+  gs.bRecord = NULL;
+}
+
+
+// Free the recorded timeline and all its keyframes.
+
+void RecordFree()
+{
+  int i;
+
+  gs.bRecord = NULL;
+  for (i = 0; i < gs.ckey; i++)
+    gs.rgbKey[i]->Destroy();
+  if (gs.rgbKey != NULL) {
+    DeallocateP(gs.rgbKey);
+    gs.rgbKey = NULL;
+  }
+  if (gs.rgrec != NULL) {
+    DeallocateP(gs.rgrec);
+    gs.rgrec = NULL;
+  }
+  gs.crec = gs.crecMax = 0;
+  gs.ckey = gs.ckeyMax = 0;
+  gs.cbKey = 0;
+}
+
+
+// Append an edit of the bitmap being recorded to the timeline. Single pixels
+// take one entry, while blocks and lines take a second entry for their other
+// endpoint. If memory runs out, recording stops with what was captured.
+
+void RecordEvent(int nType, int x1, int y1, int x2, int y2, KV kv)
+{
+  REC *prec, *rgrecNew;
+  long crecNew;
+
+  if (nType == recBlock || nType == recLine) {
+    if (nType == recBlock && (x1 > x2 || y1 > y2))
+      return;
+    if (x1 == x2 && y1 == y2)
+      nType = recDot;
+  }
+  if (gs.crec + 2 > gs.crecMax) {
+    crecNew = Max(gs.crecMax << 1, 4096);
+    rgrecNew = RgAllocate(crecNew, REC);
+    if (rgrecNew == NULL) {
+      PrintSz_W("Recording stopped due to running out of memory.\n");
+      gs.bRecord = NULL;
+      return;
+    }
+    if (gs.rgrec != NULL) {
+      CopyRgb((char *)gs.rgrec, (char *)rgrecNew, gs.crec * sizeof(REC));
+      DeallocateP(gs.rgrec);
+    }
+    gs.rgrec = rgrecNew;
+    gs.crecMax = crecNew;
+  }
+  prec = &gs.rgrec[gs.crec++];
+  prec->x = x1; prec->y = y1;
+  prec->kv = ((dword)kv & 0xFFFFFF) | ((dword)nType << 24);
+  if (nType == recBlock || nType == recLine) {
+    prec = &gs.rgrec[gs.crec++];
+    prec->x = x2; prec->y = y2; prec->kv = 0;
+  }
+}
+
+
+// Add a bitmap to the list of keyframes, returning its index. If memory runs
+// out or the keyframes would take more than nRecordMemory megabytes, the
+// bitmap is freed, recording stops, and -1 is returned.
+
+int IRecordKeyAdd(CMap *bKey)
+{
+  CMap **rgbNew;
+  lsize cb = (lsize)bKey->m_clRow * 4 * bKey->m_y;
+  int ckeyNew;
+
+  if (gs.cbKey + cb > ((lsize)gs.nRecordMem << 20)) {
+    PrintSz_W("Recording stopped due to keyframes reaching nRecordMemory.\n");
+    goto LExit;
+  }
+  if (gs.ckey >= gs.ckeyMax) {
+    ckeyNew = Max(gs.ckeyMax << 1, 16);
+    rgbNew = RgAllocate(ckeyNew, CMap *);
+    if (rgbNew == NULL) {
+      PrintSz_W("Recording stopped due to running out of memory.\n");
+      goto LExit;
+    }
+    if (gs.rgbKey != NULL) {
+      CopyRgb((char *)gs.rgbKey, (char *)rgbNew, gs.ckey * sizeof(CMap *));
+      DeallocateP(gs.rgbKey);
+    }
+    gs.rgbKey = rgbNew;
+    gs.ckeyMax = ckeyNew;
+  }
+  gs.rgbKey[gs.ckey] = bKey;
+  gs.cbKey += cb;
+  return gs.ckey++;
+
+LExit:
+  bKey->Destroy();
+  return -1;
+}
+
+
+// Save a copy of the bitmap being recorded as a keyframe. This is done for
+// edits that change the whole bitmap at once, which can't be stored as a
+// list of pixel events. Consecutive keyframes are merged together, except
+// for the first one which playback starts from.
+
+void RecordKey()
+{
+  CMap *b = gs.bRecord, *bKey;
+  REC *prec;
+  int ikey;
+
+  gs.bRecord = NULL;
+  prec = gs.crec > 1 ? &gs.rgrec[gs.crec-1] : NULL;
+  if (prec != NULL && (prec->kv >> 24) == recKey) {
+    bKey = gs.rgbKey[prec->x];
+    gs.cbKey -= (lsize)bKey->m_clRow * 4 * bKey->m_y;
+    if (!bKey->FBitmapCopy(*b))
+      goto LExit;
+    gs.cbKey += (lsize)bKey->m_clRow * 4 * bKey->m_y;
+    gs.bRecord = b;
+    return;
+  }
+
+  bKey = b->Create();
+  if (bKey == NULL)
+    goto LExit;
+  if (!bKey->FBitmapCopy(*b)) {
+    bKey->Destroy();
+    goto LExit;
+  }
+  ikey = IRecordKeyAdd(bKey);
+  if (ikey < 0)
+    return;
+  gs.bRecord = b;
+  RecordEvent(recKey, ikey, 0, 0, 0, 0);
+  return;
+
+LExit:
+  PrintSz_W("Recording stopped due to running out of memory.\n");
+}
+
+
+// Save a copy of a rectangle of the bitmap being recorded as a patch
+// keyframe. This is done for block moves, which change too many pixels to
+// store as pixel events, but usually much less than the whole bitmap. A
+// patch right after a keyframe, or over the same rectangle as the patch
+// before it, is merged into that keyframe instead of taking more memory.
+
+void RecordPatch(int x1, int y1, int x2, int y2)
+{
+  CMap *b = gs.bRecord, *bKey;
+  REC *prec;
+  int ikey;
+
+  gs.bRecord = NULL;
+  prec = gs.crec > 1 ? &gs.rgrec[gs.crec-1] : NULL;
+  if (prec != NULL && (prec->kv >> 24) == recKey) {
+    gs.rgbKey[prec->x]->BlockMove(*b, x1, y1, x2, y2, x1, y1);
+    gs.bRecord = b;
+    return;
+  }
+  if (prec != NULL && (prec->kv >> 24) == recPatch &&
+    prec->x == x1 && prec->y == y1) {
+    bKey = gs.rgbKey[prec->kv & 0xFFFFFF];
+    if (bKey->m_x == x2-x1+1 && bKey->m_y == y2-y1+1) {
+      bKey->BlockMove(*b, x1, y1, x2, y2, 0, 0);
+      gs.bRecord = b;
+      return;
+    }
+  }
+
+  bKey = b->Create();
+  if (bKey == NULL)
+    goto LExit;
+  if (!bKey->FBitmapSizeSet(x2-x1+1, y2-y1+1)) {
+    bKey->Destroy();
+    goto LExit;
+  }
+  bKey->BlockMove(*b, x1, y1, x2, y2, 0, 0);
+  ikey = IRecordKeyAdd(bKey);
+  if (ikey < 0)
+    return;
+  gs.bRecord = b;
+  RecordEvent(recPatch, x1, y1, 0, 0, ikey);
+  return;
+
+LExit:
+  PrintSz_W("Recording stopped due to running out of memory.\n");
+}
+
+
+// Replay recorded edits from the timeline onto a bitmap, starting with the
+// given event and stopping once the target event is reached. Returns the
+// index of the next event that still needs to be applied.
+
+long RecordApply(CMap &b, long irec, long irecMax)
+{
+  CONST REC *prec;
+  KV kv;
+
+  Assert(gs.bRecord != &b);
+  irecMax = Min(irecMax, gs.crec);
+  while (irec < irecMax) {
+    prec = &gs.rgrec[irec++];
+    kv = prec->kv & 0xFFFFFF;
+    switch (prec->kv >> 24) {
+    case recDot:
+      b.Set(prec->x, prec->y, kv);
+      break;
+    case recBlock:
+      b.Block(prec->x, prec->y, prec[1].x, prec[1].y, kv);
+      irec++;
+      break;
+    case recLine:
+      b.Line(prec->x, prec->y, prec[1].x, prec[1].y, kv);
+      irec++;
+      break;
+    case recKey:
+      b.FBitmapCopy(*gs.rgbKey[prec->x]);
+      break;
+    case recPatch:
+      b.BlockMove(*gs.rgbKey[kv], 0, 0, gs.rgbKey[kv]->m_x-1,
+        gs.rgbKey[kv]->m_y-1, prec->x, prec->y);
+      break;
+    }
+  }
+  return irec;
+}
+
+
 /*
 ******************************************************************************
 ** Bitmap Block Editing
@@ -471,7 +807,8 @@ void CMap::Legalize2(int *x, int *y) CONST
 void CMon::Block(int x1, int y1, int x2, int y2, KV o)
 {
   int x, y;
-  long il1, il2, il, l, l1, l2;
+  lsize il1, il2, il;
+  long l, l1, l2;
 
   Legalize(&x1, &y1); Legalize(&x2, &y2);
   SortN(&x1, &x2);
@@ -510,6 +847,8 @@ void CMon::Block(int x1, int y1, int x2, int y2, KV o)
 
   // Need to update the screen if Show Pixel Edits is on.
 LDone:
+  Dirty(x1, y1, x2, y2);
+  Rec(recBlock, x1, y1, x2, y2, o);
   if (gs.fTraceDot && FVisible())
     for (y = y1; y <= y2; y++)
       for (x = x1; x <= x2; x++)
@@ -555,7 +894,7 @@ void CMon::BlockMove(CONST CMap &b, int x1, int y1, int x2, int y2,
 {
   CONST CMon &b1 = dynamic_cast<CONST CMon &>(b);
   int x, y, xT, yT;
-  long il1, il2, il0;
+  lsize il1, il2, il0;
 
   Assert(!b.FColor());
   SortN(&x1, &x2);
@@ -573,6 +912,9 @@ void CMon::BlockMove(CONST CMap &b, int x1, int y1, int x2, int y2,
     il0 = _Il(x0, y0);
     while (il1 <= il2)
       *_Pl(il0++) = *b1._Pl(il1++);
+    Dirty(x0, y0, m_x-1, y0+(y2-y1));
+    if (this == gs.bRecord)
+      RecordPatch(x0, y0, m_x-1, y0+(y2-y1));
     return;
   }
 
@@ -616,7 +958,8 @@ void CMon::BlockMoveOrAnd(CONST CMon &b1, int x1, int y1, int x2, int y2,
 void CMon::LineX(int x1, int x2, int y, KV o)
 {
   int x;
-  long il1, il2, il, l;
+  lsize il1, il2, il;
+  long l;
 
   // Don't worry about pixels that are off the bitmap.
   if (y < 0 || y >= m_y)
@@ -642,6 +985,8 @@ void CMon::LineX(int x1, int x2, int y, KV o)
   }
 
   // Need to update the screen if Show Pixel Edits is on.
+  Dirty(x1, y, x2, y);
+  Rec(recBlock, x1, y, x2, y, o);
   if (gs.fTraceDot && FVisible())
     for (x = x1; x <= x2; x++)
       ScreenDot(x, y, o, ~0);
@@ -653,7 +998,8 @@ void CMon::LineX(int x1, int x2, int y, KV o)
 void CMon::LineY(int x, int y1, int y2, KV o)
 {
   int y;
-  long il, lf;
+  lsize il;
+  long lf;
 
   // Don't worry about pixels that are off the bitmap.
   if (x < 0 || x >= m_x)
@@ -682,6 +1028,8 @@ void CMon::LineY(int x, int y1, int y2, KV o)
   }
 
   // Need to update the screen if Show Pixel Edits is on.
+  Dirty(x, y1, x, y2);
+  Rec(recBlock, x, y1, x, y2, o);
   if (gs.fTraceDot && FVisible())
     for (y = y1; y <= y2; y++)
       ScreenDot(x, y, o, ~0);
@@ -743,6 +1091,8 @@ void CMon::Line(int x1, int y1, int x2, int y2, KV o)
   }
 
   // Need to update the screen if Show Pixel Edits is on.
+  Dirty(x1, y1, x2, y2);
+  Rec(recLine, x1, y1, x2, y2, o);
   if (gs.fTraceDot && FVisible())
     UpdateDisplay();
 }
@@ -1466,14 +1816,12 @@ LDone:
 flag CMon::FFillCore(int x, int y, KV o, flag fFlood)
 {
   PT *rgpt;
-  long ipt = 0;
+  lsize ipt = 0, lScratch = LScratchMark();
   int xnew, ynew, d, dMax;
 
   if (!FLegalFill(x, y, o))
     return fTrue;
-  if (F64K())
-    return fFalse;
-  rgpt = RgAllocate(m_x*m_y, PT);
+  rgpt = RgAllocateScratch((lsize)m_x*m_y, PT);
   if (rgpt == NULL)
     return fFalse;
   dMax = DIRS + fFlood*DIRS;
@@ -1492,7 +1840,7 @@ LSet:
       break;
     FillPop(x, y);
   }
-  DeallocateP(rgpt);
+  ScratchRelease(lScratch);
   return fTrue;
 }
 
@@ -1553,12 +1901,251 @@ long CMon::AnalyzePerimeter(int x0, int y0, flag fCorner) CONST
 }
 
 
+// Label connected components. Each strip of rows is labeled on its own
+// thread, by giving each pixel in the target state a parent index and
+// joining it with its already visited neighbors in the strip. A parent index
+// always precedes its child in raster order, so each tree's root is the
+// first pixel of its component, and strips only ever touch their own pixels.
+
+typedef struct _componentlabel {
+  CONST CMon *b;
+  lsize *rgl;
+  bit o;
+  flag fCorner;
+  int cstrip;
+} COMPLAB;
+
+INLINE lsize LabelFind(lsize *rgl, lsize i)
+{
+  while (rgl[i] != i) {
+    rgl[i] = rgl[rgl[i]];
+    i = rgl[i];
+  }
+  return i;
+}
+
+INLINE void LabelUnion(lsize *rgl, lsize i, lsize j)
+{
+  i = LabelFind(rgl, i); j = LabelFind(rgl, j);
+  if (i < j)
+    rgl[j] = i;
+  else if (j < i)
+    rgl[i] = j;
+}
+
+void LabelComponentsThread(void *pv, int is)
+{
+  COMPLAB *pcl = (COMPLAB *)pv;
+  CONST CMon &b = *pcl->b;
+  lsize *rgl = pcl->rgl, i;
+  int x, y, ylo, yhi;
+
+  ylo = (int)((lsize)b.m_y * is / pcl->cstrip);
+  yhi = (int)((lsize)b.m_y * (is+1) / pcl->cstrip);
+  for (y = ylo; y < yhi; y++)
+    for (x = 0; x < b.m_x; x++) {
+      i = (lsize)y * b.m_x + x;
+      if (b._Get(x, y) != pcl->o) {
+        rgl[i] = -1;
+        continue;
+      }
+      rgl[i] = i;
+      if (x > 0 && rgl[i-1] >= 0)
+        LabelUnion(rgl, i, i-1);
+      if (y <= ylo)
+        continue;
+      if (rgl[i - b.m_x] >= 0)
+        LabelUnion(rgl, i, i - b.m_x);
+      if (pcl->fCorner) {
+        if (x > 0 && rgl[i - b.m_x - 1] >= 0)
+          LabelUnion(rgl, i, i - b.m_x - 1);
+        if (x < b.m_x-1 && rgl[i - b.m_x + 1] >= 0)
+          LabelUnion(rgl, i, i - b.m_x + 1);
+      }
+    }
+}
+
+
+// Label the connected components of pixels in the given state. The label
+// image has one entry per pixel, numbering each component from 1 in order of
+// its first pixel, with 0 for pixels not in the state. Optionally also return
+// the size and first pixel of each component, indexed by label. Both arrays
+// come from the scratch arena. Return the number of components, or -1 on
+// failure.
+
+lsize CMon::LabelComponents(bit o, flag fCorner, lsize **prgl,
+  CCS **prgccs) CONST
+{
+  COMPLAB cl;
+  lsize *rgl, ccell = (lsize)m_x * m_y, cl2 = 0, i;
+  CCS *rgccs;
+  int x, y, is, ylo;
+
+  rgl = RgAllocateScratch(ccell, lsize);
+  if (rgl == NULL)
+    return -1;
+  cl.b = this; cl.rgl = rgl; cl.o = o; cl.fCorner = fCorner;
+  cl.cstrip = Min(CThread(), Max(ccell >> 16, 1));
+  EnsureBetween(cl.cstrip, 1, Max(m_y, 1));
+  RunThreads(LabelComponentsThread, &cl, cl.cstrip);
+
+  // Join components across the boundaries between strips.
+  for (is = 1; is < cl.cstrip; is++) {
+    ylo = (int)((lsize)m_y * is / cl.cstrip);
+    for (x = 0; x < m_x; x++) {
+      i = (lsize)ylo * m_x + x;
+      if (rgl[i] < 0)
+        continue;
+      if (rgl[i - m_x] >= 0)
+        LabelUnion(rgl, i, i - m_x);
+      if (fCorner) {
+        if (x > 0 && rgl[i - m_x - 1] >= 0)
+          LabelUnion(rgl, i, i - m_x - 1);
+        if (x < m_x-1 && rgl[i - m_x + 1] >= 0)
+          LabelUnion(rgl, i, i - m_x + 1);
+      }
+    }
+  }
+
+  // Replace parent indexes with compact labels. Since a parent always comes
+  // first, it has already been relabeled by the time its children are seen.
+  for (i = 0; i < ccell; i++) {
+    if (rgl[i] < 0)
+      rgl[i] = 0;
+    else if (rgl[i] == i)
+      rgl[i] = ++cl2;
+    else
+      rgl[i] = rgl[rgl[i]];
+  }
+
+  if (prgccs != NULL) {
+    rgccs = RgAllocateScratch(cl2 + 1, CCS);
+    if (rgccs == NULL)
+      return -1;
+    ClearPb(rgccs, (cl2 + 1) * sizeof(CCS));
+    for (y = 0, i = 0; y < m_y; y++)
+      for (x = 0; x < m_x; x++, i++)
+        if (rgl[i] > 0 && rgccs[rgl[i]].cPixel++ <= 0) {
+          rgccs[rgl[i]].x = x; rgccs[rgl[i]].y = y;
+        }
+    *prgccs = rgccs;
+  }
+  *prgl = rgl;
+  return cl2;
+}
+
+
 /*
 ******************************************************************************
 ** Bitmap Transformations
 ******************************************************************************
 */
 
+// Scratch bitmaps. Transforms that build a whole new bitmap and then replace
+// the original with it borrow one from a small cache of bitmaps of the same
+// pixel type, rather than allocating a new one on each call. Afterward they
+// swap buffers with the borrowed bitmap, so the original's buffer stays in
+// the cache for the next call, making repeated transforms in a script loop
+// double buffered instead of allocating and freeing a bitmap each time.
+
+CMon rgbScratch[cScratchMap];
+SMAP smapMon, smapCol;
+
+
+// Borrow a bitmap from a scratch cache, sized to the given dimensions and
+// with 3D fields copied from the original bitmap. Prefer a cached bitmap that
+// already has the right size, else reuse the least recently used one. The
+// contents are undefined. Return the index of the bitmap, or -1 on failure.
+
+int IScratchBorrow(SMAP *psm, int x, int y, CONST CMap *pbOld)
+{
+  CMap *pb;
+  int i, iBest = -1;
+
+  for (i = 0; i < cScratchMap; i++) {
+    if (psm->rgfBusy[i])
+      continue;
+    pb = psm->rgpb[i];
+    if (pb->m_x == x && pb->m_y == y && !pb->FNull()) {
+      iBest = i;
+      break;
+    }
+    if (iBest < 0 || psm->rglUse[i] < psm->rglUse[iBest])
+      iBest = i;
+  }
+  if (iBest < 0) {
+    PrintSz_E("Too many scratch bitmaps in use at once.\n");
+    return -1;
+  }
+  pb = psm->rgpb[iBest];
+  if (!pb->FBitmapSizeSet(x, y))
+    return -1;
+  if (pbOld != NULL)
+    pb->Copy3(*pbOld);
+  psm->rgfBusy[iBest] = fTrue;
+  psm->rglUse[iBest] = ++psm->lUse;
+  return iBest;
+}
+
+
+// Borrow a monochrome scratch bitmap of the given size.
+
+CMon *PbScratch(int x, int y, CONST CMap *pbOld)
+{
+  int i;
+
+  if (smapMon.rgpb[0] == NULL)
+    for (i = 0; i < cScratchMap; i++)
+      smapMon.rgpb[i] = &rgbScratch[i];
+  i = IScratchBorrow(&smapMon, x, y, pbOld);
+  return i >= 0 ? &rgbScratch[i] : NULL;
+}
+
+
+// Return a borrowed scratch bitmap to its cache. Idle scratch bitmaps are
+// limited to the same total memory as the allocation pool, beyond which the
+// returned bitmap's buffer is freed.
+
+void ScratchMapDone(CMap *pb)
+{
+  SMAP *psm;
+  lsize cb = 0;
+  int i, j, iDone = -1;
+
+  for (j = 0; j < 2; j++) {
+    psm = j ? &smapCol : &smapMon;
+    for (i = 0; i < cScratchMap; i++) {
+      if (psm->rgpb[i] == pb) {
+        Assert(psm->rgfBusy[i]);
+        psm->rgfBusy[i] = fFalse;
+        iDone = i;
+      }
+      if (psm->rgpb[i] != NULL && !psm->rgfBusy[i])
+        cb += (lsize)psm->rgpb[i]->m_y * psm->rgpb[i]->m_clRow << 2;
+    }
+  }
+  Assert(iDone >= 0);
+  if (cb > us.cbAllocPoolMax)
+    pb->Free();
+}
+
+
+// Free the buffers of all idle scratch bitmaps.
+
+void ScratchMapFree()
+{
+  SMAP *psm;
+  int i, j;
+
+  for (j = 0; j < 2; j++) {
+    psm = j ? &smapCol : &smapMon;
+    for (i = 0; i < cScratchMap; i++)
+      if (psm->rgpb[i] != NULL && !psm->rgfBusy[i])
+        psm->rgpb[i]->Free();
+  }
+}
+
+
 // Return the number of on pixels in a bitmap.
 
 long CMon::BitmapCount() CONST
@@ -1635,13 +2222,14 @@ flag CMon::FBitmapSubset(CONST CMon &b2) CONST
 void CMon::BitmapSet(KV o)
 {
   dword l;
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   l = o ? dwSet : 0;
   clBitmap = CbBitmap(m_x, m_y) >> 2;
   // Set 32 pixels at a time.
   for (il = 0; il < clBitmap; il++)
     *_Pl(il) = l;
+  DirtyAll();
   if (gs.fTraceDot && FVisible())
     UpdateDisplay();
 }
@@ -1651,12 +2239,13 @@ void CMon::BitmapSet(KV o)
 
 void CMon::BitmapReverse()
 {
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   clBitmap = CbBitmap(m_x, m_y) >> 2;
   // Invert 32 pixels at a time.
   for (il = 0; il < clBitmap; il++)
     *_Pl(il) ^= dwSet;
+  DirtyAll();
 }
 
 
@@ -1697,15 +2286,16 @@ void CMon::BitmapMoire()
 
 flag CMap::FBitmapCopy(CONST CMap &bSrc)
 {
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   if (!FBitmapSizeSet(bSrc.m_x, bSrc.m_y))
     return fFalse;
   Copy3(bSrc);
   Assert(m_cfPix == bSrc.m_cfPix);
-  clBitmap = m_y * m_clRow;
+  clBitmap = (lsize)m_y * m_clRow;
   for (il = 0; il < clBitmap; il++)
     *_Rgl(il) = *bSrc._Rgl(il);
+  DirtyAll();
   return fTrue;
 }
 
@@ -1729,13 +2319,14 @@ void CMon::BitmapMoveOrAnd(CONST CMon &bSrc, CONST int *rgf)
 
 void CMon::BitmapOr(CONST CMon &bSrc)
 {
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   // Fast case: For bitmaps of the same size, combine 32 pixels at a time.
   if (m_x == bSrc.m_x && m_y == bSrc.m_y) {
     clBitmap = CbBitmap(m_x, m_y) >> 2;
     for (il = 0; il < clBitmap; il++)
       *_Pl(il) |= *bSrc._Pl(il);
+    DirtyAll();
     return;
   }
 
@@ -1747,13 +2338,14 @@ void CMon::BitmapOr(CONST CMon &bSrc)
 
 void CMon::BitmapAnd(CONST CMon &bSrc)
 {
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   // Fast case: For bitmaps of the same size, combine 32 pixels at a time.
   if (m_x == bSrc.m_x && m_y == bSrc.m_y) {
     clBitmap = CbBitmap(m_x, m_y) >> 2;
     for (il = 0; il < clBitmap; il++)
       *_Pl(il) &= *bSrc._Pl(il);
+    DirtyAll();
     return;
   }
 
@@ -1765,13 +2357,14 @@ void CMon::BitmapAnd(CONST CMon &bSrc)
 
 void CMon::BitmapXor(CONST CMon &bSrc)
 {
-  long clBitmap, il;
+  lsize clBitmap, il;
 
   // Fast case: For bitmaps of the same size, combine 32 pixels at a time.
   if (m_x == bSrc.m_x && m_y == bSrc.m_y) {
     clBitmap = CbBitmap(m_x, m_y) >> 2;
     for (il = 0; il < clBitmap; il++)
       *_Pl(il) ^= *bSrc._Pl(il);
+    DirtyAll();
     return;
   }
 
@@ -1829,7 +2422,7 @@ flag CMap::FBitmapTessellateTo(int x, int y)
 void CMon::BitmapFlipX()
 {
   int x, y, o;
-  long il, ilT;
+  lsize il, ilT;
   dword l;
 
   if ((m_x & 31) == 0) {
@@ -1859,6 +2452,7 @@ void CMon::BitmapFlipX()
         ilT++, il--;
       }
     }
+    DirtyAll();
   } else {
     // Normal case: Flip one bit at a time.
     for (y = 0; y < m_y; y++)
@@ -1876,7 +2470,7 @@ void CMon::BitmapFlipX()
 void CMap::BitmapFlipY()
 {
   int x, y;
-  dword l, *pl1 = _Rgl(0), *pl2 = _Rgl((m_y-1) * m_clRow);
+  dword l, *pl1 = _Rgl(0), *pl2 = _Rgl((lsize)(m_y-1) * m_clRow);
 
   // Swap one row at a time, 32 bits at a time.
   for (y = 0; y < m_y >> 1; y++) {
@@ -1886,6 +2480,7 @@ void CMap::BitmapFlipY()
     }
     pl2 -= (m_clRow << 1);
   }
+  DirtyAll();
 }
 
 
@@ -2008,12 +2603,14 @@ flag CMap::FBitmapShiftBy(int xnew, int ynew)
 
 flag CMon::FBitmapZoomTo(int xnew, int ynew, flag fPreserve)
 {
-  CMon bNew;
+  CMon *pbNew;
   int x, y, x1, y1, x2, y2;
   real deltax, deltay;
 
-  if (!bNew.FAllocate(xnew, ynew, this))
+  pbNew = PbScratch(xnew, ynew, this);
+  if (pbNew == NULL)
     return fFalse;
+  CMon &bNew = *pbNew;
   bNew.BitmapOff();
   if (FZero() || bNew.FZero())
     goto LDone;
@@ -2050,7 +2647,8 @@ LNext:
           bNew.Set1(x, y);
   }
 LDone:
-  CopyFrom(bNew);
+  SwapWith(bNew);
+  ScratchMapDone(pbNew);
   return fTrue;
 }
 
@@ -2061,12 +2659,14 @@ LDone:
 
 flag CMon::FBitmapBias(int xbias1, int xbias2, int ybias1, int ybias2)
 {
-  CMon bNew;
+  CMon *pbNew;
   int x, y;
 
-  if (!bNew.FAllocate((m_x >> 1)*(xbias1 + xbias2) + FOdd(m_x)*xbias1,
-    (m_y >> 1)*(ybias1 + ybias2) + FOdd(m_y)*ybias1, this))
+  pbNew = PbScratch((m_x >> 1)*(xbias1 + xbias2) + FOdd(m_x)*xbias1,
+    (m_y >> 1)*(ybias1 + ybias2) + FOdd(m_y)*ybias1, this);
+  if (pbNew == NULL)
     return fFalse;
+  CMon &bNew = *pbNew;
   bNew.BitmapOff();
   for (y = 0; y < m_y; y++)
     for (x = 0; x < m_x; x++)
@@ -2075,7 +2675,8 @@ flag CMon::FBitmapBias(int xbias1, int xbias2, int ybias1, int ybias2)
           (y >> 1)*(ybias1 + ybias2) + FOdd(y)*ybias1,
           ((x + 1) >> 1)*(xbias1 + xbias2) + FOdd(x + 1)*xbias1 - 1,
           ((y + 1) >> 1)*(ybias1 + ybias2) + FOdd(y + 1)*ybias1 - 1, fOn);
-  CopyFrom(bNew);
+  SwapWith(bNew);
+  ScratchMapDone(pbNew);
   return fTrue;
 }
 
@@ -2668,54 +3269,188 @@ flag CMon::FStereogram(CONST CMon &bTexture, int width, int height)
 }
 
 
-// Treat the bitmap as a board of the "Life" cellular automaton, and create
-// the next generation.
+typedef struct _lifegen {
+  CMon *b;         // Bitmap being evolved
+  qword *rgq;      // Copy of bitmap, with pixel x at bit x+1 of each row
+  qword *rgqZero;  // Row of all off pixels above and below the bitmap
+  int cq;          // Number of qwords in each row of the copy
+  int cstrip;
+  int nPass;
+  flag fTorus;
+  flag fTrace;
+  long rgcount[cThreadMax];
+} LIFEGEN;
 
-long CMon::LifeGenerate(flag fTorus)
+// Reverse the order of the bits within each byte of a 32 bit long. Monochrome
+// bitmaps store the leftmost pixel in the high bit of each byte, so this
+// converts to and from an order where pixel x is at bit x of the long.
+
+INLINE dword LReverseByteBits(dword l)
 {
-  CMon bCopy;
-  int x, y, i, n, xT, yT;
-  long count = 0;
+  l = ((l >> 1) & 0x55555555L) | ((l & 0x55555555L) << 1);
+  l = ((l >> 2) & 0x33333333L) | ((l & 0x33333333L) << 2);
+  l = ((l >> 4) & 0x0f0f0f0fL) | ((l & 0x0f0f0f0fL) << 4);
+  return l;
+}
 
-  if (!bCopy.FBitmapCopy(*this))
-    return -1;
-  for (y = 0; y < m_y; y++)
-    for (x = 0; x < m_x; x++) {
+// Return the number of on bits in a qword, by adding neighboring bits
+// together, then groups of four, then eight, etc.
 
-      // Count the number of neighboring live cells.
-      n = 0;
-      if (!fTorus) {
-        for (i = 0; i < DIRS2; i++)
-          n += bCopy.GetFast(x + xoff[i], y + yoff[i]);
-      } else {
-        for (i = 0; i < DIRS2; i++) {
-          xT = x + xoff[i]; yT = y + yoff[i];
-          if (xT < 0)
-            xT = m_x-1;
-          else if (xT >= m_x)
-            xT = 0;
-          if (yT < 0)
-            yT = m_y-1;
-          else if (yT >= m_y)
-            yT = 0;
-          n += bCopy.Get(xT, yT);
-        }
+INLINE int CBitQword(qword q)
+{
+  q = q - ((q >> 1) & 0x5555555555555555ULL);
+  q = (q & 0x3333333333333333ULL) + ((q >> 2) & 0x3333333333333333ULL);
+  q = (q + (q >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int)((q * 0x0101010101010101ULL) >> 56);
+}
+
+// Full and half adders across 64 bits at once. Sum the bits in each position
+// of the inputs, returning the low bit of each sum in s and the high in c.
+
+#define Add3(a, b, c0, s, c) \
+  { qword _t = (a) ^ (b); s = _t ^ (c0); c = ((a) & (b)) | (_t & (c0)); }
+#define Add2(a, b, s, c) { s = (a) ^ (b); c = (a) & (b); }
+
+
+// Thread routine for LifeGenerate. Pass 0 copies each row in a strip to the
+// working copy, padded with the pixels (if any) off the left and right edges.
+// Pass 1 computes the next generation of each row in a strip, 64 cells at a
+// time, by adding up the neighbors of each cell using bit sliced adders.
+
+void LifeGenerateThread(void *pv, int is)
+{
+  LIFEGEN *lg = (LIFEGEN *)pv;
+  CMon &b = *lg->b;
+  CONST qword *pqU, *pqC, *pqD;
+  qword *pq, qOld, qNew, qMask, qEq, qDiff, uw, uc, ue, cw, cc, ce,
+    dw, dc, de, s1, c1, s2, c2, s3, c3, b0, b1, b2, b3, k1, k2, k3;
+  uint *pl;
+  int y, ylo, yhi, j, cl, n, grfLive, grfBorn, k;
+  long count = 0;
+
+  ylo = b.m_y * is / lg->cstrip; yhi = b.m_y * (is+1) / lg->cstrip;
+  cl = (b.m_x + 63) >> 6;
+  for (y = ylo; y < yhi; y++) {
+    pq = lg->rgq + (long)y * lg->cq;
+    pl = (uint *)b._Pl(0, y);
+
+    if (lg->nPass <= 0) {
+      // Convert the row to linear bit order, shifted over by one pixel.
+      qOld = 0;
+      for (j = 0; j < cl; j++) {
+        qNew = LReverseByteBits(pl[j << 1]);
+        if ((j << 1) + 1 < b.m_clRow)
+          qNew |= (qword)LReverseByteBits(pl[(j << 1) + 1]) << 32;
+        if (j == cl-1 && (b.m_x & 63) != 0)
+          qNew &= ((qword)1 << (b.m_x & 63)) - 1;
+        pq[j] = (qNew << 1) | (qOld >> 63);
+        qOld = qNew;
       }
+      pq[cl] = qOld >> 63;
+      if (lg->fTorus) {
+        pq[0] |= (pq[b.m_x >> 6] >> (b.m_x & 63)) & 1;
+        pq[(b.m_x + 1) >> 6] |= (pq[0] >> 1 & 1) << ((b.m_x + 1) & 63);
+      }
+      continue;
+    }
 
-      if (bCopy.Get(x, y)) {
-        if (gs.grfLifeDie & (1 << n)) {
-          // A cell dies.
-          Set0(x, y);
-          count++;
-        }
-      } else {
-        if (gs.grfLifeBorn & (1 << n)) {
-          // A new cell is born.
-          Set1(x, y);
-          count++;
-        }
+    // Determine the rows above and below, which may wrap around.
+    pqC = pq;
+    if (y > 0)
+      pqU = pqC - lg->cq;
+    else
+      pqU = lg->fTorus ? lg->rgq + (long)(b.m_y-1) * lg->cq : lg->rgqZero;
+    if (y < b.m_y-1)
+      pqD = pqC + lg->cq;
+    else
+      pqD = lg->fTorus ? lg->rgq : lg->rgqZero;
+    grfLive = ~gs.grfLifeDie; grfBorn = gs.grfLifeBorn;
+
+    for (j = 0; j < cl; j++) {
+      // Get the cells to the left, center, and right, above and below.
+      uw = pqU[j]; uc = (uw >> 1) | (pqU[j+1] << 63);
+      ue = (uw >> 2) | (pqU[j+1] << 62);
+      cw = pqC[j]; cc = (cw >> 1) | (pqC[j+1] << 63);
+      ce = (cw >> 2) | (pqC[j+1] << 62);
+      dw = pqD[j]; dc = (dw >> 1) | (pqD[j+1] << 63);
+      de = (dw >> 2) | (pqD[j+1] << 62);
+
+      // Add up the eight neighbors into a four bit count b3..b0.
+      Add3(uw, uc, ue, s1, c1);
+      Add3(cw, ce, dw, s2, c2);
+      Add2(dc, de, s3, c3);
+      Add3(s1, s2, s3, b0, k1);
+      Add3(c1, c2, c3, k2, k3);
+      Add2(k2, k1, b1, k2);
+      b2 = k3 ^ k2; b3 = k3 & k2;
+
+      // Apply the rules for each count of neighbors.
+      qNew = 0;
+      for (n = 0; n <= 8; n++) {
+        if (!((grfLive | grfBorn) & (1 << n)))
+          continue;
+        qEq = (n & 1 ? b0 : ~b0) & (n & 2 ? b1 : ~b1) &
+          (n & 4 ? b2 : ~b2) & (n & 8 ? b3 : ~b3);
+        if (!(grfLive & (1 << n)))
+          qEq &= ~cc;
+        else if (!(grfBorn & (1 << n)))
+          qEq &= cc;
+        qNew |= qEq;
       }
+
+      // Store the row back in the bitmap, leaving any pad bits unchanged.
+      qOld = LReverseByteBits(pl[j << 1]);
+      if ((j << 1) + 1 < b.m_clRow)
+        qOld |= (qword)LReverseByteBits(pl[(j << 1) + 1]) << 32;
+      qMask = (j < cl-1 || (b.m_x & 63) == 0) ? ~(qword)0 :
+        ((qword)1 << (b.m_x & 63)) - 1;
+      qDiff = (qNew ^ qOld) & qMask;
+      if (qDiff == 0)
+        continue;
+      count += CBitQword(qDiff);
+      if (lg->fTrace)
+        for (k = 0; k < 64; k++)
+          if (qDiff >> k & 1)
+            ScreenDot((j << 6) + k, y, (int)(qNew >> k & 1), ~0);
+      qNew = qOld ^ qDiff;
+      pl[j << 1] = LReverseByteBits((dword)qNew);
+      if ((j << 1) + 1 < b.m_clRow)
+        pl[(j << 1) + 1] = LReverseByteBits((dword)(qNew >> 32));
     }
+  }
+  lg->rgcount[is] = count;
+}
+
+
+// Treat the bitmap as a board of the "Life" cellular automaton, and create
+// the next generation. Each row is processed 64 cells at a time, and large
+// bitmaps are split into strips of rows processed on separate threads.
+
+long CMon::LifeGenerate(flag fTorus)
+{
+  LIFEGEN lg;
+  long count = 0;
+  int is;
+
+  lg.cq = ((m_x + 63) >> 6) + 1;
+  lg.rgq = RgAllocate((long)(m_y + 1) * lg.cq, qword);
+  if (lg.rgq == NULL)
+    return -1;
+  lg.rgqZero = lg.rgq + (long)m_y * lg.cq;
+  for (is = 0; is < lg.cq; is++)
+    lg.rgqZero[is] = 0;
+  lg.b = this;
+  lg.fTorus = fTorus;
+  lg.fTrace = gs.fTraceDot && FVisible();
+  lg.cstrip = lg.fTrace ? 1 :
+    Min(CThread(), Max((long)m_y * lg.cq >> 12, 1));
+  EnsureBetween(lg.cstrip, 1, m_y);
+  for (lg.nPass = 0; lg.nPass < 2; lg.nPass++)
+    RunThreads(LifeGenerateThread, &lg, lg.cstrip);
+  for (is = 0; is < lg.cstrip; is++)
+    count += lg.rgcount[is];
+  DeallocateP(lg.rgq);
+  DirtyAll();
   return count;
 }
 
@@ -2750,6 +3485,474 @@ flag FSetLife(CONST char *sz, int cch)
 }
 
 
+/*
+******************************************************************************
+** HashLife Routines
+******************************************************************************
+*/
+
+#define clhLevel 64
+#define clhNodeMin 4096L
+#define lhNil (-1L)
+
+typedef struct _lifenode {
+  long nw, ne, sw, se;  // Quadrants, which are nodes one level down
+  long res;             // Center of node after some generations, if computed
+  long next;            // Next node in the same hash table chain
+  int level;            // Node covers 2^level by 2^level cells
+  int step;             // Log2 of generations res is for, or -1 if none
+} LIFENODE;
+
+typedef struct _lifehash {
+  LIFENODE *rgnode;     // Pool of all nodes. Nodes 0 and 1 are single cells
+  long *rghash;         // Heads of hash table chains, also used for GC
+  long cnode;           // Number of nodes in use
+  long cnodeMax;        // Number of nodes allocated in the pool
+  long cnodeCap;        // Most nodes allowed within the memory limit
+  long chash;           // Size of hash table, which is a power of two
+  long rgEmpty[clhLevel];  // Node of all dead cells at each level
+  int step;             // Log2 of generations to advance nodes by
+  byte rgbLeaf[65536];  // Center 2x2 cells after one generation of 4x4 cells
+} LIFEHASH;
+
+#define LhN(n) (lh->rgnode[n])
+#define LhHash(nw, ne, sw, se) \
+  ((((((ulong)(nw) * 0x9E3779B1UL) + (ulong)(ne)) * 0x85EBCA6BUL + \
+  (ulong)(sw)) * 0xC2B2AE35UL + (ulong)(se)) & (ulong)(lh->chash-1))
+
+// Rebuild the hash table of a HashLife universe, after the node pool has
+// been resized or compacted.
+
+flag FLifeHashRehash(LIFEHASH *lh, long chash)
+{
+  long i, h;
+
+  if (chash != lh->chash) {
+    if (lh->rghash != NULL)
+      DeallocateP(lh->rghash);
+    lh->rghash = RgAllocate(chash, long);
+    if (lh->rghash == NULL)
+      return fFalse;
+    lh->chash = chash;
+  }
+  for (i = 0; i < chash; i++)
+    lh->rghash[i] = lhNil;
+  for (i = 2; i < lh->cnode; i++) {
+    h = LhHash(LhN(i).nw, LhN(i).ne, LhN(i).sw, LhN(i).se);
+    LhN(i).next = lh->rghash[h];
+    lh->rghash[h] = i;
+  }
+  return fTrue;
+}
+
+
+// Return the unique node with the given four quadrants, creating it if it
+// doesn't exist yet. Return lhNil if the node pool is at its memory limit.
+
+long LifeHashFind(LIFEHASH *lh, long nw, long ne, long sw, long se)
+{
+  LIFENODE *rgnode;
+  long h, n, cnodeMax, chash;
+
+  if (nw < 0 || ne < 0 || sw < 0 || se < 0)
+    return lhNil;
+  h = LhHash(nw, ne, sw, se);
+  for (n = lh->rghash[h]; n != lhNil; n = LhN(n).next)
+    if (LhN(n).nw == nw && LhN(n).ne == ne && LhN(n).sw == sw &&
+      LhN(n).se == se)
+      return n;
+
+  // Grow the node pool and hash table if needed.
+  if (lh->cnode >= lh->cnodeMax) {
+    if (lh->cnodeMax >= lh->cnodeCap)
+      return lhNil;
+    cnodeMax = Min(lh->cnodeMax << 1, lh->cnodeCap);
+    rgnode = RgAllocate(cnodeMax, LIFENODE);
+    if (rgnode == NULL) {
+      lh->cnodeCap = lh->cnodeMax;
+      return lhNil;
+    }
+    CopyRgb((char *)lh->rgnode, (char *)rgnode,
+      lh->cnode * sizeof(LIFENODE));
+    DeallocateP(lh->rgnode);
+    lh->rgnode = rgnode;
+    lh->cnodeMax = cnodeMax;
+    for (chash = lh->chash; chash < cnodeMax; chash <<= 1)
+      ;
+    if (!FLifeHashRehash(lh, chash))
+      return lhNil;
+    h = LhHash(nw, ne, sw, se);
+  }
+
+  n = lh->cnode++;
+  LhN(n).nw = nw; LhN(n).ne = ne; LhN(n).sw = sw; LhN(n).se = se;
+  LhN(n).res = lhNil; LhN(n).step = -1;
+  LhN(n).level = LhN(nw).level + 1;
+  LhN(n).next = lh->rghash[h];
+  lh->rghash[h] = n;
+  return n;
+}
+
+
+// Return the node of all dead cells at a given level.
+
+long LifeHashEmpty(LIFEHASH *lh, int level)
+{
+  long n;
+
+  if (lh->rgEmpty[level] == lhNil) {
+    n = LifeHashEmpty(lh, level-1);
+    if (n == lhNil)
+      return lhNil;
+    lh->rgEmpty[level] = LifeHashFind(lh, n, n, n, n);
+  }
+  return lh->rgEmpty[level];
+}
+
+
+// Return the node one level down covering the center of a node.
+
+long LifeHashCenter(LIFEHASH *lh, long n)
+{
+  return LifeHashFind(lh, LhN(LhN(n).nw).se, LhN(LhN(n).ne).sw,
+    LhN(LhN(n).sw).ne, LhN(LhN(n).se).nw);
+}
+
+
+// Return the node one level down covering the center of a node, after it's
+// advanced 2^min(step, level-2) generations. This is the core of HashLife,
+// where results are memoized so identical areas are only computed once.
+
+long LifeHashStep(LIFEHASH *lh, long n)
+{
+  long rgn[9], rgr[9], nw, ne, sw, se, res;
+  int level = LhN(n).level, grf, x, y, i;
+
+  if (LhN(n).step == lh->step)
+    return LhN(n).res;
+  if (n == lh->rgEmpty[level])
+    return LifeHashEmpty(lh, level-1);
+
+  if (level <= 2) {
+    // Base case: Look up the center of 4x4 cells after one generation.
+    grf = 0;
+    for (y = 0; y < 4; y++)
+      for (x = 0; x < 4; x++) {
+        i = (y < 2 ? (x < 2 ? LhN(n).nw : LhN(n).ne) :
+          (x < 2 ? LhN(n).sw : LhN(n).se));
+        i = (y & 1 ? (x & 1 ? LhN(i).se : LhN(i).sw) :
+          (x & 1 ? LhN(i).ne : LhN(i).nw));
+        grf |= i << (y*4 + x);
+      }
+    grf = lh->rgbLeaf[grf];
+    res = LifeHashFind(lh, grf & 1, grf >> 1 & 1, grf >> 2 & 1, grf >> 3);
+  } else {
+    // Make the nine overlapping nodes one level down, and advance each of
+    // them (or just take their centers when advancing less than full speed).
+    nw = LhN(n).nw; ne = LhN(n).ne; sw = LhN(n).sw; se = LhN(n).se;
+    rgn[0] = nw;
+    rgn[1] = LifeHashFind(lh, LhN(nw).ne, LhN(ne).nw, LhN(nw).se, LhN(ne).sw);
+    rgn[2] = ne;
+    rgn[3] = LifeHashFind(lh, LhN(nw).sw, LhN(nw).se, LhN(sw).nw, LhN(sw).ne);
+    rgn[4] = LifeHashFind(lh, LhN(nw).se, LhN(ne).sw, LhN(sw).ne, LhN(se).nw);
+    rgn[5] = LifeHashFind(lh, LhN(ne).sw, LhN(ne).se, LhN(se).nw, LhN(se).ne);
+    rgn[6] = sw;
+    rgn[7] = LifeHashFind(lh, LhN(sw).ne, LhN(se).nw, LhN(sw).se, LhN(se).sw);
+    rgn[8] = se;
+    for (i = 0; i < 9; i++) {
+      if (rgn[i] == lhNil)
+        return lhNil;
+      rgr[i] = lh->step >= level-2 ? LifeHashStep(lh, rgn[i]) :
+        LifeHashCenter(lh, rgn[i]);
+      if (rgr[i] == lhNil)
+        return lhNil;
+    }
+
+    // Combine them into four nodes, and advance those to get the result.
+    nw = LifeHashFind(lh, rgr[0], rgr[1], rgr[3], rgr[4]);
+    ne = LifeHashFind(lh, rgr[1], rgr[2], rgr[4], rgr[5]);
+    sw = LifeHashFind(lh, rgr[3], rgr[4], rgr[6], rgr[7]);
+    se = LifeHashFind(lh, rgr[4], rgr[5], rgr[7], rgr[8]);
+    if (nw == lhNil || ne == lhNil || sw == lhNil || se == lhNil)
+      return lhNil;
+    nw = LifeHashStep(lh, nw); ne = LifeHashStep(lh, ne);
+    sw = LifeHashStep(lh, sw); se = LifeHashStep(lh, se);
+    res = LifeHashFind(lh, nw, ne, sw, se);
+  }
+  if (res != lhNil) {
+    LhN(n).res = res;
+    LhN(n).step = lh->step;
+  }
+  return res;
+}
+
+
+// Return a node one level up with the given node in its center.
+
+long LifeHashExpand(LIFEHASH *lh, long n)
+{
+  long e, nw, ne, sw, se;
+
+  e = LifeHashEmpty(lh, LhN(n).level-1);
+  if (e == lhNil)
+    return lhNil;
+  nw = LifeHashFind(lh, e, e, e, LhN(n).nw);
+  ne = LifeHashFind(lh, e, e, LhN(n).ne, e);
+  sw = LifeHashFind(lh, e, LhN(n).sw, e, e);
+  se = LifeHashFind(lh, LhN(n).se, e, e, e);
+  return LifeHashFind(lh, nw, ne, sw, se);
+}
+
+
+// Return whether all live cells in a node are within its center half.
+
+flag FLifeHashCentered(LIFEHASH *lh, long n)
+{
+  long e = LifeHashEmpty(lh, LhN(n).level-2), nw, ne, sw, se;
+
+  nw = LhN(n).nw; ne = LhN(n).ne; sw = LhN(n).sw; se = LhN(n).se;
+  return e != lhNil &&
+    LhN(nw).nw == e && LhN(nw).ne == e && LhN(nw).sw == e &&
+    LhN(ne).nw == e && LhN(ne).ne == e && LhN(ne).se == e &&
+    LhN(sw).nw == e && LhN(sw).sw == e && LhN(sw).se == e &&
+    LhN(se).ne == e && LhN(se).sw == e && LhN(se).se == e;
+}
+
+
+// Mark a node and everything under it as in use, for garbage collection.
+
+void LifeHashMark(LIFEHASH *lh, long n)
+{
+  if (n < 2 || LhN(n).step == -2)
+    return;
+  LhN(n).step = -2;
+  LifeHashMark(lh, LhN(n).nw); LifeHashMark(lh, LhN(n).ne);
+  LifeHashMark(lh, LhN(n).sw); LifeHashMark(lh, LhN(n).se);
+}
+
+
+// Free up space in the node pool, by discarding all memoized results, and
+// all nodes not part of the given root node. Children are always created
+// before their parents, so nodes can be compacted in place in index order,
+// with the hash table temporarily mapping old indexes to new ones.
+
+long LifeHashCollect(LIFEHASH *lh, long root)
+{
+  long *rgfwd = lh->rghash, i, j = 2;
+  int level;
+
+  LifeHashMark(lh, root);
+  rgfwd[0] = 0; rgfwd[1] = 1;
+  for (i = 2; i < lh->cnode; i++) {
+    if (LhN(i).step != -2)
+      continue;
+    rgfwd[i] = j;
+    LhN(j) = LhN(i);
+    LhN(j).nw = rgfwd[LhN(i).nw]; LhN(j).ne = rgfwd[LhN(i).ne];
+    LhN(j).sw = rgfwd[LhN(i).sw]; LhN(j).se = rgfwd[LhN(i).se];
+    LhN(j).res = lhNil; LhN(j).step = -1;
+    j++;
+  }
+  root = rgfwd[root];
+  lh->cnode = j;
+  for (level = 1; level < clhLevel; level++)
+    lh->rgEmpty[level] = lhNil;
+  FLifeHashRehash(lh, lh->chash);
+  return root;
+}
+
+
+// Create a node covering an area of a bitmap, with the given upper left
+// corner. Cells off the bitmap are dead.
+
+long LifeHashBuild(LIFEHASH *lh, CONST CMon &b, int level, quad x, quad y)
+{
+  long nw, ne, sw, se;
+  quad d;
+
+  if (x >= b.m_x || y >= b.m_y || x + ((quad)1 << level) <= 0 ||
+    y + ((quad)1 << level) <= 0)
+    return LifeHashEmpty(lh, level);
+  if (level <= 0)
+    return b.Get((int)x, (int)y);
+  d = (quad)1 << (level-1);
+  nw = LifeHashBuild(lh, b, level-1, x,     y);
+  ne = LifeHashBuild(lh, b, level-1, x + d, y);
+  sw = LifeHashBuild(lh, b, level-1, x,     y + d);
+  se = LifeHashBuild(lh, b, level-1, x + d, y + d);
+  return LifeHashFind(lh, nw, ne, sw, se);
+}
+
+
+// Draw the live cells of a node in a bitmap, with the given upper left
+// corner. Cells off the bitmap are ignored.
+
+void LifeHashDraw(LIFEHASH *lh, CMon &b, long n, quad x, quad y)
+{
+  int level = LhN(n).level;
+  quad d;
+
+  if (n == lh->rgEmpty[level] || x >= b.m_x || y >= b.m_y ||
+    x + ((quad)1 << level) <= 0 || y + ((quad)1 << level) <= 0)
+    return;
+  if (level <= 0) {
+    if (n)
+      b.Set1((int)x, (int)y);
+    return;
+  }
+  d = (quad)1 << (level-1);
+  LifeHashDraw(lh, b, LhN(n).nw, x,     y);
+  LifeHashDraw(lh, b, LhN(n).ne, x + d, y);
+  LifeHashDraw(lh, b, LhN(n).sw, x,     y + d);
+  LifeHashDraw(lh, b, LhN(n).se, x + d, y + d);
+}
+
+
+// Treat the bitmap as a window on an infinite board of the "Life" cellular
+// automaton, and create the generation a given number of generations later,
+// using Gosper's HashLife algorithm. Cells may move off the bitmap and come
+// back. The node cache is limited to gs.nLifeHashMem megabytes, and is
+// garbage collected whenever it fills up. HashLife can't wrap around, so for
+// torus edges the generations are stepped through one at a time instead.
+
+long CMon::LifeGenerateHash(long cgen, flag fTorus)
+{
+  LIFEHASH *lh;
+  CMon bCopy;
+  long root, rootNew, count = -1;
+  quad x0 = 0, y0 = 0;
+  int level, step, grf, n, x, y, i;
+  flag fCollected = fFalse;
+
+  if (!fTorus && (gs.grfLifeBorn & 1)) {
+    PrintSz_W("HashLife can't be used with rules where cells are born "
+      "without any neighbors.\n");
+    return -1;
+  }
+  if (!bCopy.FBitmapCopy(*this))
+    return -1;
+  if (fTorus) {
+    for (; cgen > 0; cgen--) {
+      count = LifeGenerate(fTrue);
+      if (count <= 0)
+        break;
+    }
+    if (count < 0)
+      return -1;
+    bCopy.BitmapXor(*this);
+    return bCopy.BitmapCount();
+  }
+  lh = RgAllocate(1, LIFEHASH);
+  if (lh == NULL)
+    return -1;
+  lh->cnodeCap = Max(((long)gs.nLifeHashMem << 20) /
+    (long)(sizeof(LIFENODE) + sizeof(long)), clhNodeMin);
+  lh->cnodeMax = Min(clhNodeMin << 4, lh->cnodeCap);
+  lh->rgnode = RgAllocate(lh->cnodeMax, LIFENODE);
+  lh->rghash = NULL;
+  if (lh->rgnode == NULL)
+    goto LExit;
+  lh->cnode = 2;
+  for (i = 0; i < 2; i++) {
+    LhN(i).nw = LhN(i).ne = LhN(i).sw = LhN(i).se = i;
+    LhN(i).res = LhN(i).next = lhNil;
+    LhN(i).level = 0; LhN(i).step = -1;
+  }
+  for (lh->chash = 1; lh->chash < lh->cnodeMax; lh->chash <<= 1)
+    ;
+  i = lh->chash; lh->chash = 0;
+  if (!FLifeHashRehash(lh, i))
+    goto LExit;
+  lh->rgEmpty[0] = 0;
+  for (level = 1; level < clhLevel; level++)
+    lh->rgEmpty[level] = lhNil;
+
+  // Compute the center 2x2 cells of every possible 4x4 block.
+  for (i = 0; i < 65536; i++) {
+    grf = 0;
+    for (y = 1; y <= 2; y++)
+      for (x = 1; x <= 2; x++) {
+        n = 0;
+        for (step = 0; step < DIRS2; step++)
+          n += (i >> ((y + yoff[step])*4 + x + xoff[step])) & 1;
+        if ((i >> (y*4 + x)) & 1 ? !(gs.grfLifeDie & (1 << n)) :
+          (gs.grfLifeBorn & (1 << n)))
+          grf |= 1 << ((y-1)*2 + x-1);
+      }
+    lh->rgbLeaf[i] = grf;
+  }
+
+  // Create the initial node covering the bitmap.
+  for (level = 3; ((quad)1 << level) < Max(m_x, m_y); level++)
+    ;
+  root = LifeHashBuild(lh, *this, level, 0, 0);
+  if (root == lhNil)
+    goto LExit;
+
+  while (cgen > 0) {
+    for (step = 0; step < clhLevel-4 && ((quad)2 << step) <= cgen; step++)
+      ;
+    loop {
+      // Make sure the node is big enough that no cell can travel outside it
+      // during the generations, then advance it.
+      lh->step = step;
+      rootNew = root;
+      level = LhN(root).level;
+      while (rootNew != lhNil && level < clhLevel-1 &&
+        (level < step+2 || !FLifeHashCentered(lh, rootNew))) {
+        rootNew = LifeHashExpand(lh, rootNew);
+        level++;
+      }
+      if (rootNew != lhNil && level < clhLevel-1) {
+        rootNew = LifeHashExpand(lh, rootNew);
+        level++;
+      }
+      if (rootNew != lhNil)
+        rootNew = LifeHashStep(lh, rootNew);
+      if (rootNew != lhNil)
+        break;
+
+      // If the node pool is full, collect garbage and try again, trying
+      // fewer generations at once if that's already been done.
+      if (fCollected) {
+        if (step <= 0) {
+          PrintSz_W("Not enough memory for HashLife node cache.\n");
+          goto LExit;
+        }
+        step--;
+      }
+      root = LifeHashCollect(lh, root);
+      fCollected = fTrue;
+    }
+    fCollected = fFalse;
+
+    // The result is centered in the expanded node, so adjust the corner.
+    x0 -= ((quad)1 << (level-1)) - ((quad)1 << (LhN(root).level-1)) -
+      ((quad)1 << (level-2));
+    y0 -= ((quad)1 << (level-1)) - ((quad)1 << (LhN(root).level-1)) -
+      ((quad)1 << (level-2));
+    root = rootNew;
+    cgen -= 1L << step;
+    if (lh->cnode > lh->cnodeCap - (lh->cnodeCap >> 2))
+      root = LifeHashCollect(lh, root);
+  }
+
+  // Draw the final generation in the bitmap, and count changed pixels.
+  BitmapOff();
+  LifeHashDraw(lh, *this, root, x0, y0);
+  bCopy.BitmapXor(*this);
+  count = bCopy.BitmapCount();
+
+LExit:
+  if (lh->rgnode != NULL)
+    DeallocateP(lh->rgnode);
+  if (lh->rghash != NULL)
+    DeallocateP(lh->rghash);
+  DeallocateP(lh);
+  return count;
+}
+
+
 /*
 ******************************************************************************
 ** Bitmap File Routines
@@ -2819,6 +4022,7 @@ flag CMon::FReadBitmapCore(FILE *file, int x, int y)
       *_Pl(il) = getlong();
     }
   }
+  DirtyAll();
   return fTrue;
 }
 
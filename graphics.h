@@ -60,6 +60,7 @@
 #define CbBitmapRow(x) ((((x) + 31) >> 5) << 2)
 #define CbBitmap(x, y) LMul(y, CbBitmapRow(x))
 #define Lf(x) (1L << ((x)&31 ^ 7))
+#define cDirtyMax 16
 
 #define GetP(b, x, y) ((b) != NULL && !(b)->FNull() && (b)->Get(x, y))
 #define DirInc(d) d = ((d) + 1) & DIRS1
@@ -81,6 +82,29 @@ class CMap; // Forward
 typedef flag bit;
 typedef long KV;
 
+typedef struct _dirtyrect {
+  int x1, y1, x2, y2;
+} DIRTY;
+
+enum _recordtype {
+  recDot   = 0,
+  recBlock = 1,
+  recLine  = 2,
+  recKey   = 3,
+  recPatch = 4,
+};
+
+typedef struct _recordevent {
+  int x, y; // Pixel coordinates, or keyframe index for keyframe events
+  dword kv; // Color or patch keyframe index in low 24 bits, type in high byte
+} REC;
+
+typedef struct _componentstat {
+  lsize cPixel; // Number of pixels in the component
+  int x;        // First pixel of the component in raster order
+  int y;
+} CCS;
+
 typedef struct _graphicssettings {
   // Display settings
 
@@ -99,6 +123,24 @@ typedef struct _graphicssettings {
   int turtlet;
   int grfLifeDie;
   int grfLifeBorn;
+  long lLifeHash;
+  int nLifeHashMem;
+  flag fRecord;
+  int nRecordMem;
+
+  // Internal settings
+
+  int cDirty;
+  flag fDirtyAll;
+  DIRTY rgDirty[cDirtyMax];
+  CMap *bRecord;
+  REC *rgrec;
+  long crec;
+  long crecMax;
+  CMap **rgbKey;
+  int ckey;
+  int ckeyMax;
+  lsize cbKey;
 } GS;
 
 extern CONST int xoff[DIRS2], yoff[DIRS2], xoff2[DIRS2], yoff2[DIRS2];
@@ -106,6 +148,11 @@ extern CONST int rgfOr[3], rgfAnd[3], rgfXor[3];
 extern CONST int rgnDitherPoint[16];
 extern CONST int rggrfNeighbor[25];
 extern GS gs;
+extern void DirtyRect(int, int, int, int);
+extern void DirtyClear(void);
+extern void RecordEvent(int, int, int, int, int, KV);
+extern void RecordKey(void);
+extern void RecordPatch(int, int, int, int);
 
 class CMap // Base bitmap independent of pixel type
 {
@@ -119,36 +166,43 @@ public:
   int m_y3;    // 3D bitmap Y size
   int m_z3;    // 3D bitmap Z size
   byte *m_rgb; // Bytes of bitmap bits
+  uint m_cMod; // Times bitmap modified, for noticing it has changed
 
   INLINE CMap()
     { Init(); }
   INLINE ~CMap()
     { Free(); }
   INLINE void Init()
-    { m_x = m_y = 0; m_rgb = NULL; }
+    { m_x = m_y = 0; m_rgb = NULL; m_cMod = 0; }
   INLINE void Free()
-    { if (m_rgb != NULL) { DeallocateP(m_rgb); m_rgb = NULL; } }
-  INLINE dword *_Rgl(long i) CONST
+    { if (m_rgb != NULL) { DeallocateP(m_rgb); m_rgb = NULL; m_cMod++; } }
+  INLINE dword *_Rgl(lsize i) CONST
     { return (dword *)&m_rgb[i << 2]; }
   INLINE flag FVisible() CONST
     { return this == gs.bFocus; }
   INLINE void Copy3(CONST CMap &b)
     { m_w3 = b.m_w3; m_x3 = b.m_x3; m_y3 = b.m_y3; m_z3 = b.m_z3; }
+  INLINE void Dirty(int x1, int y1, int x2, int y2)
+    { m_cMod++; if (FVisible()) DirtyRect(x1, y1, x2, y2); }
+  INLINE void DirtyAll()
+    { m_cMod++; if (FVisible()) gs.fDirtyAll = fTrue;
+    if (this == gs.bRecord) RecordKey(); }
+  INLINE void Rec(int nType, int x1, int y1, int x2, int y2, KV kv) CONST
+    { if (this == gs.bRecord) RecordEvent(nType, x1, y1, x2, y2, kv); }
   INLINE void CopyFrom(CMap &b)
     { m_x = b.m_x; m_y = b.m_y; m_clRow = b.m_clRow; m_cfPix = b.m_cfPix;
-    Copy3(b); Free(); m_rgb = b.m_rgb; b.m_rgb = NULL; }
+    Copy3(b); Free(); m_rgb = b.m_rgb; b.m_rgb = NULL; DirtyAll(); }
   INLINE void SwapWith(CMap &b)
     { SwapN(m_x, b.m_x); SwapN(m_y, b.m_y); SwapN(m_clRow, b.m_clRow);
     SwapN(m_cfPix, b.m_cfPix); SwapN(m_w3, b.m_w3); SwapN(m_x3, b.m_x3);
     SwapN(m_y3, b.m_y3); SwapN(m_z3, b.m_z3);
-    byte *pT; pT = m_rgb; m_rgb = b.m_rgb; b.m_rgb = pT; }
+    byte *pT; pT = m_rgb; m_rgb = b.m_rgb; b.m_rgb = pT;
+    DirtyAll(); b.DirtyAll(); }
 
   INLINE flag FNull() CONST
     { return m_rgb == NULL; }
   INLINE flag FZero() CONST
     { return m_x < 1 || m_y < 1; }
-  INLINE flag F64K() CONST
-    { return m_x > 0xFFFF || m_y > 0xFFFF; }
   INLINE flag FLegal(int x, int y) CONST
     { return (uint)x < (uint)m_x && (uint)y < (uint)m_y; }
   INLINE flag FLegalOff(int x, int y) CONST
@@ -237,9 +291,9 @@ public:
 class CMon : virtual public CMap // Monochrome bitmap
 {
 public:
-  INLINE long _Il(int x, int y) CONST
-    { return y*m_clRow + (x >> 5); }
-  INLINE dword *_Pl(long i) CONST
+  INLINE lsize _Il(int x, int y) CONST
+    { return (lsize)y*m_clRow + (x >> 5); }
+  INLINE dword *_Pl(lsize i) CONST
     { return (dword *)&m_rgb[i << 2]; }
   INLINE dword *_Pl(int x, int y) CONST
     { return _Pl(_Il(x, y)); }
@@ -305,6 +359,7 @@ public:
   flag Turtle(CONST char *);
   flag FFillCore(int, int, KV, flag);
   long AnalyzePerimeter(int, int, flag) CONST;
+  lsize LabelComponents(bit, flag, lsize **, CCS **) CONST;
 
   flag FBitmapFind(int *, int *, bit) CONST;
   flag FBitmapSubset(CONST CMon &) CONST;
@@ -328,6 +383,7 @@ public:
   void BitmapSeen(int, int, int);
   flag FStereogram(CONST CMon &, int, int);
   long LifeGenerate(flag);
+  long LifeGenerateHash(long, flag);
 
   flag FReadBitmapCore(FILE *, int, int);
   void WriteBitmap(FILE *, KV, KV) CONST;
@@ -348,6 +404,10 @@ public:
 
 extern void UpdateDisplay(void);
 extern void ScreenDot(int, int, bit, KV);
+extern flag FRecordBegin(CMap &);
+extern void RecordEnd(void);
+extern void RecordFree(void);
+extern long RecordApply(CMap &, long, long);
 
 
 /*
@@ -366,6 +426,20 @@ extern void ScreenDot(int, int, bit, KV);
 ******************************************************************************
 */
 
+#define cScratchMap 4
+
+typedef struct _scratchmap {
+  CMap *rgpb[cScratchMap];  // Cached bitmaps, all of the same pixel type
+  flag rgfBusy[cScratchMap]; // Whether each bitmap is currently borrowed
+  long rglUse[cScratchMap];  // When each bitmap was last borrowed
+  long lUse;
+} SMAP;
+
+extern SMAP smapMon, smapCol;
+extern int IScratchBorrow(SMAP *, int, int, CONST CMap *);
+extern CMon *PbScratch(int, int, CONST CMap *);
+extern void ScratchMapDone(CMap *);
+extern void ScratchMapFree(void);
 extern flag FSetLife(CONST char *, int);
 
 
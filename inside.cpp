@@ -49,6 +49,106 @@
 #define IO(y) ((y) >> iScale)
 #define IP(y) ((y) << iScale)
 
+// Number of transposed texture copies and mipmap chains cached for the
+// inside view, and the most levels smaller than the texture in each chain.
+#define cTextureColumn 16
+#define cTextureMip 16
+#define cMipLevel 12
+
+typedef struct _texturecache {
+  int iTexture; // Texture this copy was made from, or 0 if none.
+  long lGen;    // Texture generation this copy was made from.
+  long lFrame;  // Frame this copy was last used during.
+} TEXTURECACHE;
+
+TEXTURECACHE rgtcColumn[cTextureColumn], rgtcMip[cTextureMip];
+CCol rgcTextureColumn[cTextureColumn], rgcTextureMip[cTextureMip][cMipLevel];
+int rgcMipLevel[cTextureMip];
+long lFrameInside = 0, cpixFrameInside;
+
+// Number of Maze bitmaps whose sizes the last inside frame remembers.
+#define cInsideMap 5
+
+// The last frame drawn by RedrawInsidePerspective, and what it was drawn
+// from, so redrawing when nothing has changed can just copy it.
+typedef struct _insideframe {
+  DR dr;            // Inside settings the frame was drawn with.
+  int x, y;         // Size of the bitmap the frame was drawn in.
+  int rgnMap[cInsideMap][6]; // Sizes and 3D dimensions of the Maze bitmaps.
+  flag fStar, fSkyAll, fStereo3D;
+  int cStar, nStarSize, nStereo, nTrans;
+  flag fPair;       // Whether the frame is a stereo pair of views.
+  long lStarColor;
+  long lTextureGen; // Texture generation the frame was drawn with.
+  ulong lMod;       // Modify count of the Maze bitmaps drawn from.
+  flag fView;       // Whether the fields above describe the last frame.
+  flag fFrame;      // Whether cFrameInside is a copy of the last frame.
+} INSIDEFRAME;
+
+INSIDEFRAME ifr;
+CCol cFrameInside;
+
+// Which eye of a stereo pair is being drawn, if any. Both eyes face the same
+// way from nearly the same spot, so they share the same background, which is
+// drawn once for the first eye and copied for the second.
+#define nEyeNone   0
+#define nEyeFirst  1
+#define nEyeSecond 2
+
+int nEyeInside = nEyeNone;
+CCol cBackInside;
+
+// Number of fog amount tables cached for floor and ceiling rows.
+#define cFogRow 16
+#define nFogRowNone (int)0x80000000
+
+typedef struct _fogrow {
+  int nScale;  // Fog scale this table was filled for.
+  int yb;      // Horizon row this table was filled for.
+  long lFrame; // Frame this table was filled during.
+} FOGROW;
+
+FOGROW rgfr[cFogRow];
+int *rgnFogRow = NULL, cnFogRow = 0;
+
+// Get the fog amount for a row, from its table entry if already computed.
+#define NFogRow(n, pn, y, nScale, yb) \
+  if ((pn) == NULL || (n = (pn)[y]) == nFogRowNone) { \
+    n = IO((nScale) / No0((y)-(yb))); \
+    if ((pn) != NULL) \
+      (pn)[y] = n; \
+  }
+
+// Layout of a sky texture across the bitmap. A sky texture is already a
+// panorama covering all directions, so each column of the sky just samples
+// the texture column for its direction, and each row the texture row for its
+// height. The row table only depends on where the sky is, and the column
+// angles only on the bitmap width and field of view, so both are kept between
+// frames, and turning just offsets the angles.
+typedef struct _skystrip {
+  int yTop, ySky; // Rows the sky covers that the row table was made for.
+  int y1, y2;     // Rows the sky is drawn over after clipping.
+  int cy;         // Number of rows in the row table.
+  int ySrc;       // Texture height the row table was made for.
+  int xAngle;     // Bitmap width the column angles were made for.
+  real dInside;   // Field of view the column angles were made for.
+} SKYSTRIP;
+
+SKYSTRIP ss;
+real *rgrSkyAngle = NULL;
+int *rgibSkyCol = NULL, *rgySkyRow = NULL, cySkyRow = 0;
+
+typedef struct _skydraw {
+  CMazK *c;          // Bitmap to draw the sky in.
+  CONST CMazK *cT;   // Sky texture.
+  int cstrip;
+} SKYDRAW;
+
+// Spread the three channels of a pixel into separate 16 bit lanes, so they
+// can all be blended with one multiply.
+#define QPixel(pb) \
+  ((qword)(pb)[0] | (qword)(pb)[1] << 16 | (qword)(pb)[2] << 32)
+
 #define LineITrans(yHi, yLo, kv, nTrans) \
   LineYTrans(c, x, IO(yHi), IO(yLo), kv, nTrans);
 
@@ -164,8 +264,9 @@ void LineYGradient(CMazK &c, int x, int y1, int y2, KV kv1, KV kv2)
 
 void LineYTrans(CMazK &c, int x, int y1, int y2, KV kv, int nTrans)
 {
-  byte *pb;
+  byte *pb, rgb[cbPixelC];
   int db, y, nR, nG, nB, nRT, nGT, nBT;
+  qword q, qKv;
 
   // Don't worry about pixels that are off the bitmap.
   if (y1 < 0)
@@ -189,9 +290,23 @@ void LineYTrans(CMazK &c, int x, int y1, int y2, KV kv, int nTrans)
       c._Set(pb, nR, nG, nB);
       pb += db;
     }
+  } else if (FBetween(nTrans, 0, 100)) {
+
+    // If semitransparent, blend color with what's already in place. Each
+    // channel becomes (old * t + kv * (128 - t)) >> 7, which is the same as
+    // kv + ((old - kv) * t >> 7). No channel can exceed 255 * 128, so all
+    // three are blended at once in separate 16 bit lanes of a 64 bit number.
+    nTrans = nTrans * 128 / 100;
+    c._Set(rgb, nR, nG, nB);
+    qKv = QPixel(rgb) * (128 - nTrans);
+    for (y = y1; y < y2; y++) {
+      q = (QPixel(pb) * nTrans + qKv) >> 7;
+      pb[0] = (byte)q; pb[1] = (byte)(q >> 16); pb[2] = (byte)(q >> 32);
+      pb += db;
+    }
   } else {
 
-    // If semitransparent, blend color with what's already in place.
+    // Blend the slow way if the proportion can overflow the lanes above.
     nTrans = nTrans * 128 / 100;
     for (y = y1; y < y2; y++) {
       c._Get(pb, &nRT, &nGT, &nBT);
@@ -206,11 +321,12 @@ void LineYTrans(CMazK &c, int x, int y1, int y2, KV kv, int nTrans)
 
 
 // Draw a texture mapped vertical line on a color bitmap. Used for drawing
-// walls in inside display modes.
+// walls in inside display modes. If pcSrcT is set, it's a transposed copy of
+// the texture, which is read from instead.
 
 void LineYTexture(
   CMazK &cDst, int xDst, int yDst1, int yDst2, int yClip1, int yClip2,
-  CMazK &cSrc, int xSrc, int ySrc1, int ySrc2,
+  CMazK &cSrc, CCol *pcSrcT, int xSrc, int ySrc1, int ySrc2,
   int nTrans, KV kvFog, int nFog, KV kvWall)
 {
   int dyDst = yDst2 - yDst1, dySrc = ySrc2 - ySrc1, dbDst, dbSrc,
@@ -229,9 +345,14 @@ void LineYTexture(
     y2 = dr.yElevMax;
 
   pbDst = cDst._Pb(xDst, y1);
-  pbBase = cSrc._Pb(xSrc, 0);
   dbDst = cDst.m_clRow << 2;
-  dbSrc = cSrc.m_clRow << 2;
+  if (pcSrcT != NULL) {
+    pbBase = pcSrcT->_Pb(0, xSrc);
+    dbSrc = cbPixelC;
+  } else {
+    pbBase = cSrc._Pb(xSrc, 0);
+    dbSrc = cSrc.m_clRow << 2;
+  }
   if (dyDst == 0)
     dyDst = 1;
   yT = (y1 - yDst1) * dySrc;
@@ -395,16 +516,16 @@ void LineYTexture(
 
 // Draw a texture map overlaying a vertical line on a color bitmap. The
 // overlay shape comes from a monochrome bitmap, where optional coloring comes
-// from another color bitmap.
+// from another color bitmap, or from its transposed copy pcSrcT if set.
 
 void LineYMask(
   CMazK &cDst, int xDst, int yDst1, int yDst2, int yClip1, int yClip2,
-  CMaz *b, CMazK *cSrc, int xSrc, int ySrc1, int ySrc2,
+  CMaz *b, CMazK *cSrc, CCol *pcSrcT, int xSrc, int ySrc1, int ySrc2,
   KV kvFog, int nFog, flag fSet)
 {
-  int dyDst = yDst2 - yDst1, dySrc = ySrc2 - ySrc1, db,
+  int dyDst = yDst2 - yDst1, dySrc = ySrc2 - ySrc1, db, dbSrc,
     y1 = yClip1, y2 = yClip2, y, yT, dy, nRF, nGF, nBF, nR, nG, nB;
-  byte *pbDst, *pbSrc;
+  byte *pbDst, *pbSrc, *pbBase;
 
   // Don't worry about pixels that are off the bitmap.
   if (y1 < 0)
@@ -427,6 +548,13 @@ void LineYMask(
   if (yT < 0)
     return;
   dy = (dySrc << 16) / dyDst;
+  if (pcSrcT != NULL) {
+    pbBase = pcSrcT->_Pb(0, xSrc);
+    dbSrc = cbPixelC;
+  } else if (cSrc != NULL) {
+    pbBase = cSrc->_Pb(xSrc, 0);
+    dbSrc = cSrc->m_clRow << 2;
+  }
   if (cSrc == NULL) {
 
     // Draw either black or white pixels on top of what's already present.
@@ -450,7 +578,7 @@ void LineYMask(
       // Draw a color mask from a texture on top of what's already present.
       for (y = y1; y < y2; y++) {
         if (b->_Get(xSrc, yT >> 16) == fSet) {
-          pbSrc = cSrc->_Pb(xSrc, yT >> 16);
+          pbSrc = pbBase + (yT >> 16) * dbSrc;
           cSrc->_Get(pbSrc, &nR, &nG, &nB);
           cDst._Set(pbDst, nR, nG, nB);
         }
@@ -464,7 +592,7 @@ void LineYMask(
       nRF = RgbR(kvFog); nGF = RgbG(kvFog); nBF = RgbB(kvFog);
       for (y = y1; y < y2; y++) {
         if (b->_Get(xSrc, yT >> 16) == fSet) {
-          pbSrc = cSrc->_Pb(xSrc, yT >> 16);
+          pbSrc = pbBase + (yT >> 16) * dbSrc;
           cSrc->_Get(pbSrc, &nR, &nG, &nB);
           nR += ((nRF - nR) * nFog >> 7);
           nG += ((nGF - nG) * nFog >> 7);
@@ -479,6 +607,55 @@ void LineYMask(
 }
 
 
+// Return the table of fog amounts for floor or ceiling pixels in each row, for
+// a fog scale and horizon. Fog only depends on the row and not the column, so
+// all columns in a frame share a table, which is filled in as rows are used.
+// There's one fog scale per floor elevation, so keep a few tables around.
+// Variable height walls can have more elevations in view than there are
+// tables, and filling a table costs a pass over every row, so once all tables
+// are in use this frame, return NULL and let the caller compute fog directly.
+// Also return NULL if no table can be allocated.
+
+int *PnFogRow(int nScale, int yb, int cy)
+{
+  FOGROW *pfr;
+  int ifr, i;
+
+  for (ifr = 0; ifr < cFogRow; ifr++) {
+    pfr = &rgfr[ifr];
+    if (pfr->lFrame == lFrameInside && pfr->nScale == nScale &&
+      pfr->yb == yb)
+      return &rgnFogRow[ifr * cnFogRow];
+  }
+
+  // Make sure there's enough room for each table to cover the bitmap.
+  if (cy > cnFogRow) {
+    if (rgnFogRow != NULL)
+      DeallocateP(rgnFogRow);
+    rgnFogRow = RgAllocate(cFogRow * cy, int);
+    if (rgnFogRow == NULL) {
+      cnFogRow = 0;
+      return NULL;
+    }
+    cnFogRow = cy;
+    for (ifr = 0; ifr < cFogRow; ifr++)
+      rgfr[ifr].lFrame = 0;
+  }
+
+  // Reuse a table not filled this frame, and mark all its rows unknown.
+  for (ifr = 0; ifr < cFogRow; ifr++)
+    if (rgfr[ifr].lFrame != lFrameInside)
+      break;
+  if (ifr >= cFogRow)
+    return NULL;
+  pfr = &rgfr[ifr];
+  pfr->nScale = nScale; pfr->yb = yb; pfr->lFrame = lFrameInside;
+  for (i = 0; i < cnFogRow; i++)
+    rgnFogRow[ifr * cnFogRow + i] = nFogRowNone;
+  return &rgnFogRow[ifr * cnFogRow];
+}
+
+
 // Draw a variable color vertical line on a color bitmap. Used for drawing
 // floor markings in inside display modes.
 
@@ -486,7 +663,7 @@ void LineYFloor(CMazK &c, int x, int yb, int dy1, int dy2,
   KV kv, int nTrans, flag fFog, real rScale)
 {
   byte *pb;
-  int y1 = yb + dy1, y2 = yb + dy2, db, y, n,
+  int y1 = yb + dy1, y2 = yb + dy2, db, y, n, nScale, *pn,
     nRF, nGF, nBF, nR, nG, nB, nRT, nGT, nBT, nRO, nGO, nBO;
 
   // Don't worry about pixels that are off the bitmap.
@@ -517,9 +694,10 @@ void LineYFloor(CMazK &c, int x, int yb, int dy1, int dy2,
       // If fog, blend each pixel with the fog color based on its distance.
       nRF = RgbR(dr.kvInFog); nGF = RgbG(dr.kvInFog); nBF = RgbB(dr.kvInFog);
       rScale = rScale / (real)(dr.nFog * 10) * (dy1 >= 0 ? 128.0 : -128.0);
+      nScale = (int)rScale;
+      pn = PnFogRow(nScale, yb, c.m_y);
       for (y = y1; y < y2; y++) {
-        n = y-yb;
-        n = IO((int)rScale / No0(n));
+        NFogRow(n, pn, y, nScale, yb);
         if ((uint)n < 128) {
           nRT = nR + ((nRF - nR) * n >> 7);
           nGT = nG + ((nGF - nG) * n >> 7);
@@ -548,9 +726,10 @@ void LineYFloor(CMazK &c, int x, int yb, int dy1, int dy2,
       // If fog semitransparent, blend with the fog color based on distance.
       nRF = RgbR(dr.kvInFog); nGF = RgbG(dr.kvInFog); nBF = RgbB(dr.kvInFog);
       rScale = rScale / (real)(dr.nFog * 10) * (dy1 >= 0 ? 128.0 : -128.0);
+      nScale = (int)rScale;
+      pn = PnFogRow(nScale, yb, c.m_y);
       for (y = y1; y < y2; y++) {
-        n = y-yb;
-        n = IO((int)rScale / No0(n));
+        NFogRow(n, pn, y, nScale, yb);
         if ((uint)n < 128) {
           nRT = nR + ((nRF - nR) * n >> 7);
           nGT = nG + ((nGF - nG) * n >> 7);
@@ -579,7 +758,7 @@ void LineYFloorTexture(CMazK &cDst, int x, int yb, int dy1, int dy2,
 {
   byte *pb, *pbT;
   int y1 = yb + IO(dy1), y2 = yb + IO(dy2), y, db, n, xT, yT, xMax, yMax,
-    nRF, nGF, nBF, nR, nG, nB, nRT, nGT, nBT;
+    nScale, *pn = NULL, nRF, nGF, nBF, nR, nG, nB, nRT, nGT, nBT;
   real rScaleFog, dm, dn, rd1, rd2, rdd, rdy1, rddy, rdy, rdyCur, rdyInc, rT;
   flag fNoFog = !fFog || dr.nFog <= 0 || !dr.fFogFloor;
 
@@ -620,12 +799,13 @@ void LineYFloorTexture(CMazK &cDst, int x, int yb, int dy1, int dy2,
   if (!fNoFog) {
     nRF = RgbR(dr.kvInFog); nGF = RgbG(dr.kvInFog); nBF = RgbB(dr.kvInFog);
     rScaleFog = rScale / (real)(dr.nFog * 10) * (dy1 >= 0 ? 128.0 : -128.0);
+    nScale = (int)rScaleFog;
   }
   if (cSrc == NULL) {
     nR = nG = nB = fSet * 255;
     if (!fNoFog) {
       n = y2-yb;
-      n = IO((int)rScaleFog / No0(n));
+      n = IO(nScale / No0(n));
       if ((uint)n < 128) {
         nR += ((nRF - nR) * n >> 7);
         nG += ((nGF - nG) * n >> 7);
@@ -639,6 +819,8 @@ void LineYFloorTexture(CMazK &cDst, int x, int yb, int dy1, int dy2,
   }
   if (!dr.fTextureBlend)
     fTrans = fFalse;
+  if (!fNoFog)
+    pn = PnFogRow(nScale, yb, cDst.m_y);
 
   // Texture mapping floors is more complicated than walls. For floors the
   // vertical line crosses the texture at an oblique angle, requiring
@@ -674,8 +856,7 @@ void LineYFloorTexture(CMazK &cDst, int x, int yb, int dy1, int dy2,
     if (fNoFog)
       cDst._Set(pb, nR, nG, nB);
     else {
-      n = y-yb;
-      n = IO((int)rScaleFog / No0(n));
+      NFogRow(n, pn, y, nScale, yb);
       if ((uint)n < 128) {
         nRT = nR + ((nRF - nR) * n >> 7);
         nGT = nG + ((nGF - nG) * n >> 7);
@@ -1179,6 +1360,7 @@ flag FMoveCloud(int iCloud, int x)
       dx = x0 + NMultDiv(icld - icldLo, x, 16384);
     is = icld * csCld;
     dr.rgcld[is] = dr.rgcld[is] - dx & 16383;
+    ifr.fView = ifr.fFrame = fFalse;
   }
   return fTrue;
 }
@@ -1207,6 +1389,17 @@ void ResetInside()
   FCreateInsideStars(NULL, 0.0, 0, fFalse);
   FCreateInsideMountains(NULL, 0.0, 0);
   FCreateInsideClouds(NULL, 0.0, 0);
+  ifr.fView = ifr.fFrame = fFalse;
+}
+
+
+// Forget the last perspective inside frame drawn, so the next one is drawn
+// from scratch. Called when something the frame depends on changes in a way
+// FInsideViewSame() can't notice, such as editing a star.
+
+void ResetInsideFrame()
+{
+  ifr.fView = ifr.fFrame = fFalse;
 }
 
 
@@ -1283,14 +1476,143 @@ void FormatTimer(char sz[cchSzDef], ulong lTimer, ulong lTimer2)
 }
 
 
+// Thread routine for FDrawSkyTexture. Each thread copies a strip of the sky
+// rows, gathering each row's pixels from the texture row for that height.
+
+void SkyTextureThread(void *pv, int is)
+{
+  SKYDRAW *psd = (SKYDRAW *)pv;
+  int xmax = psd->c->m_x, x, y, ylo, yhi;
+  byte *pbDst, *pbSrc, *pbT;
+
+  ylo = (int)((long)ss.cy * is / psd->cstrip);
+  yhi = (int)((long)ss.cy * (is+1) / psd->cstrip);
+  for (y = ylo; y < yhi; y++) {
+    pbDst = psd->c->_Pb(0, ss.y1 + y);
+    pbSrc = psd->cT->_Pb(0, rgySkyRow[y]);
+    for (x = 0; x < xmax; x++) {
+      pbT = pbSrc + rgibSkyCol[x];
+      pbDst[0] = pbT[0]; pbDst[1] = pbT[1]; pbDst[2] = pbT[2];
+      pbDst += cbPixelC;
+    }
+  }
+}
+
+
+// Draw a sky texture over the rows of the inside view the sky covers, facing
+// the given direction. This draws the same pixels as calling LineYTexture on
+// each column, but a row at a time across all columns, split among threads.
+
+flag FDrawSkyTexture(CMazK &c, CONST CMazK &cT, real rd, int yTop, int ySky)
+{
+  SKYDRAW sd;
+  real rx, rT;
+  int x, y1, y2, xSrc1, xSrc2, xDst, xT, dyDst, yT, dy;
+
+  // Nothing is drawn in a single column bitmap, since each column is drawn
+  // once the next column's texture column is known.
+  if (c.m_x < 2)
+    return fTrue;
+
+  // Get the angle of each column from the center, if the width or field of
+  // view has changed.
+  if (ss.xAngle != c.m_x || ss.dInside != dr.dInside) {
+    if (rgrSkyAngle != NULL) {
+      DeallocateP(rgrSkyAngle);
+      DeallocateP(rgibSkyCol);
+    }
+    rgrSkyAngle = RgAllocate(c.m_x, real);
+    rgibSkyCol = RgAllocate(c.m_x, int);
+    if (rgrSkyAngle == NULL || rgibSkyCol == NULL) {
+      if (rgrSkyAngle != NULL)
+        DeallocateP(rgrSkyAngle);
+      if (rgibSkyCol != NULL)
+        DeallocateP(rgibSkyCol);
+      rgrSkyAngle = NULL; rgibSkyCol = NULL;
+      ss.xAngle = 0;
+      return fFalse;
+    }
+    rT = RTanD(dr.dInside);
+    for (x = 0; x < c.m_x; x++) {
+      rx = (real)(x << 1) / (real)c.m_x - 1.0;
+      rgrSkyAngle[x] = RAtnD(rx * rT);
+    }
+    ss.xAngle = c.m_x; ss.dInside = dr.dInside;
+  }
+
+  // Get the texture row for each sky row, if where the sky is has changed.
+  // Rows advance through the texture in the same fixed point steps as
+  // LineYTexture, clipped to the bitmap the same way.
+  y1 = Max(yTop, 0); y2 = Min(yTop + ySky, c.m_y);
+  if (y1 < dr.yElevMin)
+    y1 = dr.yElevMin;
+  if (y2 > dr.yElevMax)
+    y2 = dr.yElevMax;
+  if (ss.yTop != yTop || ss.ySky != ySky || ss.y1 != y1 || ss.y2 != y2 ||
+    ss.ySrc != cT.m_y) {
+    ss.yTop = yTop; ss.ySky = ySky; ss.y1 = y1; ss.y2 = y2; ss.ySrc = cT.m_y;
+    ss.cy = 0;
+    if (y2 - y1 > cySkyRow) {
+      if (rgySkyRow != NULL)
+        DeallocateP(rgySkyRow);
+      rgySkyRow = RgAllocate(y2 - y1, int);
+      if (rgySkyRow == NULL) {
+        cySkyRow = 0;
+        ss.ySrc = 0;
+        return fFalse;
+      }
+      cySkyRow = y2 - y1;
+    }
+    dyDst = ySky != 0 ? ySky : 1;
+    yT = (y1 - yTop) * cT.m_y;
+    if (y2 > y1 && (yT << 10) >> 10 == yT) {
+      yT = (yT << 10) / dyDst << 6;
+      dy = (cT.m_y << 16) / dyDst;
+      if (yT >= 0)
+        for (; ss.cy < y2 - y1; ss.cy++) {
+          rgySkyRow[ss.cy] = yT >> 16;
+          yT += dy;
+        }
+    }
+  }
+  if (ss.cy <= 0)
+    return fTrue;
+
+  // Get the texture column for each column, facing the current direction.
+  // Columns are assigned in runs the same way they used to be drawn.
+  xDst = xSrc1 = 0;
+  for (x = 0; x < c.m_x; x++) {
+    rx = rd - rgrSkyAngle[x];
+    if (rx < 0)
+      rx += rDegMax;
+    else if (rx >= rDegMax)
+      rx -= rDegMax;
+    xSrc2 = cT.m_x - 1 - (int)(rx * (real)cT.m_x / rDegMax);
+    if (xSrc2 != xSrc1 || x == c.m_x-1) {
+      if (x > 0) {
+        for (xT = xDst; xT <= x; xT++)
+          rgibSkyCol[xT] = xSrc1 * cbPixelC;
+        xDst = x+1;
+      }
+      xSrc1 = xSrc2;
+    }
+  }
+
+  sd.c = &c; sd.cT = &cT;
+  sd.cstrip = Min(CThread(), Max((long)c.m_x * ss.cy >> 16, 1));
+  EnsureBetween(sd.cstrip, 1, ss.cy);
+  RunThreads(SkyTextureThread, &sd, sd.cstrip);
+  return fTrue;
+}
+
+
 // Do all background drawing, i.e. all things the actual walls are later drawn
 // on top of, for the inside display mode.
 
 void DrawBackground(CMazK &c, flag f3D, real rd, int yb)
 {
   CMazK *cT;
-  real rx, rT;
-  int x, y, xSrc1, xSrc2, xDst, iTexture, xT, yT;
+  int y, iTexture, yT;
   KV kvSky = f3D && dr.z > 0 ? dr.kvInCeil : dr.kvInSky,
     kvSky2 = f3D && dr.z > 0 ? dr.kvInCeil2 : dr.kvInSky2;
 
@@ -1319,32 +1641,11 @@ void DrawBackground(CMazK &c, flag f3D, real rd, int yb)
   // Do texture mapping over both the sky and ground part of the screen.
   if (dr.fTexture && (dr.nTexture > 0 || dr.nTexture2 > 0)) {
     iTexture = !f3D || dr.z <= 0 || dr.fSky3D ? dr.nTexture : dr.nTexture2;
-    cT = ColmapGetTexture(iTexture);
-    if (iTexture > 0 && cT != NULL && !cT->FNull()) {
-      yb -= c.m_y >> 1;
-      rT = RTanD(dr.dInside);
-      yT = c.m_y >> (int)!ds.fSkyAll;
-      xDst = xSrc1 = 0;
-      for (x = 0; x < c.m_x; x++) {
-        rx = (real)(x << 1) / (real)c.m_x - 1.0;
-        rx = rd - RAtnD(rx * rT);
-        if (rx < 0)
-          rx += rDegMax;
-        else if (rx >= rDegMax)
-          rx -= rDegMax;
-        xSrc2 = cT->m_x - 1 - (int)(rx * (real)cT->m_x / rDegMax);
-        if (xSrc2 != xSrc1 || x == c.m_x-1) {
-          if (x > 0) {
-            for (xT = xDst; xT <= x; xT++)
-              LineYTexture(c, xT, yb, yb + yT, yb, yb + yT,
-                *cT, xSrc1, 0, cT->m_y, 0, kvBlack, 0, ~0);
-            xDst = x+1;
-          }
-          xSrc1 = xSrc2;
-        }
-      }
-      yb += c.m_y >> 1;
-    }
+    cT = iTexture > 0 && iTexture < ws.ccTexture ? &ws.rgcTexture[iTexture] :
+      NULL;
+    if (cT != NULL && !cT->FNull())
+      FDrawSkyTexture(c, *cT, rd, yb - (c.m_y >> 1),
+        c.m_y >> (int)!ds.fSkyAll);
   }
 
   // Normally only do the outside things for 2D Mazes or the top level of 3D
@@ -1592,6 +1893,136 @@ LDone:
 }
 
 
+// Return whether a slot in one of the texture copy caches holds an up to
+// date copy of a texture, marking it used this frame if so.
+
+flag FTextureCacheHit(TEXTURECACHE *ptc, int iTexture)
+{
+  if (ptc->iTexture != iTexture || ptc->lGen != ws.lTextureGen)
+    return fFalse;
+  ptc->lFrame = lFrameInside;
+  return fTrue;
+}
+
+
+// Take over a slot in one of the texture copy caches for a new copy of a
+// texture. Don't evict a different texture already used this frame, since
+// walls alternating between the two would copy each over and over again.
+
+flag FTextureCacheClaim(TEXTURECACHE *ptc, int iTexture)
+{
+  if (ptc->iTexture > 0 && ptc->lFrame == lFrameInside)
+    return fFalse;
+  ptc->iTexture = iTexture;
+  ptc->lGen = ws.lTextureGen;
+  ptc->lFrame = lFrameInside;
+  return fTrue;
+}
+
+
+// Return a transposed copy of a color texture, in which each column of the
+// texture is contiguous in memory, so walls can sample down it without
+// touching a new cache line for each pixel. Copies are kept until textures
+// change. Return NULL if the texture should be read directly, which is the
+// case if copying it would cost more than is saved, i.e. if it isn't small
+// compared to the frame.
+
+CCol *PcTextureColumn(int iTexture)
+{
+  CMazK &cT = ws.rgcTexture[iTexture];
+  int i = iTexture & (cTextureColumn-1);
+  CCol &c = rgcTextureColumn[i];
+
+  if (FTextureCacheHit(&rgtcColumn[i], iTexture))
+    return &c;
+  if ((long)cT.m_x * cT.m_y * 2 >= cpixFrameInside)
+    return NULL;
+  if (!FTextureCacheClaim(&rgtcColumn[i], iTexture))
+    return NULL;
+  if (!c.FBitmapSizeSet(cT.m_y, cT.m_x)) {
+    rgtcColumn[i].iTexture = 0;
+    return NULL;
+  }
+  cT.ColmapTransposeTo(c);
+  return &c;
+}
+
+
+// Return the given level of a color texture's mipmap chain, where each level
+// is half the size of the one before, and level 0 is the texture itself.
+// Distant walls sample from smaller levels, which averages texels that would
+// otherwise be skipped over, so they don't shimmer as the view moves, and
+// keeps the texels read close together in memory. Like PcTextureColumn,
+// levels are stored transposed. Levels are made as they're first needed.
+// Return NULL if the level can't be made.
+
+CCol *PcTextureMip(int iTexture, int iLevel)
+{
+  CCol *pcPrev, *pc;
+  int i = iTexture & (cTextureMip-1), iT;
+
+  if (!FTextureCacheHit(&rgtcMip[i], iTexture)) {
+    if (!FTextureCacheClaim(&rgtcMip[i], iTexture))
+      return NULL;
+    rgcMipLevel[i] = 0;
+  }
+
+  // Make any levels between the smallest already made and this one.
+  for (iT = rgcMipLevel[i]; iT < iLevel; iT++) {
+    pcPrev = iT <= 0 ? &ws.rgcTexture[iTexture] : &rgcTextureMip[i][iT-1];
+    pc = &rgcTextureMip[i][iT];
+    if (!(iT <= 0 ?
+      pc->FBitmapSizeSet(Max(pcPrev->m_y >> 1, 1), Max(pcPrev->m_x >> 1, 1)) :
+      pc->FBitmapSizeSet(Max(pcPrev->m_x >> 1, 1), Max(pcPrev->m_y >> 1, 1))))
+      return NULL;
+    pcPrev->ColmapHalveTo(*pc, iT <= 0);
+    rgcMipLevel[i] = iT+1;
+  }
+  return &rgcTextureMip[i][iLevel-1];
+}
+
+
+// Free the texture copies and fog tables used by the inside view.
+
+void InsideCacheFree()
+{
+  int i, j;
+
+  for (i = 0; i < cTextureColumn; i++) {
+    rgcTextureColumn[i].Free();
+    rgtcColumn[i].iTexture = 0;
+  }
+  for (i = 0; i < cTextureMip; i++) {
+    for (j = 0; j < cMipLevel; j++)
+      rgcTextureMip[i][j].Free();
+    rgtcMip[i].iTexture = 0;
+    rgcMipLevel[i] = 0;
+  }
+  if (rgnFogRow != NULL) {
+    DeallocateP(rgnFogRow);
+    rgnFogRow = NULL;
+  }
+  cnFogRow = 0;
+  for (i = 0; i < cFogRow; i++)
+    rgfr[i].lFrame = 0;
+  if (rgrSkyAngle != NULL) {
+    DeallocateP(rgrSkyAngle);
+    DeallocateP(rgibSkyCol);
+    rgrSkyAngle = NULL;
+    rgibSkyCol = NULL;
+  }
+  if (rgySkyRow != NULL) {
+    DeallocateP(rgySkyRow);
+    rgySkyRow = NULL;
+  }
+  cySkyRow = 0;
+  ss.xAngle = ss.ySrc = 0;
+  cFrameInside.Free();
+  cBackInside.Free();
+  ifr.fView = ifr.fFrame = fFalse;
+}
+
+
 // Draw a texture at the given column. For solid color textures, this
 // completely covers whatever solid wall color would otherwise be present. For
 // textures overlays, this is done on top of whatever solid wall color is
@@ -1602,7 +2033,8 @@ void DrawTexture(CMazK &c, int x, int y, int y2, int yk, int yb, int iTexture,
 {
   CMaz *bT;
   CMazK *cT;
-  int xTexture, yDst1, yDst2, yClip1, yClip2;
+  CCol *pcT = NULL;
+  int xTexture, ySrc, yDst1, yDst2, yClip1, yClip2, iLevel;
 
   // Figure out the pixel offset within the texture bitmaps. Color bitmap
   // only: Solid texture. Monochrome bitmap only: Black or white overlay on
@@ -1635,14 +2067,31 @@ void DrawTexture(CMazK &c, int x, int y, int y2, int yk, int yb, int iTexture,
     yClip1 = IO(yb-Min(-y2, y+yk*2)+iRound); yClip2 = yDst2;
   }
 
+  // For solid textures, if the wall is shorter than the texture, sample from
+  // the smallest mipmap level that still has at least one texel per pixel.
+  if (iTexture > 0) {
+    iLevel = 0;
+    if (dr.fTextureMip && iMask == 0)
+      while (iLevel < cMipLevel &&
+        (cT->m_y >> (iLevel+1)) >= yDst2 - yDst1 && cT->m_y >> iLevel > 1)
+        iLevel++;
+    pcT = iLevel > 0 ? PcTextureMip(iTexture, iLevel) : NULL;
+    if (pcT != NULL) {
+      xTexture = (int)((real)pcT->m_y * rTexture);
+      if (xTexture >= pcT->m_y)
+        xTexture = pcT->m_y-1;
+    } else
+      pcT = PcTextureColumn(iTexture);
+  }
+  ySrc = pcT != NULL ? pcT->m_x : (cT != NULL ? cT->m_y : bT->m_y);
+
   // Go draw the solid texture map or texture overlay.
   if (iTexture > 0 && iMask == 0)
     LineYTexture(c, x, yDst1, yDst2, yClip1, yClip2,
-      *cT, xTexture, 0, cT->m_y, nTrans, dr.kvInFog, nFog, kv);
+      *cT, pcT, xTexture, 0, ySrc, nTrans, dr.kvInFog, nFog, kv);
   else
     LineYMask(c, x, yDst1, yDst2, yClip1, yClip2,
-      bT, cT, xTexture, 0, cT != NULL ? cT->m_y : bT->m_y, dr.kvInFog, nFog,
-      fMaskSet);
+      bT, cT, pcT, xTexture, 0, ySrc, dr.kvInFog, nFog, fMaskSet);
 }
 
 
@@ -1920,7 +2369,7 @@ void DrawTransVar(CMazK &c, int x, int yb, int cTrans, TRANS *trans,
 // where it doesn't matter how many polygons the array contains. The classic
 // PC games Wolfenstein 3D and DOOM do similar "one dimensional ray tracing".
 
-flag RedrawInsidePerspective(CMazK &c)
+flag FDrawInsidePerspective(CMazK &c)
 {
   // Main variables for standard walls.
   KV kvWall, kv1, kv1Old, kv2, kv2Old;
@@ -1981,6 +2430,7 @@ flag RedrawInsidePerspective(CMazK &c)
   real zdElev, rTextureElev;
 
   // Prepare the bitmap for drawing.
+  c.DirtyAll();
   rT = RTanD(dr.dInside); rd = (real)xc / rT;
   if (c.m_x != dr.xCalc || rd != dr.rdCalc) {
     if (c.m_x > dr.ccalc) {
@@ -2056,8 +2506,21 @@ flag RedrawInsidePerspective(CMazK &c)
     dr.nTransPct2 = dr.nTransPct * 4 / 5;
   }
 
+  // Start a new frame for the transposed texture copies. The second eye of a
+  // stereo pair is part of the same frame, so shares fog tables too.
+  if (nEyeInside != nEyeSecond)
+    lFrameInside++;
+  cpixFrameInside = (long)c.m_x * c.m_y;
+
   // Clear the bitmap and draw all background stuff behind the walls.
-  DrawBackground(c, f3D, zl, yb);
+  if (nEyeInside == nEyeSecond && cBackInside.m_x == c.m_x &&
+    cBackInside.m_y == c.m_y)
+    c.FBitmapCopy(cBackInside);
+  else {
+    DrawBackground(c, f3D, zl, yb);
+    if (nEyeInside == nEyeFirst && !cBackInside.FBitmapCopy(c))
+      cBackInside.Free();
+  }
 
   // If the dot is located within a solid floor or wall, or semitransparent
   // wall, draw or prepare to draw later over the whole bitmap.
@@ -2708,18 +3171,171 @@ LNext:
 }
 
 
+// Return whether the perspective inside view about to be drawn in a bitmap
+// is from the same place, with the same settings and textures, as the last
+// one drawn. Also remember the view for comparing against next time.
+
+flag FInsideViewSame(CONST CMazK &c, flag fPair)
+{
+  INSIDEFRAME ifrNew;
+  CONST CMap *rgpb[cInsideMap] = {&bm.b, &bm.b2, &bm.b3, &bm.k, &bm.k2};
+  int cb = (int)((byte *)&dr.fInSmooth - (byte *)&dr), i;
+
+  // Meteors are drawn at random each time, so such views are never the same.
+  if (ds.fStar && dr.nMeteor > 0) {
+    ifr.fView = ifr.fFrame = fFalse;
+    return fFalse;
+  }
+  CopyRgb((char *)&dr, (char *)&ifrNew.dr, cb);
+  ifrNew.x = c.m_x; ifrNew.y = c.m_y;
+
+  // Bitmaps can be resized in place, or given new 3D dimensions, without
+  // their modify counts changing, so compare their sizes too.
+  for (i = 0; i < cInsideMap; i++) {
+    ifrNew.rgnMap[i][0] = rgpb[i]->m_x;  ifrNew.rgnMap[i][1] = rgpb[i]->m_y;
+    ifrNew.rgnMap[i][2] = rgpb[i]->m_w3; ifrNew.rgnMap[i][3] = rgpb[i]->m_x3;
+    ifrNew.rgnMap[i][4] = rgpb[i]->m_y3; ifrNew.rgnMap[i][5] = rgpb[i]->m_z3;
+  }
+  ifrNew.fStar = ds.fStar; ifrNew.fSkyAll = ds.fSkyAll;
+  ifrNew.fStereo3D = ds.fStereo3D;
+  ifrNew.cStar = ds.cStar; ifrNew.nStarSize = ds.nStarSize;
+  ifrNew.nStereo = ds.nStereo; ifrNew.nTrans = ds.nTrans;
+  ifrNew.lStarColor = ds.lStarColor;
+  ifrNew.lTextureGen = ws.lTextureGen;
+  ifrNew.fPair = fPair;
+  if (ifr.fView && FEqualRgb((char *)&dr, (char *)&ifr.dr, cb) &&
+    ifrNew.x == ifr.x && ifrNew.y == ifr.y &&
+    FEqualRgb((char *)ifrNew.rgnMap, (char *)ifr.rgnMap,
+      sizeof(ifr.rgnMap)) &&
+    ifrNew.fStar == ifr.fStar && ifrNew.fSkyAll == ifr.fSkyAll &&
+    ifrNew.fStereo3D == ifr.fStereo3D && ifrNew.cStar == ifr.cStar &&
+    ifrNew.nStarSize == ifr.nStarSize && ifrNew.nStereo == ifr.nStereo &&
+    ifrNew.nTrans == ifr.nTrans && ifrNew.lStarColor == ifr.lStarColor &&
+    ifrNew.lTextureGen == ifr.lTextureGen && ifrNew.fPair == ifr.fPair)
+    return fTrue;
+
+  // The view has changed, so the saved frame is no longer of any use.
+  CopyRgb((char *)&ifrNew, (char *)&ifr, sizeof(INSIDEFRAME));
+  ifr.fView = fTrue;
+  ifr.fFrame = fFalse;
+  return fFalse;
+}
+
+
+// Return the total number of times the Maze bitmaps and masks the inside
+// view is drawn from have been modified. Any edit to them changes this.
+
+ulong LInsideMod()
+{
+  ulong l;
+  int i;
+
+  l = (ulong)bm.b.m_cMod + bm.b2.m_cMod + bm.b3.m_cMod + bm.k.m_cMod +
+    bm.k2.m_cMod;
+  for (i = 0; i < ws.cbMask; i++)
+    l += ws.rgbMask[i].m_cMod;
+  return l;
+}
+
+
+// Remember a perspective inside view just drawn in a bitmap. The second time
+// the same view is drawn, save a copy of it.
+
+void InsideFrameSave(CONST CMazK &c, flag fSame, ulong lMod)
+{
+  if (fSame && !ifr.fFrame) {
+    ifr.fFrame = cFrameInside.FBitmapCopy(c);
+    ifr.lMod = lMod;
+  } else if (fSame && lMod != ifr.lMod)
+    ifr.fFrame = fFalse;
+}
+
+
+// Draw the 3D first person perspective inside view in a bitmap. Displays
+// often redraw without anything having changed, e.g. to update the overlay
+// map or text on top of the view, or in screen saver like setups that just
+// sit there. So when the view, settings, textures, and Maze bitmaps are all
+// the same as the last two times, copy the saved last frame instead.
+
+flag RedrawInsidePerspective(CMazK &c)
+{
+  ulong lMod = 0;
+  flag fSame, fRet;
+  PROFT pt;
+
+  ProfileStart(&pt);
+  fSame = FInsideViewSame(c, fFalse);
+  if (fSame) {
+    lMod = LInsideMod();
+    if (ifr.fFrame && lMod == ifr.lMod) {
+      fRet = c.FBitmapCopy(cFrameInside);
+      ProfileStop(&rgprofPhase[prfInsideReuse], &pt);
+      return fRet;
+    }
+  }
+  fRet = FDrawInsidePerspective(c);
+  if (!fRet)
+    ifr.fView = ifr.fFrame = fFalse;
+  else
+    InsideFrameSave(c, fSame, lMod);
+  ProfileStop(&rgprofPhase[prfInside], &pt);
+  return fRet;
+}
+
+
+// Merge one eye of a red/blue stereo view into a bitmap. The left eye goes in
+// the green and blue channels, and the right eye in the red channel. Done in
+// one pass over both bitmaps, rather than masking each with a color first.
+
+void StereoMergeEye(CMazK &c, CONST CMazK &cs, flag fRight)
+{
+  int x, y, nR, nG, nB, nR2, nG2, nB2;
+  byte *pb, *pb2;
+
+  for (y = 0; y < c.m_y; y++) {
+    pb = c._Pb(0, y); pb2 = cs._Pb(0, y);
+    for (x = 0; x < c.m_x; x++) {
+      cs._Get(pb2, &nR2, &nG2, &nB2);
+      if (!fRight)
+        c._Set(pb, 0, nG2, nB2);
+      else {
+        c._Get(pb, &nR, &nG, &nB);
+        c._Set(pb, nR2, nG, nB);
+      }
+      pb += cbPixelC; pb2 += cbPixelC;
+    }
+  }
+  c.DirtyAll();
+}
+
+
 // Draw a stereoscopic 3D version of the first person perspective inside view
 // in a bitmap. This involves drawing "left eye" and "right eye" versions of
-// the scene from slightly different points of view.
+// the scene from slightly different points of view. The eyes only differ in
+// position, so the background is drawn once and shared by both, and the
+// whole pair is reused like a single view when nothing has changed.
 
 flag RedrawInsidePerspectiveStereo(CMazK &c, CMazK &cs)
 {
   int mSav = dr.nOffsetX, nSav = dr.nOffsetY, dSav = dr.nOffsetD,
     x, f, m, n, d;
-
+  ulong lMod = 0;
+  flag fSame, fRet = fFalse;
+  PROFT pt;
+
+  ProfileStart(&pt);
+  fSame = FInsideViewSame(c, fTrue);
+  if (fSame) {
+    lMod = LInsideMod();
+    if (ifr.fFrame && lMod == ifr.lMod) {
+      fRet = c.FBitmapCopy(cFrameInside);
+      ProfileStop(&rgprofPhase[prfInsideReuse], &pt);
+      return fRet;
+    }
+  }
   x = !ds.fStereo3D ? c.m_x >> 1 : c.m_x;
   if (!cs.FBitmapSizeSet(x, c.m_y))
-    return fFalse;
+    goto LDone;
   f = FOdd(c.m_x) && !ds.fStereo3D;
   d = 180 - (dr.dir*90 + dr.nOffsetD);
   if (d >= nDegMax)
@@ -2728,31 +3344,301 @@ flag RedrawInsidePerspectiveStereo(CMazK &c, CMazK &cs)
 
   // Draw left eye view of scene.
   dr.nOffsetX += m; dr.nOffsetY += n; //dr.nOffsetD += 1;
-  if (!RedrawInsidePerspective(cs))
-    return fFalse;
-  if (ds.fStereo3D) {
+  nEyeInside = nEyeFirst;
+  if (!FDrawInsidePerspective(cs))
+    goto LDone;
+  if (!ds.fStereo3D)
+    c.BlockMove(cs, 0, 0, x-1, c.m_y-1, 0, 0);
+  else {
     cs.ColmapGrayscale();
-    cs.ColmapOrAndKv(kvCyan, 0);
+    StereoMergeEye(c, cs, fFalse);
   }
-  c.BlockMove(cs, 0, 0, x-1, c.m_y-1, 0, 0);
 
   // Draw right eye view of scene.
   dr.nOffsetX -= m*2; dr.nOffsetY -= n*2; //dr.nOffsetD -= 1*2;
-  if (!RedrawInsidePerspective(cs))
-    return fFalse;
+  nEyeInside = nEyeSecond;
+  if (!FDrawInsidePerspective(cs))
+    goto LDone;
   if (!ds.fStereo3D)
     c.BlockMove(cs, 0, 0, x-1, c.m_y-1, x+f, 0);
   else {
     cs.ColmapGrayscale();
-    cs.ColmapOrAndKv(kvRed, 0);
-    c.ColmapOrAnd(cs, 1);
+    StereoMergeEye(c, cs, fTrue);
   }
 
   // Draw line down middle if outer bitmap is odd sized.
   if (f)
     c.LineY(x, 0, c.m_y-1, dr.kvInEdge);
+  fRet = fTrue;
+
+LDone:
+  nEyeInside = nEyeNone;
   dr.nOffsetX = mSav; dr.nOffsetY = nSav; dr.nOffsetD = dSav;
-  return fTrue;
+  if (!fRet)
+    ifr.fView = ifr.fFrame = fFalse;
+  else
+    InsideFrameSave(c, fSame, lMod);
+  ProfileStop(&rgprofPhase[prfInside], &pt);
+  return fRet;
+}
+
+
+/*
+******************************************************************************
+** Camera Path Rendering
+******************************************************************************
+*/
+
+#define cPathBatch 8
+
+typedef struct _camerakey {
+  long xin, yin, zin; // Position in high-res inside coordinates.
+  long d;             // Facing in degrees, unwrapped so turns go the short way.
+  long cFrame;        // Number of frames from this key to the next one.
+} CAMERAKEY;
+
+typedef struct _pathrender {
+  CAMERAKEY *rgck;
+  int cKey, iKey;        // Keys, and the segment the next frame is drawn in.
+  long iSub;             // Frame within that segment.
+  CMazK *rgc;            // Frame bitmaps of the batch.
+  int cWrite;            // Number of frames in the batch to save.
+  long iWrite;           // Frame number of the first bitmap to save.
+  CONST char *szFile;
+  flag fTarga;
+  flag rgfFail[cPathBatch];
+} PATHRENDER;
+
+// Position the view at the next frame along a camera path and draw it in a
+// bitmap. Movement, turning, and level changes between keys are interpolated
+// linearly. Must be called from the main thread, since drawing uses globals.
+
+flag FRenderPathFrame(PATHRENDER *ppr, CMazK &c)
+{
+  CAMERAKEY *pck = &ppr->rgck[ppr->iKey], *pck2;
+  long xin, yin, zin, d, i = ppr->iSub, n = pck->cFrame, z;
+  flag fRet;
+
+  if (ppr->iKey < ppr->cKey-1) {
+    pck2 = pck + 1;
+    xin = pck->xin + (pck2->xin - pck->xin) * i / n;
+    yin = pck->yin + (pck2->yin - pck->yin) * i / n;
+    zin = pck->zin + (pck2->zin - pck->zin) * i / n;
+    d   = pck->d   + (pck2->d   - pck->d)   * i / n;
+    if (++ppr->iSub >= n) {
+      ppr->iKey++;
+      ppr->iSub = 0;
+    }
+  } else {
+    xin = pck->xin; yin = pck->yin; zin = pck->zin; d = pck->d;
+  }
+  dr.x = AFromInside(xin);
+  dr.y = AFromInside(yin);
+  dr.nOffsetX = (int)(xin - InsideFromA(dr.x));
+  dr.nOffsetY = (int)(yin - InsideFromA(dr.y));
+  z = (zin + (dr.zCell >> 1)) / dr.zCell;
+  dr.nOffsetZ = (int)(zin - z * dr.zCell);
+  dr.z = (int)z << dr.fNarrow;
+  d %= nDegMax;
+  if (d < 0)
+    d += nDegMax;
+  dr.dir = (int)(d + 44) / 90;
+  dr.nOffsetD = (int)d - dr.dir * 90;
+  dr.dir &= DIRS1;
+
+  if (c.FNull() || c.m_x != ws.xpClient || c.m_y != ws.ypClient)
+    if (!c.FBitmapSizeSet(ws.xpClient, ws.ypClient))
+      return fFalse;
+  if (ds.nStereo == 0)
+    fRet = RedrawInsidePerspective(c);
+  else
+    fRet = RedrawInsidePerspectiveStereo(c, bm.kS);
+  if (fRet && dr.fMap)
+    DrawOverlay(c, bm.b);
+  return fRet;
+}
+
+
+// Thread routine for RenderCameraPath. Save one frame of the batch just drawn
+// to its file.
+
+void PathRenderThread(void *pv, int is)
+{
+  PATHRENDER *ppr = (PATHRENDER *)pv;
+  char sz[cchSzMax];
+  FILE *file;
+
+  sprintf(S(sz), ppr->szFile, ppr->iWrite + is);
+  file = FileOpen(sz, "wb");
+  ppr->rgfFail[is] = (file == NULL);
+  if (file == NULL)
+    return;
+  if (ppr->fTarga)
+    ppr->rgc[is].WriteColmapTarga(file);
+  else
+    ppr->rgc[is].WriteColmap(file);
+  fclose(file);
+}
+
+
+// Render a fly through of the Maze along a camera path, saving each frame of
+// the perspective inside view to its own file. The path is given as keys of
+// four numbers each: x, y, and z coordinates, and direction. Frames between
+// keys are based on the smooth movement frame counts. Each frame is named by
+// the file pattern with its frame number, and saved as a Targa or Windows
+// bitmap based on extension. Returns the number of frames saved, or -1.
+
+long RenderCameraPath(CONST char *szFile, CONST long *rgl, int cKey)
+{
+  char sz[cchSzMax*2], szT[cchSzMax];
+  CMazK rgc[cPathBatch];
+  CAMERAKEY *rgck;
+  PATHRENDER pr;
+  int xSav = dr.x, ySav = dr.y, zSav = dr.z, dSav = dr.dir,
+    mSav = dr.nOffsetX, nSav = dr.nOffsetY, oSav = dr.nOffsetZ,
+    eSav = dr.nOffsetD, cBatch, cch, x, y, z, i;
+  long cFrame = 1, dT, l = -1;
+
+  if (cKey < 1) {
+    PrintSz_W("A camera path needs at least one key.\n");
+    return -1;
+  }
+  if (!FCheckFramePattern(szFile))
+    return -1;
+  rgck = RgAllocate(cKey, CAMERAKEY);
+  if (rgck == NULL)
+    return -1;
+
+  // Convert the keys to inside coordinates, and determine frame counts.
+  for (i = 0; i < cKey; i++) {
+    x = (int)rgl[i*4]; y = (int)rgl[i*4+1]; z = (int)rgl[i*4+2];
+    if (dr.fNarrow) {
+      x |= 1; y |= 1; z &= ~1;
+    }
+    rgck[i].xin = InsideFromA(x);
+    rgck[i].yin = InsideFromA(y);
+    rgck[i].zin = (long)(z >> dr.fNarrow) * dr.zCell;
+    rgck[i].d = (rgl[i*4+3] & DIRS1) * 90;
+    if (i > 0) {
+      dT = (rgck[i].d - rgck[i-1].d) % nDegMax;
+      if (dT < 0)
+        dT += nDegMax;
+      if (dT > nDegHalf)
+        dT -= nDegMax;
+      rgck[i].d = rgck[i-1].d + dT;
+      rgck[i-1].cFrame = Max(1,
+        (NAbs(rgck[i].xin - rgck[i-1].xin) +
+        NAbs(rgck[i].yin - rgck[i-1].yin)) * dr.nFrameXY /
+        (dr.zCell + (dr.fNarrow ? dr.zCellNarrow : 0)) +
+        NAbs(dT) * dr.nFrameD / 90 +
+        NAbs(rgck[i].zin - rgck[i-1].zin) * dr.nFrameZ / dr.zCell);
+      cFrame += rgck[i-1].cFrame;
+    }
+  }
+  rgck[cKey-1].cFrame = 0;
+
+  // Draw a batch of frames, then save all of them at once on separate
+  // threads. Drawing uses globals, so it's always done on this thread.
+  pr.rgck = rgck; pr.cKey = cKey; pr.iKey = 0; pr.iSub = 0;
+  pr.rgc = rgc; pr.iWrite = 0; pr.szFile = szFile;
+  cch = CchSz(szFile);
+  pr.fTarga = cch >= 4 && FCompareSzRgchI(".tga", szFile + cch - 4, 4);
+  cBatch = Min(CThread(), cPathBatch);
+  while (pr.iWrite < cFrame) {
+    pr.cWrite = (int)Min(cFrame - pr.iWrite, cBatch);
+    for (i = 0; i < pr.cWrite; i++)
+      if (!FRenderPathFrame(&pr, rgc[i]))
+        goto LDone;
+    RunThreads(PathRenderThread, &pr, pr.cWrite);
+    for (i = 0; i < pr.cWrite; i++)
+      if (pr.rgfFail[i]) {
+        sprintf(S(szT), szFile, pr.iWrite + i);
+        sprintf(S(sz), "The frame file %s could not be created.", szT);
+        PrintSz_E(sz);
+        goto LDone;
+      }
+    pr.iWrite += pr.cWrite;
+  }
+  l = cFrame;
+
+LDone:
+  DeallocateP(rgck);
+  dr.x = xSav; dr.y = ySav; dr.z = zSav; dr.dir = dSav;
+  dr.nOffsetX = mSav; dr.nOffsetY = nSav; dr.nOffsetZ = oSav;
+  dr.nOffsetD = eSav;
+  return l;
+}
+
+
+// Render a fly through of the shortest solution path from the dot, to the
+// second dot or the nearest exit, like SolveMazeShortest() finds. The camera
+// walks the path, turning in place at each corner.
+
+long RenderSolvePath(CONST char *szFile)
+{
+  CMaz bT;
+  long *rgl, cKey = 0, cStep, l = -1;
+  int x = dr.x, y = dr.y, d = dr.dir, dNew, xk = x, yk = y;
+  flag fAllowUpdate = ws.fAllowUpdate;
+
+  if (dr.f3D) {
+    PrintSz_W("Solution fly throughs can only be rendered in 2D Mazes.\n");
+    return -1;
+  }
+  if (!bm.b.FLegalOff(x, y)) {
+    PrintSz_W("The dot needs to be on a passage to solve from it.\n");
+    return -1;
+  }
+  if (!bT.FBitmapCopy(bm.b))
+    return -1;
+
+  // Solve a copy of the Maze, leaving just the path off in it.
+  ws.fAllowUpdate = fFalse;
+  cStep = bT.SolveMazeShortest(x, y, dr.x2, dr.y2, fFalse);
+  ws.fAllowUpdate = fAllowUpdate;
+  if (cStep <= 0) {
+    PrintSz_W("The Maze has no solution from the dot.\n");
+    return -1;
+  }
+  rgl = RgAllocate((cStep + 2) * 2 * 4, long);
+  if (rgl == NULL)
+    return -1;
+
+  // The path stops next to the second dot rather than on it, so add the
+  // second dot to the path, to walk the last step onto it. Any path cell
+  // next to the second dot is the end of the path, so this can't branch it.
+  if (bm.b.FLegalOff(dr.x2, dr.y2) && (dr.x2 != 0 || dr.y2 != 0))
+    bT.Set0(dr.x2, dr.y2);
+
+  // Walk the path, adding keys at the start, at each end of a turn, and at
+  // the end. A shortest path never touches itself, so each step has at most
+  // one way forward.
+#define AddKey(xT, yT, dT) (rgl[cKey*4] = (xT), rgl[cKey*4+1] = (yT), \
+  rgl[cKey*4+2] = dr.z, rgl[cKey*4+3] = (dT), cKey++)
+  AddKey(x, y, d);
+  bT.Set1(x, y);
+  loop {
+    for (dNew = 0; dNew < DIRS; dNew++)
+      if (bT.FLegalOff(x + xoff[dNew], y + yoff[dNew]))
+        break;
+    if (dNew >= DIRS)
+      break;
+    if (dNew != d) {
+      if (x != xk || y != yk)
+        AddKey(x, y, d);
+      AddKey(x, y, dNew);
+      xk = x; yk = y; d = dNew;
+    }
+    x += xoff[d]; y += yoff[d];
+    bT.Set1(x, y);
+  }
+  if (x != xk || y != yk)
+    AddKey(x, y, d);
+#undef AddKey
+
+  l = RenderCameraPath(szFile, rgl, (int)cKey);
+  DeallocateP(rgl);
+  return l;
 }
 
 
@@ -70,7 +70,7 @@ MS ms = {
     fFalse, fTrue, 10, 1, -100, 15, 15, 0, 4, 4, 3, fFalse,
     fFalse, 1000, TRIES, 0, 0, 0, fFalse, fFalse, fFalse, 4,
   // Macro accessible only settings
-  -1, 1, 10, 50, 0,
+  -1, 1, 10, 50, 0, fFalse, fFalse,
   // Internal settings
   1, 0, 1, 0, 0, 0, 0, 0, -1, NULL, fFalse, 0, NULL, 0};
 
@@ -103,12 +103,6 @@ flag CMaz::FEnsureMazeSize(int z, int grfems)
 {
   int x = m_x, y = m_y, i;
 
-  // Ensure the bitmap isn't too large for the Maze.
-  if ((grfems & fems64K) > 0 && F64K()) {
-    PrintSz_W("Bitmap needs to be smaller than 65536 by 65536!\n");
-    return fFalse;
-  }
-
   // Ensure the bitmap is large enough for the Maze.
   if (x < z || y < z) {
     if ((grfems & femsMinSize) == 0) {
@@ -1043,20 +1037,20 @@ enum _isolationdetachmentcell {
 // section or detached wall. Called from DoRemoveIsolationDetachment().
 
 void CMaz::RemoveIdIn(ID *id, int x, int y, int xs, int ys,
-  long *cEffectivelyIn, long *cFrontier, flag fDetach)
+  lsize *cEffectivelyIn, lsize *cFrontier, flag fDetach)
 {
-  long z;
+  lsize z;
   int xnew, ynew, xp, yp, d;
   flag fIsolate = !fDetach;
 
-  z = (long)y*xs + x;
+  z = (lsize)y*xs + x;
   id[z].set = idIn;
 
   // Update the status of the four adjacent cells.
   for (d = 0; d < DIRS; d++) {
     xnew = x + xoff[d]; ynew = y + yoff[d];
     if (xnew >= 0 && ynew >= 0 && xnew < xs && ynew < ys) {
-      z = (long)ynew*xs + xnew;
+      z = (lsize)ynew*xs + xnew;
       if (id[z].set == idFrontier || id[z].set == idOut) {
         xp = xl + (x << 1) + fIsolate + xoff[d];
         yp = yl + (y << 1) + fIsolate + yoff[d];
@@ -1090,6 +1084,65 @@ void CMaz::RemoveIdIn(ID *id, int x, int y, int xs, int ys,
 }
 
 
+// Return whether every cell in a Maze can already reach the cells that
+// DoRemoveIsolationDetachment starts flooding from, in which case there's
+// nothing for it to do. This labels a bitmap of the cell graph, where each
+// cell and each connection between adjacent cells is an on pixel.
+
+flag CMaz::FCellsConnected(flag fDetach, int xs, int ys) CONST
+{
+  CMon *pbT;
+  lsize *rgl, l, l1 = 0, l2 = 0, lScratch = LScratchMark();
+  int x, y, xp, yp;
+  flag fIsolate = !fDetach, fRet = fFalse;
+
+  pbT = PbScratch((xs << 1) - 1, (ys << 1) - 1, NULL);
+  if (pbT == NULL)
+    return fFalse;
+  ClearPb(pbT->m_rgb, (lsize)pbT->m_y * pbT->m_clRow << 2);
+  for (y = 0; y < ys; y++)
+    for (x = 0; x < xs; x++) {
+      xp = xl + (x << 1) + fIsolate; yp = yl + (y << 1) + fIsolate;
+      if (GetFast(xp, yp) != fDetach)
+        continue;
+      *pbT->_Pl(x << 1, y << 1) |= Lf(x << 1);
+      if (x < xs-1 && GetFast(xp + 1, yp) == fDetach &&
+        GetFast(xp + 2, yp) == fDetach)
+        *pbT->_Pl((x << 1) + 1, y << 1) |= Lf((x << 1) + 1);
+      if (y < ys-1 && GetFast(xp, yp + 1) == fDetach &&
+        GetFast(xp, yp + 2) == fDetach)
+        *pbT->_Pl(x << 1, (y << 1) + 1) |= Lf(x << 1);
+    }
+  if (pbT->LabelComponents(fOn, fFalse, &rgl, NULL) < 0)
+    goto LDone;
+
+  // The flood starts from the first cell, and for detached walls the last.
+  for (y = 0; y < ys; y++)
+    for (x = 0; x < xs; x++) {
+      l = rgl[(lsize)(y << 1) * pbT->m_x + (x << 1)];
+      if (l > 0) {
+        if (l1 <= 0)
+          l1 = l;
+        l2 = l;
+      }
+    }
+  if (!fDetach)
+    l2 = l1;
+  for (y = 0; y < ys; y++)
+    for (x = 0; x < xs; x++) {
+      l = rgl[(lsize)(y << 1) * pbT->m_x + (x << 1)];
+      if (l > 0 && l != l1 && l != l2)
+        goto LDone;
+    }
+  fRet = fTrue;
+
+LDone:
+  ScratchMapDone(pbT);
+  ScratchRelease(lScratch);
+  return fRet;
+}
+
+
 // Remove all isolated sections in a Maze by adding passages connecting them
 // to the rest of the Maze, or remove all detached walls or loops by adding
 // walls connecting them.
@@ -1097,17 +1150,20 @@ void CMaz::RemoveIdIn(ID *id, int x, int y, int xs, int ys,
 long CMaz::DoRemoveIsolationDetachment(flag fDetach)
 {
   ID *id;
-  long count = 0, cEffectivelyIn = 0, cFrontier = 0, i;
+  long count = 0;
+  lsize cEffectivelyIn = 0, cFrontier = 0, i;
   int x, y, xs, ys, j, xnew, ynew, d;
   flag fIsolate = !fDetach;
 
   if (FMazeSizeError(3, 3))
     return fFalse;
   xs = ((xh - xl | 1) + fDetach) >> 1; ys = ((yh - yl | 1) + fDetach) >> 1;
-  id = RgAllocate(xs*ys, ID);
+  if (FCellsConnected(fDetach, xs, ys))
+    return 0;
+  id = RgAllocate((lsize)xs*ys, ID);
   if (id == NULL)
     return -1;
-  for (i = (long)xs*ys-1L; i >= 0L; i--) {
+  for (i = (lsize)xs*ys-1; i >= 0; i--) {
     id[i].set = idOut;
     id[i].zList = 0;
   }
@@ -1120,7 +1176,7 @@ long CMaz::DoRemoveIsolationDetachment(flag fDetach)
     for (x = 0; x < xs; x++) {
       if (Get(xl + (x << 1) + fIsolate,
         yl + (y << 1) + fIsolate) != fDetach)
-        id[(long)y*xs + x].set = idNever;
+        id[(lsize)y*xs + x].set = idNever;
       else if (j) {
         j = fFalse;
         RemoveIdIn(id, x, y, xs, ys, &cEffectivelyIn, &cFrontier, fDetach);
@@ -1157,7 +1213,7 @@ long CMaz::DoRemoveIsolationDetachment(flag fDetach)
     for (j = 0; j < DIRS; j++) {
       xnew = x + xoff[d]; ynew = y + yoff[d];
       if (xnew >= 0 && ynew >= 0 && xnew < xs && ynew < ys &&
-        id[(long)ynew*xs + xnew].set == idIn) {
+        id[(lsize)ynew*xs + xnew].set == idIn) {
         Set(xl + (x << 1) + fIsolate + xoff[d],
           yl + (y << 1) + fIsolate + yoff[d], fDetach);
         break;
@@ -1478,16 +1534,15 @@ long CMaz::DoCrackIsland(int x0, int y0, flag fCorner)
 {
   BFSS *bfss = NULL, bfssT;
   CMaz bT;
-  long lRet = -1, iLo = 0, iHi, iMax = 0, i, j, k;
+  long lRet = -1;
+  lsize iLo = 0, iHi, iMax = 0, i, j, k;
   int x, y, xnew, ynew, d, dMax = DIRS + fCorner*DIRS;
 
-  if (F64K())
-    goto LDone;
   if (!FLegal(x0, y0) || !Get(x0, y0)) {
     if (!FBitmapFind(&x0, &y0, fOn))
       return 0;
   }
-  bfss = RgAllocate(m_x*m_y, BFSS);
+  bfss = RgAllocate((lsize)m_x*m_y, BFSS);
   if (bfss == NULL)
     goto LDone;
   if (!bT.FBitmapSizeSet(m_x, m_y))
@@ -1558,8 +1613,6 @@ LDone:
 }
 
 
-#define KrusFind(x, y) KruskalFind(&cell[y * m_x + x]);
-
 // Connect all regions of on pixels with the nearest region disconnected from
 // them, by drawing shortest possible lines of on pixels between them. This
 // can be used to fuse all detached walls in a Maze with each other. This is
@@ -1568,62 +1621,46 @@ LDone:
 
 long CMaz::DoCrackIslands(flag fCorner)
 {
-  CMazK c;
   BFSS *bfss = NULL, bfssT;
-  KRUS *cell = NULL, *krus, *krusT;
-  int x, y, x2, y2, xnew, ynew, d, dMax = DIRS + fCorner*DIRS;
-  long lRet = -1, iset = 0, iLo = 0, iHi, iMax = 0, i, j, k, ccell, icell;
-
-  if (F64K())
+  KRUS *rgkrus, *krus, *krusT;
+  lsize *rgl, *rgiFill = NULL;
+  int x, y, xnew, ynew, d, dMax = DIRS + fCorner*DIRS;
+  long lRet = -1;
+  lsize iLo = 0, iHi, iMax = 0, i, j, ccell, ccomp, icell,
+    lScratch = LScratchMark();
+
+  // Label each region of walls with a unique id number. Each pixel's label
+  // then tracks which region has flooded it, where the regions are merged
+  // into fewer sets as they're connected.
+  ccomp = LabelComponents(fOn, fCorner, &rgl, NULL);
+  if (ccomp < 0)
     goto LDone;
-  ccell = m_x*m_y;
-  bfss = RgAllocate(ccell, BFSS);
-  if (bfss == NULL)
+  rgkrus = RgAllocateScratch(ccomp + 1, KRUS);
+  if (rgkrus == NULL)
     goto LDone;
-  cell = RgAllocate(ccell, KRUS);
-  if (cell == NULL)
+  for (i = 0; i <= ccomp; i++) {
+    rgkrus[i].next = &rgkrus[i];
+    rgkrus[i].count = 1;
+  }
+
+  // The working arrays are only needed for the duration of this call, so
+  // come from the scratch arena, and are all released together at the end.
+  ccell = (lsize)m_x*m_y;
+  bfss = RgAllocateScratch(ccell, BFSS);
+  if (bfss == NULL)
     goto LDone;
-  if (!c.FBitmapSizeSet(m_x, m_y))
+
+  // Each pixel remembers the index of the search entry that reached it.
+  rgiFill = RgAllocateScratch(ccell, lsize);
+  if (rgiFill == NULL)
     goto LDone;
-  c.BitmapOff();
   lRet = 0;
-
-  // Start with each cell in a set by itself.
-  for (icell = 0; icell < ccell; icell++) {
-    cell[icell].next = &cell[icell];
-    cell[icell].count = 1;
-  }
-
-  // For each section of walls that hasn't already been filled, flood it and
-  // all walls that connect with it with a unique id number.
-  for (y = 0; y < m_y; y++)
-    for (x = 0; x < m_x; x++) {
-      krus = KrusFind(x, y);
-      if (Get(x, y) && krus->count <= 1) {
-        iset++;
-        j = iMax;
-        c.Set(x, y, iMax);
+  for (y = 0, icell = 0; y < m_y; y++)
+    for (x = 0; x < m_x; x++, icell++)
+      if (rgl[icell] > 0) {
+        rgiFill[icell] = iMax;
         BfssPush(iMax, x, y, -1);
-        k = iMax;
-        while (j < k) {
-          for (i = j; i < k; i++) {
-            x2 = bfss[i].x; y2 = bfss[i].y;
-            for (d = 0; d < dMax; d++) {
-              xnew = x2 + xoff[d]; ynew = y2 + yoff[d];
-              if (!FLegal(xnew, ynew))
-                continue;
-              krusT = KrusFind(xnew, ynew);
-              if (Get(xnew, ynew) && krusT->count <= 1) {
-                KruskalUnion(krus, krusT);
-                c.Set(xnew, ynew, iMax);
-                BfssPush(iMax, xnew, ynew, -1);
-              }
-            }
-          }
-          j = k; k = iMax;
-        }
       }
-    }
 
   // Randomize the order of pixels in the set of regions, so the shortest
   // connecting lines randomly start from among the set of possible points.
@@ -1639,20 +1676,21 @@ long CMaz::DoCrackIslands(flag fCorner)
   while (iLo < iHi) {
     for (i = iLo; i < iHi; i++) {
       x = bfss[i].x; y = bfss[i].y;
-      krus = KrusFind(x, y);
+      krus = KruskalFind(&rgkrus[rgl[(lsize)y * m_x + x]]);
       for (d = 0; d < dMax; d++) {
         xnew = x + xoff[d]; ynew = y + yoff[d];
         if (!FLegal(xnew, ynew))
           continue;
-        krusT = KrusFind(xnew, ynew);
-        if (krusT == krus)
-          continue;
-        if (krusT->count <= 1) {
-          KruskalUnion(krus, krusT);
-          c.Set(xnew, ynew, iMax);
+        icell = (lsize)ynew * m_x + xnew;
+        if (rgl[icell] <= 0) {
+          rgl[icell] = krus - rgkrus;
+          rgiFill[icell] = iMax;
           BfssPush(iMax, xnew, ynew, i);
           continue;
         }
+        krusT = KruskalFind(&rgkrus[rgl[icell]]);
+        if (krusT == krus)
+          continue;
 
         // Found another new region! Draw lines backwards to start regions.
         lRet++;
@@ -1661,7 +1699,7 @@ long CMaz::DoCrackIslands(flag fCorner)
           Set1(bfss[j].x, bfss[j].y);
           j = bfss[j].parent;
         } while (j >= 0);
-        j = c.Get(xnew, ynew);
+        j = rgiFill[icell];
         if (bfss[j].x == xnew && bfss[j].y == ynew)
           do {
             Set1(bfss[j].x, bfss[j].y);
@@ -1670,17 +1708,14 @@ long CMaz::DoCrackIslands(flag fCorner)
 
         // Union the two regions quickly.
         KruskalUnion(krus, krusT);
-        krus = KrusFind(x, y);
+        krus = KruskalFind(krus);
       }
     }
     iLo = iHi; iHi = iMax;
   }
 
 LDone:
-  if (bfss != NULL)
-    DeallocateP(bfss);
-  if (cell != NULL)
-    DeallocateP(cell);
+  ScratchRelease(lScratch);
   return lRet;
 }
 
@@ -1888,67 +1923,277 @@ void CMaz::BlockMoveMaze3(CONST CMaz &b1, int x1, int y1, int z1,
 }
 
 
-#define BLOCKS 40
+MAS mas = {-1};
 
-// Display information about passages in the Maze, specifically counts and
-// percentage information about the types of cells, lengths of passages, and
-// lengths of dead ends. Implements the Analyze Passages command.
+typedef struct _mazeanalyze {
+  CONST CMaz *b;   // Maze being analyzed
+  int nMode;       // What is being analyzed
+  int crow;        // Number of rows of cells or wall points
+  int cstrip;      // Number of strips the rows are divided into
+  MAS rgmas[cThreadMax];
+} MAZANA;
+
+// Thread routine for FMazeAnalyze. Tally the types of cells or wall points in
+// one strip of rows, along with straight passage and dead end lengths, into
+// that strip's partial results. Pixels are read with GetFast, avoiding a
+// virtual function call per pixel.
 
-void CMaz::MazeAnalyze() CONST
+void MazeAnalyzeThread(void *pv, int is)
 {
-  long c[16], e[BLOCKS], tot = 0, m, n;
-  int x, y, i, j, k, l, xm = 0, ym = 0, xnew, ynew;
-  char sz[cchSzMax*6], sz1[cchSzMax], sz2[cchSzMax], sz3[cchSzMax],
-    sz4[cchSzMax], sz5[cchSzMax*2], *pch;
+  MAZANA *pma = (MAZANA *)pv;
+  CONST CMaz &b = *pma->b;
+  MAS *pmas = &pma->rgmas[is];
+  int ir, irLo, irHi, ny, x, y, z, i, j, k, f, xnew, ynew, znew;
 
-  for (i = 0; i < 16; i++)
-    c[i] = 0;
-  for (i = 0; i < BLOCKS; i++)
-    e[i] = 0;
-  l = ms.nRadar; ms.nRadar = 0;
-  for (y = yl+1; y < yh; y += 2)
-    for (x = xl+1; x < xh; x += 2) {
-
-      // See what arrangement of passages this cell has.
-      k = 0;
-      for (j = 0; j < DIRS; j++)
-        k = (k << 1) + Get(x + xoff[j], y + yoff[j]);
-      c[k]++, tot++;
-
-      // See how long straight passages are after this point.
-      if (Get(x-1, y)) {
-        for (i = 0; x+i < xh-1 && !Get(x+i, y); i++)
-          ;
-        if (i > xm)
-          xm = i;
+  ClearPb(pmas, sizeof(MAS));
+  irLo = (int)((lsize)pma->crow * is / pma->cstrip);
+  irHi = (int)((lsize)pma->crow * (is+1) / pma->cstrip);
+  for (ir = irLo; ir < irHi; ir++) {
+
+    // Passages in a 2D Maze.
+    if (pma->nMode == nAnalyzePassage) {
+      y = yl+1 + (ir << 1);
+      for (x = xl+1; x < xh; x += 2) {
+
+        // See what arrangement of passages this cell has.
+        k = 0;
+        for (j = 0; j < DIRS; j++)
+          k = (k << 1) + b.GetFast(x + xoff[j], y + yoff[j]);
+        pmas->rgcType[k]++, pmas->cCell++;
+
+        // See how long straight passages are after this point. Each scan
+        // starts just past a wall, so no pixel is ever scanned twice.
+        if (b.GetFast(x-1, y)) {
+          for (i = 0; x+i < xh-1 && !b.GetFast(x+i, y); i++)
+            ;
+          if (i > pmas->xLong)
+            pmas->xLong = i;
+        }
+        if (b.GetFast(x, y-1)) {
+          for (i = 0; y+i < yh-1 && !b.GetFast(x, y+i); i++)
+            ;
+          if (i > pmas->yLong)
+            pmas->yLong = i;
+        }
+
+        // If a dead end cell, see how many cells long the dead end is.
+        if (k == 14 || k == 13 || k == 11 || k == 7) {
+          xnew = x; ynew = y; j = 0;
+          for (i = 0; i < cDeadEndMax*2; i++) {
+            j = b.FollowPassage(&xnew, &ynew, NULL, j, fFalse);
+            if (j < 0)
+              break;
+          }
+          i >>= 1;
+          EnsureBetween(i, 1, cDeadEndMax);
+          pmas->rgcDead[i-1]++;
+          pmas->cDeadCell += i;
+        }
       }
-      if (Get(x, y-1)) {
-        for (i = 0; y+i < yh-1 && !Get(x, y+i); i++)
-          ;
-        if (i > ym)
-          ym = i;
+
+    // Walls in a 2D Maze.
+    } else if (pma->nMode == nAnalyzeWall) {
+      y = yl + (ir << 1);
+      for (x = xl; x <= xh; x += 2) {
+
+        // See what arrangement of wall segments this intersection point has.
+        k = 0;
+        for (j = 0; j < DIRS; j++)
+          k = (k << 1) + b.GetFast(x + xoff[j], y + yoff[j]);
+        pmas->rgcType[k]++, pmas->cCell++;
+
+        // See how long walls are after this point (excluding boundary walls).
+        if (y > yl && y < yh-1 && !b.GetFast(x-1, y)) {
+          for (i = 0; x+i < xh && b.GetFast(x+i, y); i++)
+            ;
+          if (i > pmas->xLong)
+            pmas->xLong = i;
+        }
+        if (x > xl && x < xh-1 && !b.GetFast(x, y-1)) {
+          for (i = 0; y+i < yh && b.GetFast(x, y+i); i++)
+            ;
+          if (i > pmas->yLong)
+            pmas->yLong = i;
+        }
       }
 
-      // If a dead end cell, see how many cells long the dead end is.
-      if (k == 14 || k == 13 || k == 11 || k == 7) {
-        xnew = x; ynew = y; j = 0;
-        for (i = 0; i < BLOCKS*2; i++) {
-          j = FollowPassage(&xnew, &ynew, NULL, j, fFalse);
-          if (j < 0)
-            break;
+    // Passages in a 3D Maze.
+    } else {
+      ny = (b.m_y3 - 1) >> 1;
+      z = ir / ny << 1; y = (ir % ny << 1) + 1;
+      for (x = 1; x < b.m_x3-1; x += 2) {
+
+        // See what arrangement of passages this cell has. Directions are
+        // paired with their opposites as 0-2, 1-3, and 4-5.
+        k = f = 0;
+        for (j = 0; j < DIRS3; j++)
+          if (b.Get3M(x + xoff3[j], y + yoff3[j], z + zoff3[j]))
+            k++;
+          else
+            f |= 1 << j;
+        pmas->rgcWay[DIRS3 - k]++, pmas->cCell++;
+        if (f == 0x05 || f == 0x0A || f == 0x30)
+          pmas->cStraight++;
+
+        // If a dead end cell, see how many cells long the dead end is.
+        if (k == DIRS3-1) {
+          xnew = x; ynew = y; znew = z; j = 0;
+          for (i = 0; i < cDeadEndMax*2; i++) {
+            j = b.FollowPassage(&xnew, &ynew, &znew, j, fTrue);
+            if (j < 0)
+              break;
+          }
+          i >>= 1;
+          EnsureBetween(i, 1, cDeadEndMax);
+          pmas->rgcDead[i-1]++;
+          pmas->cDeadCell += i;
         }
-        i >>= 1;
-        if (i < 1)
-          i = 1;
-        else if (i > BLOCKS)
-          i = BLOCKS;
-        e[i-1]++;
       }
     }
-  ms.nRadar = l;
+  }
+}
+
+
+// Return the length in pixels of the shortest solution of a Maze, as the
+// Solve Shortest command would find it. If the given point is in a passage,
+// solve from it to any exit off an edge, otherwise solve from the entrance on
+// the top row to any exit off the bottom edge. Return -1 if there's no
+// solution.
+
+long CMaz::MazeSolutionLength(int x, int y) CONST
+{
+  CMon *pbT;
+  BFSS *bfss;
+  int xnew, ynew, d;
+  long count = -1, lLevel = 1;
+  lsize iLo = 0, iHi = 1, iMax = 1, i, lScratch = LScratchMark();
+  flag fAny = FLegalOff(x, y);
+
+  if (!fAny) {
+    x = xl; y = yl;
+    if (!FFindPassage(&x, &y, fFalse))
+      return -1;
+  }
+  bfss = RgAllocateScratch((lsize)m_x*m_y, BFSS);
+  if (bfss == NULL)
+    return -1;
+  pbT = PbScratch(m_x, m_y, this);
+  if (pbT == NULL)
+    goto LDone;
+  CopyPb(m_rgb, pbT->m_rgb, (lsize)m_y*m_clRow << 2);
+  *pbT->_Pl(x, y) |= Lf(x);
+  bfss[0].x = x; bfss[0].y = y; bfss[0].parent = -1;
 
-  if (tot < 1)
+  // Flood the Maze one level at a time, without modifying it.
+  while (iLo < iHi) {
+    for (i = iLo; i < iHi; i++) {
+      x = bfss[i].x; y = bfss[i].y;
+      for (d = 0; d < DIRS; d++) {
+        xnew = x + xoff[d]; ynew = y + yoff[d];
+        if (!FLegal(xnew, ynew)) {
+          if (fAny || ynew >= m_y) {
+            count = lLevel;
+            goto LDone;
+          }
+        } else if (!pbT->_Get(xnew, ynew)) {
+          *pbT->_Pl(xnew, ynew) |= Lf(xnew);
+          BfssPush(iMax, xnew, ynew, i);
+        }
+      }
+    }
+    iLo = iHi; iHi = iMax;
+    lLevel++;
+  }
+
+LDone:
+  if (pbT != NULL)
+    ScratchMapDone(pbT);
+  ScratchRelease(lScratch);
+  return count;
+}
+
+
+// Compute statistics about the passages or walls in a Maze, in one pass over
+// the cells divided into strips of rows, which large Mazes process on many
+// threads. Each strip's partial results are merged into the given structure.
+
+flag CMaz::FMazeAnalyze(MAS *pmas, int nMode) CONST
+{
+  MAZANA ma;
+  MAS *pmasT;
+  int is, i, j, k, nRadar;
+
+  ClearPb(pmas, sizeof(MAS));
+  pmas->nMode = nMode;
+  pmas->lSolution = -1;
+  if (nMode == nAnalyzePassage)
+    ma.crow = (yh - yl) >> 1;
+  else if (nMode == nAnalyzeWall)
+    ma.crow = ((yh - yl) >> 1) + 1;
+  else
+    ma.crow = m_y3 > 2 ? (m_z3 >> 1) * ((m_y3 - 1) >> 1) : 0;
+  if (ma.crow <= 0)
+    return fFalse;
+  ma.b = this; ma.nMode = nMode;
+  ma.cstrip = Min(CThread(), Max((lsize)m_x * m_y >> 16, 1));
+  EnsureBetween(ma.cstrip, 1, ma.crow);
+  nRadar = ms.nRadar; ms.nRadar = 0;
+  RunThreads(MazeAnalyzeThread, &ma, ma.cstrip);
+  ms.nRadar = nRadar;
+
+  // Merge the results from each strip.
+  for (is = 0; is < ma.cstrip; is++) {
+    pmasT = &ma.rgmas[is];
+    pmas->cCell += pmasT->cCell;
+    for (i = 0; i < 16; i++)
+      pmas->rgcType[i] += pmasT->rgcType[i];
+    for (i = 0; i <= DIRS3; i++)
+      pmas->rgcWay[i] += pmasT->rgcWay[i];
+    pmas->cStraight += pmasT->cStraight;
+    for (i = 0; i < cDeadEndMax; i++)
+      pmas->rgcDead[i] += pmasT->rgcDead[i];
+    pmas->cDeadCell += pmasT->cDeadCell;
+    pmas->xLong = Max(pmas->xLong, pmasT->xLong);
+    pmas->yLong = Max(pmas->yLong, pmasT->yLong);
+  }
+
+  // For 2D Mazes, count cells by number of openings from the arrangements.
+  if (nMode != nAnalyze3D) {
+    for (i = 0; i < 16; i++) {
+      for (j = k = 0; j < DIRS; j++)
+        k += (i >> j) & 1;
+      pmas->rgcWay[nMode == nAnalyzeWall ? k : DIRS - k] += pmas->rgcType[i];
+    }
+    pmas->cStraight = pmas->rgcType[5] + pmas->rgcType[10];
+  }
+
+  // The river factor is the average dead end length. Mazes with a high
+  // river factor have fewer but longer dead ends, and flow more like rivers.
+  if (pmas->rgcWay[1] > 0 && nMode != nAnalyzeWall)
+    pmas->rRiver = (real)pmas->cDeadCell / (real)pmas->rgcWay[1];
+  return pmas->cCell > 0;
+}
+
+
+// Display information about passages in the Maze, specifically counts and
+// percentage information about the types of cells, lengths of passages,
+// lengths of dead ends, and the river factor. When fAnalyzeSolution is set,
+// also display the length of the shortest solution from the given point.
+// Implements the Analyze Passages command.
+
+void CMaz::MazeAnalyze(int x, int y) CONST
+{
+  CONST long *c = mas.rgcType, *e = mas.rgcDead;
+  long tot, m, n;
+  int i, j;
+  char sz[cchSzMax*7], sz1[cchSzMax], sz2[cchSzMax], sz3[cchSzMax],
+    sz4[cchSzMax*2], sz5[cchSzMax*2], *pch;
+
+  if (!FMazeAnalyze(&mas, nAnalyzePassage))
     return;
+  if (ms.fAnalyzeSolve)
+    mas.lSolution = MazeSolutionLength(x, y);
+  tot = mas.cCell;
   m = c[14]+c[13]+c[11]+c[7];
   n = c[10]+c[5];
   sprintf(S(sz1),
@@ -1972,17 +2217,27 @@ void CMaz::MazeAnalyze() CONST
     c[0], (real)c[0]/(real)tot*100.0,
     tot, m, (real)m/(real)tot*100.0);
   sprintf(S(sz4),
-    "Longest horizontal passage: %d (%d), Longest vertical passage %d (%d)\n",
-    (xm + 1) >> 1, xm, (ym + 1) >> 1, ym);
+    "Longest horizontal passage: %d (%d), Longest vertical passage %d (%d)\n"
+    "River factor: %.2f",
+    (mas.xLong + 1) >> 1, mas.xLong, (mas.yLong + 1) >> 1, mas.yLong,
+    mas.rRiver);
+  pch = sz4;
+  while (*pch)
+    pch++;
+  if (ms.fAnalyzeSolve)
+    sprintf(SO(pch, sz4), ", Solution length: %ld (%ld)\n",
+      (mas.lSolution + 1) >> 1, mas.lSolution);
+  else
+    sprintf(SO(pch, sz4), "\n");
   sprintf(S(sz5), "\nDead end lengths:\n");
   pch = sz5;
-  for (j = BLOCKS-1; j > 0 && e[j] == 0; j--)
+  for (j = cDeadEndMax-1; j > 0 && e[j] == 0; j--)
     ;
   for (i = 0; i <= j; i++) {
     while (*pch)
       pch++;
-    sprintf(SO(pch, sz5), "%d%s: %ld%s%c", i+1, i < BLOCKS-1 ? "" : "+", e[i],
-      i < j ? "," : "", (i&7) == 7 || i == j ? '\n' : ' ');
+    sprintf(SO(pch, sz5), "%d%s: %ld%s%c", i+1, i < cDeadEndMax-1 ? "" : "+",
+      e[i], i < j ? "," : "", (i&7) == 7 || i == j ? '\n' : ' ');
   }
   sprintf(S(sz), "%s%s%s%s%s", sz1, sz2, sz3, sz4, sz5);
   PrintSz_N(sz);
@@ -1995,39 +2250,14 @@ void CMaz::MazeAnalyze() CONST
 
 void CMaz::MazeAnalyze2() CONST
 {
-  long c[16], tot = 0, m, n, xs, ys;
-  int x, y, i, j, k, xm = 0, ym = 0;
+  CONST long *c = mas.rgcType;
+  long tot, m, n, xs, ys;
   char sz[cchSzMax*3], sz1[cchSzMax], sz2[cchSzMax], sz3[cchSzMax],
     sz4[cchSzMax];
 
-  for (i = 0; i < 16; i++)
-    c[i] = 0;
-  for (y = yl; y <= yh; y += 2)
-    for (x = xl; x <= xh; x += 2) {
-
-      // See what arrangement of wall segments this intersection point has.
-      k = 0;
-      for (j = 0; j < DIRS; j++)
-        k = (k << 1) + Get(x + xoff[j], y + yoff[j]);
-      c[k]++, tot++;
-
-      // See how long walls are after this point (excluding boundary walls).
-      if (y > yl && y < yh-1 && !Get(x-1, y)) {
-        for (i = 0; x+i < xh && Get(x+i, y); i++)
-          ;
-        if (i > xm)
-          xm = i;
-      }
-      if (x > xl && x < xh-1 && !Get(x, y-1)) {
-        for (i = 0; y+i < yh && Get(x, y+i); i++)
-          ;
-        if (i > ym)
-          ym = i;
-      }
-    }
-
-  if (tot < 1)
+  if (!FMazeAnalyze(&mas, nAnalyzeWall))
     return;
+  tot = mas.cCell;
   m = c[8]+c[4]+c[2]+c[1];
   n = c[10]+c[5];
   sprintf(S(sz1),
@@ -2056,57 +2286,29 @@ void CMaz::MazeAnalyze2() CONST
   sprintf(S(sz4),
     "Total wall segments: %d [X: %d, Y: %d]\n"
     "Longest horizontal wall: %d (%d), Longest vertical wall %d (%d)\n",
-    xs + ys, xs, ys, (xm + 1) >> 1, xm, (ym + 1) >> 1, ym);
+    xs + ys, xs, ys, (mas.xLong + 1) >> 1, mas.xLong,
+    (mas.yLong + 1) >> 1, mas.yLong);
   sprintf(S(sz), "%s%s%s%s", sz1, sz2, sz3, sz4);
   PrintSz_N(sz);
 }
 
 
 // Display information about passages in a 3D Maze, specifically counts and
-// percentage information about the types of cells. Implements the Analyze
-// Passages command for 3D bitmaps.
+// percentage information about the types of cells, lengths of dead ends, and
+// the river factor. Implements the Analyze Passages command for 3D bitmaps.
 
 void CMaz::MazeAnalyze3D() CONST
 {
-  long c[DIRS3+1], e[BLOCKS], tot = 0;
-  int x, y, z, i, j, k, l, xnew, ynew, znew;
+  CONST long *e = mas.rgcDead;
+  long c[DIRS3+1], tot;
+  int i, j;
   char sz[cchSzMax*3], sz1[cchSzMax], sz2[cchSzMax*2], *pch;
 
-  for (i = 0; i <= DIRS3; i++)
-    c[i] = 0;
-  for (i = 0; i < BLOCKS; i++)
-    e[i] = 0;
-  l = ms.nRadar; ms.nRadar = 0;
-  for (z = 0; z < m_z3-1; z += 2)
-    for (y = 1; y < m_y3-1; y += 2)
-      for (x = 1; x < m_x3-1; x += 2) {
-
-        // See what arrangement of passages this cell has.
-        k = 0;
-        for (j = 0; j < DIRS3; j++)
-          k += Get3M(x + xoff3[j], y + yoff3[j], z + zoff3[j]);
-        c[k]++, tot++;
-
-        // If a dead end cell, see how many cells long the dead end is.
-        if (k == DIRS3-1) {
-          xnew = x; ynew = y; znew = z; j = 0;
-          for (i = 0; i < BLOCKS*2; i++) {
-            j = FollowPassage(&xnew, &ynew, &znew, j, fTrue);
-            if (j < 0)
-              break;
-          }
-          i >>= 1;
-          if (i < 1)
-            i = 1;
-          else if (i > BLOCKS)
-            i = BLOCKS;
-          e[i-1]++;
-        }
-      }
-  ms.nRadar = l;
-
-  if (tot < 1)
+  if (!FMazeAnalyze(&mas, nAnalyze3D))
     return;
+  tot = mas.cCell;
+  for (i = 0; i <= DIRS3; i++)
+    c[i] = mas.rgcWay[DIRS3 - i];
   sprintf(S(sz1),
     "Cavities: %ld (%.2f%%)\n"
     "Dead ends: %ld (%.2f%%)\n"
@@ -2122,21 +2324,61 @@ void CMaz::MazeAnalyze3D() CONST
     c[2], (real)c[2]/(real)tot*100.0,
     c[1], (real)c[1]/(real)tot*100.0,
     c[0], (real)c[0]/(real)tot*100.0);
-  sprintf(S(sz2), "\nTotal cells: %ld\n\nDead end lengths:\n", tot);
+  sprintf(S(sz2), "\nTotal cells: %ld, River factor: %.2f\n\n"
+    "Dead end lengths:\n", tot, mas.rRiver);
   pch = sz2;
-  for (j = BLOCKS-1; j > 0 && e[j] == 0; j--)
+  for (j = cDeadEndMax-1; j > 0 && e[j] == 0; j--)
     ;
   for (i = 0; i <= j; i++) {
     while (*pch)
       pch++;
-    sprintf(SO(pch, sz2), "%d%s: %ld%s%c", i+1, i < BLOCKS-1 ? "" : "+", e[i],
-      i < j ? "," : "", (i&7) == 7 || i == j ? '\n' : ' ');
+    sprintf(SO(pch, sz2), "%d%s: %ld%s%c", i+1, i < cDeadEndMax-1 ? "" : "+",
+      e[i], i < j ? "," : "", (i&7) == 7 || i == j ? '\n' : ' ');
   }
   sprintf(S(sz), "%s%s", sz1, sz2);
   PrintSz_N(sz);
 }
 
 
+// Write the results of the most recent Maze analysis to a file, as a JSON
+// object. Implements the SaveAnalysis operation.
+
+flag FWriteMazeAnalysis(CONST char *szFile)
+{
+  FILE *file;
+  int i, j;
+
+  if (mas.nMode < 0) {
+    PrintSz_W("No Maze has been analyzed yet.\n");
+    return fFalse;
+  }
+  file = FileOpen(szFile, "w");
+  if (file == NULL) {
+    PrintSz_E("The file could not be created.");
+    return fFalse;
+  }
+  fprintf(file, "{\n  \"mode\": \"%s\",\n  \"cells\": %ld,\n  \"types\": [",
+    mas.nMode == nAnalyzePassage ? "passages" :
+    (mas.nMode == nAnalyzeWall ? "walls" : "3D passages"), mas.cCell);
+  for (i = 0; i < 16; i++)
+    fprintf(file, "%s%ld", i > 0 ? ", " : "", mas.rgcType[i]);
+  fprintf(file, "],\n  \"openings\": [");
+  for (i = 0; i <= DIRS3; i++)
+    fprintf(file, "%s%ld", i > 0 ? ", " : "", mas.rgcWay[i]);
+  fprintf(file, "],\n  \"straight\": %ld,\n  \"deadEndLengths\": [",
+    mas.cStraight);
+  for (j = cDeadEndMax-1; j > 0 && mas.rgcDead[j] == 0; j--)
+    ;
+  for (i = 0; i <= j; i++)
+    fprintf(file, "%s%ld", i > 0 ? ", " : "", mas.rgcDead[i]);
+  fprintf(file, "],\n  \"deadEndCells\": %ld,\n  \"riverFactor\": %.4f,\n"
+    "  \"longestX\": %d,\n  \"longestY\": %d,\n  \"solution\": %ld\n}\n",
+    mas.cDeadCell, mas.rRiver, mas.xLong, mas.yLong, mas.lSolution);
+  fclose(file);
+  return fTrue;
+}
+
+
 // Return how many possible different perfect Mazes or spanning trees there
 // are of the given dimensions. This ignores entrances and just considers
 // internal passages, and also counts rotations and reflections as different
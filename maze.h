@@ -40,7 +40,6 @@ enum _ensuremazesize {
   femsNoSection = 0x10,
   femsOddSize   = 0x20,
   femsMinSize   = 0x40,
-  fems64K       = 0x80,
 };
 
 enum _entranceposition {
@@ -179,6 +178,8 @@ typedef struct _mazesettings {
   int nFractalD;
   int nFractalL;
   int nFractalT;
+  flag fWilsonPop;
+  flag fAnalyzeSolve;
 
   // Internal settings
 
@@ -215,17 +216,37 @@ typedef struct _rc3 {
 } RC3;
 
 typedef struct _isolationdetachment {
-  long zList;
-  long iBack;
+  lsize zList;
+  lsize iBack;
   long set;
 } ID;
 
 typedef struct _krus {
   struct _krus *next;
-  long count;
+  lsize count;
 } KRUS;
 
+#define nAnalyzePassage 0
+#define nAnalyzeWall    1
+#define nAnalyze3D      2
+#define cDeadEndMax 40
+
+typedef struct _mazeanalysis {
+  int nMode;               // What was analyzed: passages, walls, 3D passages
+  long cCell;              // Total cells or wall points analyzed
+  long rgcType[16];        // Count of each arrangement of 2D neighbors
+  long rgcWay[DIRS3+1];    // Count of cells with each number of openings
+  long cStraight;          // Two way cells whose openings are opposite
+  long rgcDead[cDeadEndMax]; // Count of dead ends of each length
+  long cDeadCell;          // Total cells within dead ends
+  real rRiver;             // River factor, or average dead end length
+  int xLong;               // Longest horizontal passage or wall in pixels
+  int yLong;               // Longest vertical passage or wall in pixels
+  long lSolution;          // Pixels in shortest solution, or -1 if none
+} MAS;
+
 extern MS ms;
+extern MAS mas;
 extern int xl, yl, xh, yh;
 extern CONST char *rgszDir[DIRS];
 extern CONST char *rgszChip[7];
@@ -304,7 +325,8 @@ public:
   long MazeTweakEndpoints();
   long MazeTweakPassages();
   long DoSetAllCellsToPoles();
-  void RemoveIdIn(ID *, int, int, int, int, long *, long *, flag);
+  void RemoveIdIn(ID *, int, int, int, int, lsize *, lsize *, flag);
+  flag FCellsConnected(flag, int, int) CONST;
   long DoRemoveIsolationDetachment(flag);
   long DoConnectPoles(flag);
   long DoDeletePoles(flag);
@@ -324,7 +346,9 @@ public:
     int, int, int, int);
   void BlockMoveMaze3(CONST CMaz &, int, int, int, int, int, int,
     int, int, int, int, int, int);
-  void MazeAnalyze() CONST;
+  long MazeSolutionLength(int, int) CONST;
+  flag FMazeAnalyze(MAS *, int) CONST;
+  void MazeAnalyze(int, int) CONST;
   void MazeAnalyze2() CONST;
   void MazeAnalyze3D() CONST;
 
@@ -339,7 +363,7 @@ public:
   long BraidConnectWalls();
   flag CreateMazeBraid();
   flag CreateMazeBraidTilt();
-  void SpiralMakeNew(ushort *, ushort *);
+  void SpiralMakeNew(int *, int *);
   int SpiralMakeTemplate();
   flag CreateMazeSpiral();
   flag CreateMazeDiagonal();
@@ -354,6 +378,7 @@ public:
   flag CreateMazeForest();
   flag CreateMazeAldousBroder();
   flag CreateMazeWilson();
+  flag CreateMazeWilsonPop();
   void EllerMakeRow(long *, long *, int, int, int, int, int, flag);
   flag CreateMazeEller();
   void BraidMakeRow(long *, long *, int, int, int, int, int, int);
@@ -498,6 +523,7 @@ public:
 extern flag FMazeSizeError(int, int);
 extern int RndDir(void);
 extern ulong MazeCountPossible(int, int);
+extern flag FWriteMazeAnalysis(CONST char *);
 
 // Function hooks implemented elsewhere
 extern int InitCoordinates(int);
@@ -237,14 +237,13 @@ long CMaz::DoCrackBlindAlleys(CONST CMaz &bSol)
   CONST CMaz *pb;
   BFSS *rgpt;
   int zInc = 2 - ms.fSolveEveryPixel, x, y, x2, y2, xnew, ynew, d;
-  long iset = 0, ipt;
+  long iset = 0;
+  lsize ipt;
 
-  if (F64K())
-    return -1;
-  rgpt = RgAllocate(m_x*m_y, BFSS);
+  rgpt = RgAllocate((lsize)m_x*m_y, BFSS);
   if (rgpt == NULL)
     return -1;
-  ClearPb(rgpt, m_y*m_x * sizeof(BFSS));
+  ClearPb(rgpt, (lsize)m_y*m_x * sizeof(BFSS));
 
   // Potentially allow all off pixels in a 2nd bitmap to act as the solution.
   if (FBitmapSubset(bSol))
@@ -263,17 +262,17 @@ long CMaz::DoCrackBlindAlleys(CONST CMaz &bSol)
 
       // For each section of passages that hasn't already been filled, flood
       // it and all passages that connect with it with a unique id number.
-      if (!Get(x, y) && rgpt[(long)y * m_x + x].parent <= 0) {
+      if (!Get(x, y) && rgpt[(lsize)y * m_x + x].parent <= 0) {
         iset++;
         ipt = 0;
         x2 = x; y2 = y;
 LSet:
-        rgpt[(long)y2 * m_x + x2].parent = iset;
+        rgpt[(lsize)y2 * m_x + x2].parent = iset;
 LNext:
         for (d = 0; d < DIRS; d++) {
           xnew = x2 + xoff[d]; ynew = y2 + yoff[d];
           if (FLegal(xnew, ynew) && !_Get(xnew, ynew) &&
-            rgpt[(long)ynew * m_x + xnew].parent <= 0) {
+            rgpt[(lsize)ynew * m_x + xnew].parent <= 0) {
             FillPush(x2, y2);
             x2 = xnew; y2 = ynew;
             goto LSet;
@@ -288,11 +287,11 @@ LNext:
   // For each pair of cells, remove the wall segment there if connected.
   for (y = 1; y < m_y; y += zInc)
     for (x = 1; x < m_x; x += zInc) {
-      ipt = rgpt[(long)y * m_x + x].parent;
+      ipt = rgpt[(lsize)y * m_x + x].parent;
       if (ipt > 0) {
-        if (x < m_x-2 && ipt == rgpt[(long)y * m_x + (x+2)].parent)
+        if (x < m_x-2 && ipt == rgpt[(lsize)y * m_x + (x+2)].parent)
           Set0(x+1, y);
-        if (y < m_y-2 && ipt == rgpt[(long)(y+2) * m_x + x].parent)
+        if (y < m_y-2 && ipt == rgpt[(lsize)(y+2) * m_x + x].parent)
           Set0(x, y+1);
       }
     }
@@ -313,30 +312,29 @@ long CMaz::DoMarkBlindAlleys()
 {
   BFSS *rgpt;
   int zInc = 2 - ms.fSolveEveryPixel, x, y, x2, y2, xnew, ynew, d;
-  long count = 0, iset = 0, ipt;
+  long count = 0, iset = 0;
+  lsize ipt;
 
-  if (F64K())
-    return -1;
-  rgpt = RgAllocate(m_x*m_y, BFSS);
+  rgpt = RgAllocate((lsize)m_x*m_y, BFSS);
   if (rgpt == NULL)
     return -1;
-  ClearPb(rgpt, m_y*m_x * sizeof(BFSS));
+  ClearPb(rgpt, (lsize)m_y*m_x * sizeof(BFSS));
   for (y = 0; y < m_y; y += zInc)
     for (x = 0; x < m_x; x += zInc)
 
       // For each section of walls that hasn't already been filled, flood it
       // and all walls that connect with it with a unique id number.
-      if (Get(x, y) && rgpt[(long)y * m_x + x].parent <= 0) {
+      if (Get(x, y) && rgpt[(lsize)y * m_x + x].parent <= 0) {
         iset++;
         ipt = 0;
         x2 = x; y2 = y;
 LSet:
-        rgpt[(long)y2 * m_x + x2].parent = iset;
+        rgpt[(lsize)y2 * m_x + x2].parent = iset;
 LNext:
         for (d = 0; d < DIRS; d++) {
           xnew = x2 + xoff[d]; ynew = y2 + yoff[d];
           if (GetFast(xnew, ynew) &&
-            rgpt[(long)ynew * m_x + xnew].parent <= 0) {
+            rgpt[(lsize)ynew * m_x + xnew].parent <= 0) {
             FillPush(x2, y2);
             x2 = xnew; y2 = ynew;
             goto LSet;
@@ -351,11 +349,11 @@ LNext:
   // For each pair of wall endpoints, add a wall segment there if connected.
   for (y = 0; y < m_y; y += zInc)
     for (x = 0; x < m_x; x += zInc) {
-      ipt = rgpt[(long)y * m_x + x].parent;
+      ipt = rgpt[(lsize)y * m_x + x].parent;
       if (ipt > 0) {
-        if (x < m_x-2 && ipt == rgpt[(long)y * m_x + (x+2)].parent)
+        if (x < m_x-2 && ipt == rgpt[(lsize)y * m_x + (x+2)].parent)
           Set1(x+1, y);
-        if (y < m_y-2 && ipt == rgpt[(long)(y+2) * m_x + x].parent)
+        if (y < m_y-2 && ipt == rgpt[(lsize)(y+2) * m_x + x].parent)
           Set1(x, y+1);
       }
     }
@@ -437,8 +435,8 @@ long CMaz::SolveMazeFillBlindAlleys(int xa, int ya, int xb, int yb)
 #define STREAMS 10000
 
 typedef struct _collision {
-  ushort x;
-  ushort y;
+  int x;
+  int y;
   char mode;
   char unused;
 } COLL;
@@ -456,8 +454,6 @@ long CMaz::DoMarkCollisions(int x, int y)
   int x0, y0, xnew, ynew, streams = 1, i, j, d;
   long count = 0;
 
-  if (F64K())
-    return -1;
   if (FLegalOff(x, y)) {
     x0 = x; y0 = y;
   } else {
@@ -642,10 +638,11 @@ long CMaz::SolveMazeShortest(int x, int y, int x2, int y2, flag fCorner)
 {
   BFSS *bfss;
   int xnew, ynew, d, dMax = DIRS + fCorner*DIRS, dInc = 1, dir;
-  long count = 0, iLo = 0, iHi = 1, iMax = 1, i;
+  long count = 0;
+  lsize iLo = 0, iHi = 1, iMax = 1, i;
   flag fAny, fAny2, fDotsOnly;
 
-  bfss = RgAllocate(m_x*m_y, BFSS);
+  bfss = RgAllocate((lsize)m_x*m_y, BFSS);
   if (bfss == NULL)
     return -1;
   fAny2 = FLegalOff(x2, y2) && (x2 != 0 || y2 != 0);
@@ -708,23 +705,24 @@ long CMaz::SolveMazeShortest2(int x, int y, int x2, int y2, flag fCorner)
 {
   PT *rgpt = NULL;
   int xnew, ynew, d, d2, dMax = DIRS + fCorner*DIRS;
-  long *rgl = NULL, count = 0, iLo = 0, iHi = 1, iMax = 1, i;
+  long *rgl = NULL, count = 0;
+  lsize iLo = 0, iHi = 1, iMax = 1, i;
   flag fCount = ms.fCountShortest, fAny, fAny2, fDotsOnly;
 
-  if (!FEnsureMazeSize(1, femsNoResize | fems64K))
+  if (!FEnsureMazeSize(1, femsNoResize))
     return fFalse;
-  rgpt = RgAllocate(m_x*m_y, PT);
+  rgpt = RgAllocate((lsize)m_x*m_y, PT);
   if (rgpt == NULL) {
     count = -1;
     goto LDone;
   }
   if (fCount) {
-    rgl = RgAllocate(m_x*m_y, long);
+    rgl = RgAllocate((lsize)m_x*m_y, long);
     if (rgl == NULL) {
       count = -1;
       goto LDone;
     }
-    ClearPb(rgl, (long)m_x*m_y*sizeof(PT));
+    ClearPb(rgl, (lsize)m_x*m_y*sizeof(long));
   }
   fAny2 = FLegalOff(x2, y2) && (x2 != 0 || y2 != 0);
   fAny = FLegalOff(x, y);
@@ -754,7 +752,7 @@ long CMaz::SolveMazeShortest2(int x, int y, int x2, int y2, flag fCorner)
             Set0(x, y);
             if (fCount) {
               count = 1;
-              rgl[y * m_x + x] = count;
+              rgl[(lsize)y * m_x + x] = count;
             }
             while (i >= 0) {
 
@@ -778,14 +776,14 @@ long CMaz::SolveMazeShortest2(int x, int y, int x2, int y2, flag fCorner)
                     for (d2 = 0; d2 < dMax; d2++) {
                       xnew = x + xoff[d2]; ynew = y + yoff[d2];
                       if (FLegal(xnew, ynew)) {
-                        count += rgl[ynew * m_x + xnew];
+                        count += rgl[(lsize)ynew * m_x + xnew];
                         if (count < 0) {
                           count = 0;
                           fCount = fFalse;
                         }
                       }
                     }
-                    rgl[y * m_x + x] = count;
+                    rgl[(lsize)y * m_x + x] = count;
                   }
                   break;
                 }
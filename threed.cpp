@@ -348,14 +348,12 @@ flag CMap3::FCubeFlip2(int nAxis, int nOp)
 flag CMap3::FCubeFill(int x, int y, int z, KV o)
 {
   PT *rgpt;
-  long ipt = 0;
+  lsize ipt = 0, lScratch = LScratchMark();
   int xnew, ynew, znew, d;
 
   if (!FLegalFillCube(x, y, z, o))
     return fTrue;
-  if (F64K())
-    return fFalse;
-  rgpt = RgAllocate(m_x3 * m_y3 * m_z3, PT);
+  rgpt = RgAllocateScratch((lsize)m_x3 * m_y3 * m_z3, PT);
   if (rgpt == NULL)
     return fFalse;
 LSet:
@@ -374,7 +372,7 @@ LSet:
     FillPop(x, y);
     z = Z3(x, y); x = X3(x); y = Y3(y);
   }
-  DeallocateP(rgpt);
+  ScratchRelease(lScratch);
   return fTrue;
 }
 
@@ -389,7 +387,7 @@ int CCol3::ColmapGraphDistance3(CONST CMon3 &t, CONST CMon3 &t2,
 {
   BFSS *bfss;
   int count = 0, xnew, ynew, znew, d;
-  long iLo = 0, iHi, iMax = 0, i;
+  lsize iLo = 0, iHi, iMax = 0, i;
   flag f;
 
   if (!t.FLegalCube(x, y, z) || t.Get3(x, y, z)) {
@@ -400,11 +398,9 @@ int CCol3::ColmapGraphDistance3(CONST CMon3 &t, CONST CMon3 &t2,
   } else {
     x = X2(x, z); y = Y2(y, z);
   }
-  if (t.F64K())
-    return -2;
   if (!FColmapGetFromBitmap(t, kv0, kv1))
     return -1;
-  bfss = RgAllocate(m_x*m_y, BFSS);
+  bfss = RgAllocate((lsize)m_x*m_y, BFSS);
   if (bfss == NULL)
     return -1;
   Set(x, y, kv1);
@@ -89,8 +89,6 @@ public:
     { Inv(X4(w, x), Y4(y, z)); }
   INLINE flag FZero3() CONST
     { return m_x3 < 1 || m_y3 < 1 || m_z3 < 1; }
-  INLINE flag F64K3() CONST
-    { return m_x3 > 0xFFFF || m_y3 > 0xFFFF || m_z3 > 0xFFFF; }
   INLINE flag FLegalCubeLevel(int x, int y) CONST
     { return x >= 0 && x < m_x3 && y >= 0 && y < m_y3; }
   INLINE flag FLegalCube(int x, int y, int z) CONST
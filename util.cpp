@@ -31,10 +31,13 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <math.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include "util.h"
 
 
-US us = {fTrue, 0L, 0L, 0L};
+US us = {fTrue, 0, 0L, 0L, 0L, 0L, 0L, cbAllocPoolDef, fFalse};
 
 
 /*
@@ -49,7 +52,7 @@ void *operator new(size_t cb)
 {
   void *pv;
 
-  pv = PAllocate((long)cb);
+  pv = PAllocate((lsize)cb);
   return pv;
 }
 
@@ -68,14 +71,280 @@ void operator delete(void *pv, void *pv2)
 }
 
 
+/*
+******************************************************************************
+** Memory Allocation Routines
+******************************************************************************
+*/
+
+// Every buffer returned by PAllocate is preceded by this header. Freed
+// buffers large enough to be worth keeping are linked into a pool of free
+// lists, one per size class, so later allocations of a similar size (such as
+// temporary bitmaps the same size as the main bitmap) reuse them instead of
+// going back to the system.
+
+typedef struct _allochead {
+  lsize cb;                 // Size of the buffer as requested by the caller
+  lsize cbSys;              // Size of the system block including this header
+  struct _allochead *pNext; // Next block in the same pool free list
+  int iClass;               // Pool size class, or -1 if never pooled
+  dword dw;                 // Sentinel to check for corrupted headers
+} AH;
+
+#define cbAllocHead ((lsize)(sizeof(AH) + 15) & ~15)
+#ifdef DEBUG
+#define cbAllocTail ((lsize)sizeof(dword))
+#else
+#define cbAllocTail 0
+#endif
+#define cbPoolMin   0x10000
+#define cPoolClass  (4*40)
+
+AH *rgpahPool[cPoolClass];
+std::atomic_flag flagAlloc = ATOMIC_FLAG_INIT;
+
+
+// Lock and unlock the allocation pool and counters. The work done while
+// locked is tiny, so just spin until the lock is available.
+
+INLINE void AllocLock()
+{
+  while (flagAlloc.test_and_set(std::memory_order_acquire))
+    std::this_thread::yield();
+}
+
+INLINE void AllocUnlock()
+{
+  flagAlloc.clear(std::memory_order_release);
+}
+
+
+// Return the pool size class for a buffer of the given size, and the size of
+// the buffer to actually allocate for that class. There are four classes per
+// power of two, so a reused buffer is at most 25% larger than needed. Return
+// -1 if the buffer is too small or too large to be pooled.
+
+int IPoolClass(lsize cb, lsize *pcbClass)
+{
+  lsize cbBase = cbPoolMin, cbStep;
+  int iPow = 0, iStep, iClass;
+
+  if (cb < cbPoolMin)
+    return -1;
+  while (cbBase <= cb >> 1) {
+    cbBase <<= 1;
+    iPow++;
+  }
+  cbStep = cbBase >> 2;
+  iStep = (int)((cb - cbBase + cbStep - 1) / cbStep);
+  iClass = (iPow << 2) + iStep;
+  if (iClass >= cPoolClass)
+    return -1;
+  *pcbClass = cbBase + iStep * cbStep;
+  return iClass;
+}
+
+
+// Allocate a memory buffer of a given size. Reuse a pooled buffer of the same
+// size class if one is available, otherwise get a new block from the system.
+// This is thread safe, and may be called from worker threads.
+
+void *PAllocate(lsize lcb)
+{
+  char sz[cchSzMax];
+  AH *pah = NULL;
+  lsize cbSys;
+  int iClass;
+
+  if (lcb < 0) {
+    PrintSz_E("Failed to allocate memory (size too large).\n");
+    return NULL;
+  }
+  iClass = IPoolClass(lcb + cbAllocTail, &cbSys);
+  if (iClass < 0)
+    cbSys = lcb + cbAllocTail;
+  cbSys += cbAllocHead;
+
+  AllocLock();
+  if (iClass >= 0 && rgpahPool[iClass] != NULL) {
+    pah = rgpahPool[iClass];
+    rgpahPool[iClass] = pah->pNext;
+    us.cAllocPool -= pah->cbSys;
+    us.cAllocReuse++;
+  }
+  AllocUnlock();
+
+  if (pah == NULL) {
+    pah = (AH *)PAllocateSys(cbSys);
+
+    // If the system is out of memory, release the pool and try again.
+    if (pah == NULL && us.cAllocPool > 0) {
+      AllocPoolFlush();
+      pah = (AH *)PAllocateSys(cbSys);
+    }
+    if (pah == NULL) {
+      sprintf(S(sz), "Failed to allocate memory (%lld bytes).\n", (quad)lcb);
+      PrintSz_E(sz);
+      return NULL;
+    }
+    pah->cbSys = cbSys;
+    pah->iClass = iClass;
+  }
+  pah->cb = lcb;
+  pah->pNext = NULL;
+  pah->dw = dwCanary;
+
+  AllocLock();
+  us.cAlloc++;
+  us.cAllocTotal++;
+  us.cAllocSize += lcb;
+  AllocUnlock();
+
+#ifdef DEBUG
+  // Put sentinel at end of allocation to check for buffer overruns.
+  *(dword *)((byte *)pah + cbAllocHead + lcb) = dwCanary;
+#endif
+  return (byte *)pah + cbAllocHead;
+}
+
+
+// Free a memory buffer allocated with PAllocate. Poolable buffers are kept
+// for reuse, as long as the pool stays within its size limit.
+
+void DeallocateP(void *pv)
+{
+  AH *pah;
+  flag fPool;
+
+  Assert(pv != NULL);
+  pah = (AH *)((byte *)pv - cbAllocHead);
+  Assert(pah->dw == dwCanary);
+#ifdef DEBUG
+  // Ensure buffer wasn't overrun during its existence.
+  Assert(*(dword *)((byte *)pv + pah->cb) == dwCanary);
+#endif
+
+  AllocLock();
+  us.cAlloc--;
+  fPool = pah->iClass >= 0 && us.cAllocPool + pah->cbSys <= us.cbAllocPoolMax;
+  if (fPool) {
+    pah->pNext = rgpahPool[pah->iClass];
+    rgpahPool[pah->iClass] = pah;
+    us.cAllocPool += pah->cbSys;
+  }
+  AllocUnlock();
+  if (!fPool)
+    DeallocateSys(pah, pah->cbSys);
+}
+
+
+// Return all buffers held in the allocation pool back to the system.
+
+void AllocPoolFlush()
+{
+  AH *pahList = NULL, *pah;
+  int i;
+
+  AllocLock();
+  for (i = 0; i < cPoolClass; i++) {
+    while (rgpahPool[i] != NULL) {
+      pah = rgpahPool[i];
+      rgpahPool[i] = pah->pNext;
+      pah->pNext = pahList;
+      pahList = pah;
+    }
+  }
+  us.cAllocPool = 0;
+  AllocUnlock();
+  while (pahList != NULL) {
+    pah = pahList;
+    pahList = pah->pNext;
+    DeallocateSys(pah, pah->cbSys);
+  }
+}
+
+
+// The scratch arena is a stack of chunks that temporary buffers are carved
+// from. A routine takes a mark before allocating, and releases back to the
+// mark when done, freeing everything allocated after it in one step. Each
+// command and operation also releases back to its starting mark when it
+// finishes, so temporaries never outlive the command that made them. The
+// arena is only for use by the main thread.
+
+typedef struct _scratchchunk {
+  struct _scratchchunk *pPrev; // Chunk below this one in the stack
+  lsize lBase;                 // Arena offset of the start of this chunk
+  lsize cb;                    // Usable size of this chunk
+  lsize cbUsed;                // Bytes of this chunk currently allocated
+} SC;
+
+#define cbScratchHead ((lsize)(sizeof(SC) + 15) & ~15)
+#define cbScratchChunk 0x100000
+
+SC *pscScratch = NULL;
+
+
+// Allocate a temporary buffer from the scratch arena.
+
+void *PAllocateScratch(lsize lcb)
+{
+  SC *psc = pscScratch;
+  void *pv;
+
+  if (lcb < 0) {
+    PrintSz_E("Failed to allocate memory (size too large).\n");
+    return NULL;
+  }
+  lcb = (lcb + 15) & ~15;
+  if (psc == NULL || psc->cbUsed + lcb > psc->cb) {
+    psc = (SC *)PAllocate(cbScratchHead + Max(lcb, cbScratchChunk));
+    if (psc == NULL)
+      return NULL;
+    psc->pPrev = pscScratch;
+    psc->lBase = pscScratch == NULL ? 0 : pscScratch->lBase + pscScratch->cb;
+    psc->cb = Max(lcb, cbScratchChunk);
+    psc->cbUsed = 0;
+    pscScratch = psc;
+  }
+  pv = (byte *)psc + cbScratchHead + psc->cbUsed;
+  psc->cbUsed += lcb;
+  return pv;
+}
+
+
+// Return the current top of the scratch arena, to later release back to.
+
+lsize LScratchMark()
+{
+  return pscScratch == NULL ? 0 : pscScratch->lBase + pscScratch->cbUsed;
+}
+
+
+// Free all scratch arena buffers allocated since the given mark was taken.
+
+void ScratchRelease(lsize lMark)
+{
+  SC *psc;
+
+  Assert(lMark <= LScratchMark());
+  while (pscScratch != NULL && pscScratch->lBase >= lMark) {
+    psc = pscScratch;
+    pscScratch = psc->pPrev;
+    DeallocateP(psc);
+  }
+  if (pscScratch != NULL)
+    pscScratch->cbUsed = lMark - pscScratch->lBase;
+}
+
+
 // Change the size of a memory allocation, containing a list of cElem items of
 // cbElem size, to a list of cElemNew items of cbElem size.
 
-void *ReallocateArray(void *rgElem, int cElem, int cbElem, int cElemNew)
+void *ReallocateArray(void *rgElem, lsize cElem, int cbElem, lsize cElemNew)
 {
   void *rgElemNew;
 
-  rgElemNew = PAllocate(cElemNew * cbElem);
+  rgElemNew = PAllocate(LMul(cElemNew, cbElem));
   if (rgElemNew == NULL)
     return NULL;
   ClearPb(rgElemNew, cElemNew * cbElem);
@@ -144,6 +413,17 @@ void CopyRgb(CONST char *pbFrom, char *pbTo, long cb)
 }
 
 
+// Return whether two buffers contain the same bytes.
+
+flag FEqualRgb(CONST char *pb1, CONST char *pb2, long cb)
+{
+  while (cb--)
+    if (*pb1++ != *pb2++)
+      return fFalse;
+  return fTrue;
+}
+
+
 // Return length of a zero terminated string, not including the terminator.
 
 int CchSz(CONST char *sz)
@@ -398,15 +678,14 @@ dword LRead(FILE *file)
 }
 
 
-// Multiplication function. Return x*y, checking for overflow.
+// Multiplication function for memory sizes. Return x*y, or -1 if either
+// parameter is negative or the product would overflow.
 
-long LMul(long x, long y)
+lsize LMul(lsize x, lsize y)
 {
-  long z = x * y;
-
-  if (y != 0 && z / y != x)
-    return 0x80000000;
-  return z;
+  if (x < 0 || y < 0 || (y > 0 && x > lsizeHighest / y))
+    return -1;
+  return x * y;
 }
 
 
@@ -1083,4 +1362,116 @@ int Rnd(int n1, int n2)
   return nT + n1;
 }
 
+
+// Return a random 32 bit number that depends only on a seed and two counter
+// values. Unlike LRnd() there's no state, so numbers in a random stream can
+// be computed in any order, or by multiple threads at once, and still give
+// the same results. Each input gets stirred in with the SplitMix64 finalizer.
+
+ulong LRndHash(ulong lSeed, ulong l1, ulong l2)
+{
+  qword q;
+
+  q = (qword)lSeed + 0x9E3779B97F4A7C15ULL;
+  q = (q ^ (q >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  q = (q ^ (q >> 27)) * 0x94D049BB133111EBULL;
+  q ^= (q >> 31) ^ (qword)l1;
+  q = (q ^ (q >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  q = (q ^ (q >> 27)) * 0x94D049BB133111EBULL;
+  q ^= (q >> 31) ^ (qword)l2;
+  q = (q ^ (q >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  q = (q ^ (q >> 27)) * 0x94D049BB133111EBULL;
+  q ^= (q >> 31);
+  return (ulong)(q >> 32);
+}
+
+
+/*
+******************************************************************************
+** Thread Routines
+******************************************************************************
+*/
+
+// Return the number of worker threads that multithreaded routines should
+// use. This is the nThreadCount setting if positive, otherwise the number of
+// hardware threads the system supports.
+
+int CThread()
+{
+  int n = us.nThread;
+
+  if (n <= 0)
+    n = (int)std::thread::hardware_concurrency();
+  EnsureBetween(n, 1, cThreadMax);
+  return n;
+}
+
+
+// Run a function on several threads at once, passing each call the same data
+// pointer and a different index from 0 to cthread-1, and wait for all the
+// threads to finish. Index 0 runs on the calling thread. The function must
+// not touch global state or the display. It may allocate memory, but not from
+// the scratch arena.
+
+void RunThreads(PFNTHREAD pfn, void *pv, int cthread)
+{
+  std::thread *rgthread[cThreadMax];
+  int i;
+
+  EnsureBetween(cthread, 1, cThreadMax);
+  for (i = 1; i < cthread; i++)
+    rgthread[i] = new std::thread(pfn, pv, i);
+  (*pfn)(pv, 0);
+  for (i = 1; i < cthread; i++) {
+    rgthread[i]->join();
+    delete rgthread[i];
+  }
+}
+
+
+/*
+******************************************************************************
+** Profiling Routines
+******************************************************************************
+*/
+
+// Return a monotonic time stamp in microseconds, for measuring how long
+// things take. Unlike the Timer script function, this is always elapsed wall
+// clock time, in both Windows and windowless builds.
+
+uquad LTimeMicro()
+{
+  return (uquad)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// Start timing a span of code. When profiling is off this doesn't even read
+// the clock, so spans may be left in place around actions and frames.
+
+void ProfileStart(PROFT *pt)
+{
+  if (!us.fProfile) {
+    pt->lTime = 0;
+    return;
+  }
+  pt->lTime = LTimeMicro();
+  pt->cbAlloc = us.cAllocSize;
+}
+
+
+// Stop timing a span of code started with ProfileStart, and add its elapsed
+// time and memory allocated to a profile record, if profiling was on both
+// when the span started and when it ends. The same span may be added to more
+// than one record, such as a per action and a per phase one.
+
+void ProfileStop(PROF *pprof, CONST PROFT *pt)
+{
+  if (!us.fProfile || pt->lTime == 0)
+    return;
+  pprof->cCall++;
+  pprof->lTime += LTimeMicro() - pt->lTime;
+  pprof->cbAlloc += us.cAllocSize - pt->cbAlloc;
+}
+
 /* util.cpp */
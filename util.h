@@ -96,6 +96,7 @@
 #define rRound   0.5
 #define rMinute  0.000001
 #define lHighest 0x7FFFFFFF
+#define lsizeHighest ((lsize)((size_t)-1 >> 1))
 #define nDegMax  360
 #define nDegHalf 180
 #define cLetter  26
@@ -107,6 +108,7 @@
 #define chMost   '\377'
 #define dwSet    0xFFFFFFFF
 #define dwCanary 0x12345678
+#define cbAllocPoolDef (256L << 20)
 
 #define cchSzDef 80
 #define cchSzMax 255
@@ -229,7 +231,11 @@ enum _printmode {
 
 typedef unsigned char byte;
 typedef unsigned short word;
+#ifdef PC
 typedef unsigned long dword;
+#else
+typedef unsigned int dword; // Longs may be 64 bits on other compilers
+#endif
 typedef unsigned __int64 qword;
 typedef unsigned char uchar;
 typedef unsigned short ushort;
@@ -238,24 +244,29 @@ typedef unsigned __int64 uquad;
 typedef unsigned int uint;
 typedef double real;
 typedef __int64 quad;
+#ifdef _WIN64
+typedef __int64 lsize; // Memory size or index, as wide as a pointer
+#else
+typedef long lsize;
+#endif
 typedef int flag;
 typedef short *TRIE;
 
 typedef struct _point {
-  ushort x;
-  ushort y;
+  int x;
+  int y;
 } PT;
 
 typedef struct _point3 {
-  ushort w;
-  ushort x;
-  ushort y;
-  ushort z;
+  int w;
+  int x;
+  int y;
+  int z;
 } PT3;
 
 typedef struct _bfss { // Breadth First Search Struct
-  ushort x, y;
-  long parent;
+  int x, y;
+  lsize parent;
 } BFSS;
 
 typedef struct _minmax {
@@ -267,9 +278,14 @@ typedef struct _utilitysettings {
   // Macro accessible only settings
 
   flag fRndOld;
+  int nThread;
   long cAlloc;
   long cAllocTotal;
-  long cAllocSize;
+  lsize cAllocSize;
+  long cAllocReuse;
+  lsize cAllocPool;
+  lsize cbAllocPoolMax;
+  flag fProfile;
 } US;
 
 #define PutPt(ipt, xval, yval) rgpt[ipt].x = xval; rgpt[ipt].y = yval;
@@ -299,8 +315,8 @@ extern void AssertCore(flag);
 #define Assert(f)
 #endif
 extern int PrintSzCore(CONST char *, int);
-extern void *PAllocate(long);
-extern void DeallocateP(void *);
+extern void *PAllocateSys(lsize);
+extern void DeallocateSys(void *, lsize);
 extern byte BRead(FILE *);
 
 // Functions implemented locally
@@ -308,8 +324,15 @@ extern void *operator new(size_t);
 extern void *operator new(size_t, void *);
 extern void operator delete(void *);
 extern void operator delete(void *, void *);
+extern void *PAllocate(lsize);
+extern void DeallocateP(void *);
+extern void AllocPoolFlush(void);
+extern void *PAllocateScratch(lsize);
+extern lsize LScratchMark(void);
+extern void ScratchRelease(lsize);
 #define RgAllocate(c, t) ((t *)PAllocate((c) * sizeof(t)))
-extern void *ReallocateArray(void *, int, int, int);
+#define RgAllocateScratch(c, t) ((t *)PAllocateScratch((c) * sizeof(t)))
+extern void *ReallocateArray(void *, lsize, int, lsize);
 extern int PrintSzNCore(CONST char *, int, int);
 extern int PrintSzNNCore(CONST char *, int, int, int);
 extern int PrintSzLCore(CONST char *, long, int);
@@ -331,6 +354,7 @@ extern int PrintSzLCore(CONST char *, long, int);
 #define PrintSzL_E(sz, l) PrintSzLCore(sz, l, nPrintError)
 extern flag FErrorRange(CONST char *, int, int, int);
 extern void CopyRgb(CONST char *, char *, long);
+extern flag FEqualRgb(CONST char *, CONST char *, long);
 extern int CchSz(CONST char *);
 extern int CompareSz(CONST char *, CONST char *);
 extern int CompareSzI(CONST char *, CONST char *);
@@ -354,7 +378,7 @@ extern FILE *FileOpen(CONST char *, CONST char *);
 extern void WriteSz(FILE *file, CONST char *);
 extern word WRead(FILE *file);
 extern dword LRead(FILE *file);
-extern long LMul(long, long);
+extern lsize LMul(lsize, lsize);
 extern long LDiv(long, long);
 extern long LMod(long, long);
 extern long LPower(long, long);
@@ -423,5 +447,42 @@ extern int ILookupTrie(CONST TRIE, CONST char *, int, flag);
 void InitRndL(ulong);
 void InitRndRgl(ulong[], int);
 extern int Rnd(int, int);
+extern ulong LRndHash(ulong, ulong, ulong);
+
+
+/*
+******************************************************************************
+** Thread Routines
+******************************************************************************
+*/
+
+#define cThreadMax 64
+
+typedef void (*PFNTHREAD)(void *, int);
+
+extern int CThread(void);
+extern void RunThreads(PFNTHREAD, void *, int);
+
+
+/*
+******************************************************************************
+** Profiling Routines
+******************************************************************************
+*/
+
+typedef struct _profile {
+  long cCall;     // Number of times the span was timed
+  uquad lTime;    // Total microseconds spent in the span
+  lsize cbAlloc;  // Total bytes allocated within the span
+} PROF;
+
+typedef struct _profiletimer {
+  uquad lTime;
+  lsize cbAlloc;
+} PROFT;
+
+extern uquad LTimeMicro(void);
+extern void ProfileStart(PROFT *);
+extern void ProfileStop(PROF *, CONST PROFT *);
 
 /* util.h */
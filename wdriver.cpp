@@ -148,62 +148,20 @@ LDone:
 }
 
 
-// Allocate a memory buffer of a given size, in a Windows specific manner.
+// Allocate a memory block of a given size from the system, in a Windows
+// specific manner.
 
-void *PAllocate(long lcb)
+void *PAllocateSys(lsize lcb)
 {
-  char sz[cchSzMax];
-  void *pv;
-
-#ifdef DEBUG
-  pv = GlobalAlloc(GMEM_FIXED, lcb + sizeof(dword)*3);
-#else
-  pv = GlobalAlloc(GMEM_FIXED, lcb);
-#endif
-
-  // Handle success or failure of the allocation.
-  if (pv == NULL) {
-    sprintf(S(sz), "Failed to allocate memory (%ld bytes).\n", lcb);
-    PrintSz_E(sz);
-  } else {
-    us.cAlloc++;
-    us.cAllocTotal++;
-    us.cAllocSize += lcb;
-  }
-
-#ifdef DEBUG
-  // Put sentinels at ends of allocation to check for buffer overruns.
-  *(dword *)pv = dwCanary;
-  *(dword *)((byte *)pv + sizeof(dword)) = lcb;
-  *(dword *)((byte *)pv + sizeof(dword)*2 + lcb) = dwCanary;
-  return (byte *)pv + sizeof(dword)*2;
-#else
-  return pv;
-#endif
+  return GlobalAlloc(GMEM_FIXED, lcb);
 }
 
 
-// Free a memory buffer allocated with PAllocate.
+// Free a memory block allocated with PAllocateSys.
 
-void DeallocateP(void *pv)
+void DeallocateSys(void *pv, lsize lcb)
 {
-  Assert(pv != NULL);
-#ifdef DEBUG
-  // Ensure buffer wasn't overrun during its existence.
-  void *pvSys;
-  dword lcb, dw;
-  pvSys = (byte *)pv - sizeof(dword)*2;
-  Assert(pvSys != NULL);
-  dw = *(dword *)pvSys;
-  Assert(dw == dwCanary);
-  lcb = *(dword *)((byte *)pvSys + sizeof(dword));
-  dw = *(dword *)((byte *)pv + lcb);
-  Assert(dw == dwCanary);
-  GlobalFree((HGLOBAL)pvSys);
-#else
   GlobalFree((HGLOBAL)pv);
-#endif
-  us.cAlloc--;
 }
 
 
@@ -219,7 +177,7 @@ void UpdateDisplay()
   if (!ws.fAllowUpdate && !gs.fTraceDot)
     return;
   xlSav = xl; ylSav = yl; xhSav = xh; yhSav = yh;
-  DirtyView();
+  DirtyViewPartial();
   xl = xlSav; yl = ylSav; xh = xhSav; yh = yhSav;
 }
 
@@ -491,6 +449,8 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hPrevInstance,
     DispatchMessage(&msg);
   }
   wi.hwndMain = NULL;
+  if (FSzVar(ws.nProfileFile))
+    FProfileDump(SzVar(ws.nProfileFile));
 
   // The program is terminating. Free all memory that's been allocated.
 
@@ -507,6 +467,8 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hPrevInstance,
     DeallocateP(bm.coor);
   if (bm.patch != NULL)
     DeallocateP(bm.patch);
+  VertexStoreFree(&ds.vsWire);
+  VertexStoreFree(&ds.vsPatch);
   if (ds.rgstar != NULL)
     DeallocateP(ds.rgstar);
   if (dr.rgcalc != NULL)
@@ -538,6 +500,7 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hPrevInstance,
     DeallocateP(ws.rgszVar);
   }
   DeallocateTextures();
+  RecordFree();
   if (ws.rgsTrieAlloc != NULL)
     DeallocateP(ws.rgsTrieAlloc);
   if (ws.rgsTrieConst != NULL)
@@ -547,6 +510,10 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE hPrevInstance,
   if (ms.fileInf != NULL)
     fclose(ms.fileInf);
 
+  ScratchMapFree();
+  InsideCacheFree();
+  AllocPoolFlush();
+
   // Check for memory leaks.
   if (gs.fErrorCheck && us.cAlloc != 0)
     PrintSzL_E("Number of allocations not freed before exiting: %ld",
@@ -141,7 +141,9 @@ void Redraw(HWND);
 // From wutil.cpp
 
 void CopyBitmapToDeviceBitmap(void);
+flag FCopyDirtyToDeviceBitmap(void);
 void DirtyView(void);
+void DirtyViewPartial(void);
 void BitmapDot(int, int);
 flag FBootExternal(CONST char *, flag);
 void RedoMenu(HWND);
@@ -96,6 +96,48 @@ void CopyBitmapToDeviceBitmap()
     SetDIBitsToDevice(wi.hdcBmp, 0, 0, bm.xaC, bm.yaC, 0, 0, 0, bm.yaC,
       bm.k.m_rgb, (BITMAPINFO *)&wi.biC, DIB_RGB_COLORS);
   }
+  DirtyClear();
+}
+
+
+// Copy just the rectangles of the active bitmap that have changed since the
+// last update to the window display bitmap. Returns false if this can't be
+// done, such as if the bitmap changed size, meaning do a full copy instead.
+
+flag FCopyDirtyToDeviceBitmap()
+{
+  CMap *b = PbFocus();
+  BITMAPINFOHEADER *pbi;
+  DIRTY *pd;
+  long cbRow;
+  int i, h;
+
+  if (gs.fDirtyAll || b != gs.bFocus)
+    return fFalse;
+  if (!bm.fColor) {
+    if (b->m_x != bm.xa || b->m_y != bm.ya)
+      return fFalse;
+    pbi = &wi.bi;
+  } else {
+    if (b->m_x != bm.xaC || b->m_y != bm.yaC)
+      return fFalse;
+    pbi = &wi.biC;
+  }
+
+  // Treat the rows covered by each rectangle as their own top down bitmap,
+  // and copy just the columns within it.
+  cbRow = (long)b->m_clRow << 2;
+  for (i = 0; i < gs.cDirty; i++) {
+    pd = &gs.rgDirty[i];
+    h = pd->y2 - pd->y1 + 1;
+    pbi->biHeight = -h;
+    SetDIBitsToDevice(wi.hdcBmp, pd->x1, pd->y1, pd->x2 - pd->x1 + 1, h,
+      pd->x1, 0, 0, h, b->m_rgb + cbRow * pd->y1, (BITMAPINFO *)pbi,
+      DIB_RGB_COLORS);
+  }
+  pbi->biHeight = -b->m_y;
+  DirtyClear();
+  return fTrue;
 }
 
 
@@ -111,6 +153,19 @@ void DirtyView()
 }
 
 
+// Part of the active bitmap being viewed has changed, such as in the middle
+// of creating a Maze. Like DirtyView but only copies the changed areas.
+
+void DirtyViewPartial()
+{
+  if (!ws.fNoDirty)
+    return;
+  if (!FCopyDirtyToDeviceBitmap())
+    CopyBitmapToDeviceBitmap();
+  Redraw(wi.hwnd);
+}
+
+
 // Change a pixel in both the main bitmap and on the screen. This updates just
 // the pixel in question as opposed to redrawing the whole bitmap.
 